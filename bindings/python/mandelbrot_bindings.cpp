@@ -0,0 +1,191 @@
+//
+// Python module exposing the C++ engine to src/python and notebooks.
+//
+#include <complex>
+#include <vector>
+
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/complex.h>
+
+#include "src/cpp/colormaps.hpp"
+#include "src/cpp/formulas.hpp"
+#include "src/cpp/mandelbrot.hpp"
+#include "src/cpp/output_sink.hpp"
+#include "src/cpp/thread_pool.hpp"
+
+namespace py = pybind11;
+
+namespace {
+    // started on first use and shared by every call, like the batch renderer's pool
+    thread_pool::ThreadPool &engine_pool() {
+        static thread_pool::ThreadPool pool;
+        return pool;
+    }
+
+    // hands the engine-owned vector over to NumPy without copying:
+    // the capsule becomes the array's base object and frees the vector with it
+    template<typename T>
+    py::array_t<T> as_numpy(std::vector<T> &&values, const std::vector<py::ssize_t> &shape) {
+        auto *owned = new std::vector<T>(std::move(values));
+        py::capsule owner(owned, [](void *ptr) { delete static_cast<std::vector<T> *>(ptr); });
+        return py::array_t<T>(shape, owned->data(), owner);
+    }
+
+    py::array_t<int> render_greyscale(
+            int width,
+            int height,
+            double real_min,
+            double real_max,
+            double imag_min,
+            double imag_max,
+            double threshold,
+            int n_iterations,
+            const std::string &formula_name,
+            int power,
+            std::complex<double> julia_c
+    ) {
+        if (width < 2 || height < 2) {
+            throw std::invalid_argument("width and height must be >= 2");
+        }
+        mandelbrot::ViewParams vp{real_min, real_max, imag_min, imag_max, 0.0, 0.0, 0.0};
+        formulas::FormulaSpec spec{formula_name, power, julia_c};
+
+        std::vector<int> mandelbrot_set;
+        bool known_formula;
+        {
+            py::gil_scoped_release release;
+            known_formula = formulas::visit_formula(spec, [&](const auto &formula) {
+                mandelbrot::render_greyscale(
+                        engine_pool(), formula, width, height, vp, threshold, n_iterations, mandelbrot_set
+                );
+            });
+        }
+        if (!known_formula) {
+            throw std::invalid_argument("unknown formula '" + formula_name + "' or unsupported power");
+        }
+        return as_numpy(std::move(mandelbrot_set), {height, width});
+    }
+
+    // Renders into a caller-owned array, the pixel format following its dtype: (h, w) uint8, uint16, float32
+    // or int32, or (h, w, 3) uint8 for RGB through `colormap`. Rows may be strided (a slice of a bigger
+    // array), pixels within a row must be contiguous.
+    void render_into(
+            py::array out,
+            double real_min,
+            double real_max,
+            double imag_min,
+            double imag_max,
+            double threshold,
+            int n_iterations,
+            const std::string &formula_name,
+            int power,
+            std::complex<double> julia_c,
+            const std::string &colormap_name
+    ) {
+        if (!out.writeable()) {
+            throw std::invalid_argument("out must be writeable");
+        }
+        output_sink::PixelFormat format;
+        bool rgb = out.ndim() == 3 && out.shape(2) == 3;
+        if (rgb && py::isinstance<py::array_t<uint8_t>>(out)) {
+            format = output_sink::PixelFormat::RGB8;
+        } else if (out.ndim() != 2) {
+            throw std::invalid_argument("out must have shape (height, width) or (height, width, 3)");
+        } else if (py::isinstance<py::array_t<uint8_t>>(out)) {
+            format = output_sink::PixelFormat::U8;
+        } else if (py::isinstance<py::array_t<uint16_t>>(out)) {
+            format = output_sink::PixelFormat::U16;
+        } else if (py::isinstance<py::array_t<float>>(out)) {
+            format = output_sink::PixelFormat::F32;
+        } else if (py::isinstance<py::array_t<int32_t>>(out)) {
+            format = output_sink::PixelFormat::I32;
+        } else {
+            throw std::invalid_argument("out must be uint8, uint16, float32 or int32");
+        }
+        auto width = static_cast<int>(out.shape(1)), height = static_cast<int>(out.shape(0));
+        if (width < 2 || height < 2) {
+            throw std::invalid_argument("width and height must be >= 2");
+        }
+        size_t pixel_bytes = output_sink::bytes_per_pixel(format);
+        if (out.strides(1) != static_cast<py::ssize_t>(pixel_bytes) || (rgb && out.strides(2) != 1) ||
+            out.strides(0) < static_cast<py::ssize_t>(pixel_bytes * width)) {
+            throw std::invalid_argument("pixels of a row of out must be contiguous");
+        }
+        colormaps::Colormap colormap{};
+        if (!colormap_name.empty() && !colormaps::find(colormap_name, colormap)) {
+            throw std::invalid_argument("unknown colormap '" + colormap_name + "'");
+        }
+
+        output_sink::Sink sink{out.mutable_data(), width, height, static_cast<size_t>(out.strides(0)), format,
+                               colormap_name.empty() ? nullptr : &colormap};
+        mandelbrot::ViewParams vp{real_min, real_max, imag_min, imag_max, 0.0, 0.0, 0.0};
+        formulas::FormulaSpec spec{formula_name, power, julia_c};
+        bool known_formula;
+        {
+            py::gil_scoped_release release;
+            known_formula = formulas::visit_formula(spec, [&](const auto &formula) {
+                mandelbrot::render_greyscale(engine_pool(), formula, vp, threshold, n_iterations, sink);
+            });
+        }
+        if (!known_formula) {
+            throw std::invalid_argument("unknown formula '" + formula_name + "' or unsupported power");
+        }
+    }
+
+    py::array_t<int> mandelbrot_sequence(
+            const py::array_t<std::complex<double>, py::array::c_style | py::array::forcecast> &complex_set,
+            double threshold,
+            int n_iterations
+    ) {
+        // c_style guarantees a contiguous buffer, so the input is read in place
+        const std::complex<double> *values = complex_set.data();
+        auto n_values = static_cast<int>(complex_set.size());
+        std::vector<py::ssize_t> shape(complex_set.shape(), complex_set.shape() + complex_set.ndim());
+
+        std::vector<int> mandelbrot_set(n_values);
+        {
+            py::gil_scoped_release release;
+            const int chunk_size = 4096;
+            int n_chunks = (n_values + chunk_size - 1) / chunk_size;
+            engine_pool().parallel_for(n_chunks, [&](int idx_chunk) {
+                int end = std::min(n_values, (idx_chunk + 1) * chunk_size);
+                for (int idx_value = idx_chunk * chunk_size; idx_value < end; idx_value++) {
+                    mandelbrot_set[idx_value] = mandelbrot::escape_greyscale(values[idx_value], threshold, n_iterations);
+                }
+            });
+        }
+        return as_numpy(std::move(mandelbrot_set), shape);
+    }
+}
+
+PYBIND11_MODULE(mandelbrot_cpp, m) {
+    m.doc() = "Native Mandelbrot engine; results are NumPy arrays backed by engine-owned memory";
+
+    m.def("render_greyscale", &render_greyscale,
+          "Render a (height, width) int32 greyscale image of the view on all cores;\n"
+          "formula is one of mandelbrot, julia, multibrot, burning_ship, tricorn",
+          py::arg("width"), py::arg("height"),
+          py::arg("real_min") = -2.5, py::arg("real_max") = 1.0,
+          py::arg("imag_min") = -1.1, py::arg("imag_max") = 1.1,
+          py::arg("threshold") = 6.0, py::arg("n_iterations") = 35,
+          py::arg("formula") = "mandelbrot", py::arg("power") = 2,
+          py::arg("julia_c") = std::complex<double>(-0.8, 0.156));
+
+    m.def("render_into", &render_into,
+          "Render the view straight into `out`, without an intermediate buffer; the dtype picks the pixels:\n"
+          "(h, w) uint8 / int32 greyscale, uint16 (0-65535), float32 (0-1), or (h, w, 3) uint8 RGB through\n"
+          "`colormap` (gist_ncar, prism, flag, ocean; grey if empty)",
+          py::arg("out"),
+          py::arg("real_min") = -2.5, py::arg("real_max") = 1.0,
+          py::arg("imag_min") = -1.1, py::arg("imag_max") = 1.1,
+          py::arg("threshold") = 6.0, py::arg("n_iterations") = 35,
+          py::arg("formula") = "mandelbrot", py::arg("power") = 2,
+          py::arg("julia_c") = std::complex<double>(-0.8, 0.156), py::arg("colormap") = "");
+
+    m.def("mandelbrot_sequence", &mandelbrot_sequence,
+          "Greyscale value for every point of a complex128 array; the result has the input's shape",
+          py::arg("complex_set"), py::arg("threshold") = 2.0, py::arg("n_iterations") = 35);
+
+    m.def("n_threads", [] { return engine_pool().size(); }, "Number of engine worker threads");
+}
@@ -0,0 +1,118 @@
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include <cxxopts.hpp>
+#include "spdlog/spdlog.h"
+
+#include "src/cpp/fixed_point.hpp"
+#include "src/cpp/perturbation.hpp"
+
+
+// nanoseconds per call of op(a, b), over a chain of dependent calls so they cannot overlap
+template<typename T, typename Op>
+double time_op(const T &a, const T &b, int n_ops, Op &&op) {
+    T value = a;
+    auto t_start = std::chrono::steady_clock::now();
+    for (int idx = 0; idx < n_ops; idx++) {
+        value = op(value, b);
+    }
+    auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t_start).count();
+    // keeps the chain from being optimised away
+    if (static_cast<double>(value) == 12345.0) {
+        spdlog::info("");
+    }
+    return elapsed / n_ops;
+}
+
+template<int N>
+void bench_arithmetic(int n_ops) {
+    using Real = fixed_point::Fixed<N>;
+    // |a|, |b| < 1 keep the product and square chains bounded
+    Real a(0.7390851332151607), b(-0.9999999999999999);
+    double add_ns = time_op(a, b, n_ops, [](const Real &x, const Real &y) { return x + y; });
+    double mul_ns = time_op(a, b, n_ops, [](const Real &x, const Real &y) { return x * y; });
+    double square_ns = time_op(a, b, n_ops, [](const Real &x, const Real &) { return fixed_point::square(x); });
+    spdlog::info("Fixed<{:2}> ({:4} bits): add {:6.1f} ns, mul {:6.1f} ns, square {:6.1f} ns",
+                 N, Real::FRACTION_BITS, add_ns, mul_ns, square_ns);
+}
+
+// largest error of products against long double, which holds 64 bits: a few 2^-64 at most
+template<int N>
+long double max_product_error(int n_samples) {
+    std::mt19937_64 rng(1);
+    std::uniform_real_distribution<long double> uniform(-2.0L, 2.0L);
+    long double max_error = 0.0L;
+    for (int idx = 0; idx < n_samples; idx++) {
+        long double a = uniform(rng), b = uniform(rng);
+        fixed_point::Fixed<N> fa(a), fb(b);
+        max_error = std::max(max_error, std::fabs(static_cast<long double>(fa * fb) - a * b));
+        max_error = std::max(max_error, std::fabs(static_cast<long double>(fixed_point::square(fa)) - a * a));
+    }
+    return max_error;
+}
+
+// Times the fixed-point arithmetic and a reference orbit at the precision a view of `view_width` needs,
+// against the long double orbit the shader renderer computes today.
+int main(int argc, char *argv[]) {
+    cxxopts::Options options{argv[0], "Benchmark the fixed-point type used for deep-zoom reference orbits"};
+    options.add_options()
+            ("re", "Real part of the reference point", cxxopts::value<std::string>()->default_value(
+                    "-0.743643887037158704752191506114774"))
+            ("im", "Imaginary part of the reference point", cxxopts::value<std::string>()->default_value(
+                    "0.131825904205311970493132056385139"))
+            ("view_width", "Width of the view in the complex plane", cxxopts::value<double>()->default_value("1e-200"))
+            ("w,width", "Width of the view in pixels", cxxopts::value<int>()->default_value("1920"))
+            ("i,n_iterations", "Iterations of the reference orbit", cxxopts::value<int>()->default_value("100000"))
+            ("n_ops", "Operations per arithmetic timing", cxxopts::value<int>()->default_value("2000000"));
+    auto result = options.parse(argc, argv);
+    int n_ops = result["n_ops"].as<int>();
+    int n_iterations = result["n_iterations"].as<int>();
+
+    bench_arithmetic<2>(n_ops);
+    bench_arithmetic<4>(n_ops);
+    bench_arithmetic<8>(n_ops);
+    bench_arithmetic<12>(n_ops);
+    bench_arithmetic<16>(n_ops);
+    spdlog::info("Max product error against long double: {:.3g} (Fixed<2>), {:.3g} (Fixed<12>)",
+                 static_cast<double>(max_product_error<2>(100000)), static_cast<double>(max_product_error<12>(100000)));
+
+    std::vector<float> orbit;
+    auto t_start = std::chrono::steady_clock::now();
+    int n_long_double = perturbation::reference_orbit(
+            std::stold(result["re"].as<std::string>()), std::stold(result["im"].as<std::string>()),
+            2.0, n_iterations, orbit);
+    double long_double_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_start).count();
+    std::vector<float> orbit_long_double = orbit;
+
+    int fraction_bits = fixed_point::fraction_bits_for_view(result["view_width"].as<double>(), result["width"].as<int>());
+    bool supported = fixed_point::visit_precision(fraction_bits, [&](auto zero) {
+        using Real = decltype(zero);
+        Real cr, ci;
+        if (!Real::from_string(result["re"].as<std::string>(), cr) ||
+            !Real::from_string(result["im"].as<std::string>(), ci)) {
+            spdlog::error("Could not parse the reference point");
+            return;
+        }
+        auto t_fixed = std::chrono::steady_clock::now();
+        int n_fixed = perturbation::reference_orbit(cr, ci, 2.0, n_iterations, orbit);
+        double fixed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t_fixed).count();
+
+        // the long double orbit drifts off the exact one as its rounding error is amplified
+        int n_agree = 0;
+        while (n_agree < std::min(n_fixed, n_long_double) &&
+               std::fabs(orbit[2 * n_agree] - orbit_long_double[2 * n_agree]) < 1e-3f &&
+               std::fabs(orbit[2 * n_agree + 1] - orbit_long_double[2 * n_agree + 1]) < 1e-3f) {
+            n_agree++;
+        }
+        spdlog::info("Reference orbit, {} bits needed: Fixed<{}> {} values in {:.1f} ms ({:.0f} ns / iteration), "
+                     "long double {} values in {:.1f} ms; orbits agree for {} values",
+                     fraction_bits, Real::FRACTION_BITS / 64 + 1, n_fixed, fixed_ms, 1e6 * fixed_ms / n_fixed,
+                     n_long_double, long_double_ms, n_agree);
+    });
+    if (!supported) {
+        spdlog::error("{} fraction bits is beyond Fixed<{}>", fraction_bits, fixed_point::MAX_LIMBS);
+        return -1;
+    }
+    return 0;
+}
@@ -2,7 +2,13 @@
 // Created by maksym on 16/10/23.
 //
 
+#include <chrono>
 #include <cstdio>
+#include <utility>
+
+#include <cxxopts.hpp>
+
+#include <GL/glew.h>
 
 #include "imgui.h"
 #include "backends/imgui_impl_glfw.h"
@@ -15,48 +21,95 @@
 
 #include <GLFW/glfw3.h> // Will drag system OpenGL headers
 
-#include "src/cpp/mandelbrot.hpp"
+#include "src/cpp/frame_stats_imgui.hpp"
+#include "src/cpp/render_worker.hpp"
+#include "src/cpp/utilities_shaders.hpp"
 
 
 static void glfw_error_callback(int error, const char *description) {
     fprintf(stderr, "GLFW Error %d: %s\n", error, description);
 }
 
+// CPU phases of a frame, see frame_stats::FrameStats
+enum FramePhase { PHASE_UI, PHASE_UPLOAD, PHASE_DRAW, PHASE_SWAP };
+
+// greyscale frame texture and the view it was computed for; rows [0, rows) hold data
+struct FrameTexture {
+    GLuint texture = 0;
+    int width = 0, height = 0;
+    render_worker::ViewRequest request;
+    uint64_t generation = 0;
+    int rows = 0;
+};
+
+// (re)allocates the texture storage; only needed when the frame size changes
+static void allocate_frame_texture(FrameTexture &frame, int width, int height) {
+    frame.width = width;
+    frame.height = height;
+    glBindTexture(GL_TEXTURE_2D, frame.texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, width, height, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // show the single channel as grey
+    GLint swizzle[] = {GL_RED, GL_RED, GL_RED, GL_ONE};
+    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+}
+
+// Draws the computed rows of `frame` where its view lies within `view` (which fills the display), so a
+// frame computed for an earlier view shows up scaled and shifted into place until the exact one replaces it.
+static void draw_reprojected(ImDrawList *draw_list, const FrameTexture &frame, const render_worker::ViewRequest &view,
+                             ImVec2 display_size) {
+    if (frame.rows <= 0) {
+        return;
+    }
+    const render_worker::ViewRequest &src = frame.request;
+    double scale_x = display_size.x / (view.real_max - view.real_min);
+    double scale_y = display_size.y / (view.imag_max - view.imag_min);
+    double rows_imag_max = src.imag_min + (src.imag_max - src.imag_min) * frame.rows / frame.height;
+    // row 0 of the frame is imag_min, so v runs from the top of the computed rows down to 0
+    ImVec2 top_left(static_cast<float>((src.real_min - view.real_min) * scale_x),
+                    static_cast<float>((view.imag_max - rows_imag_max) * scale_y));
+    ImVec2 bottom_right(static_cast<float>((src.real_max - view.real_min) * scale_x),
+                        static_cast<float>((view.imag_max - src.imag_min) * scale_y));
+    float v_top = static_cast<float>(frame.rows) / static_cast<float>(frame.height);
+    draw_list->AddImage((ImTextureID) (intptr_t) frame.texture, top_left, bottom_right,
+                        ImVec2(0, v_top), ImVec2(1, 0));
+}
+
 // Main code
-int main(int, char **) {
+int main(int argc, char *argv[]) {
+    cxxopts::Options options{argv[0], "Interactive Mandelbrot set explorer"};
+    options.add_options()
+            ("stats_csv", "Write per-frame timings (CPU phases and GPU time) to this CSV file",
+             cxxopts::value<std::string>()->default_value(""));
+    auto result = options.parse(argc, argv);
+
     glfwSetErrorCallback(glfw_error_callback);
     if (!glfwInit())
         return 1;
 
-    // Decide GL+GLSL versions
-#if defined(IMGUI_IMPL_OPENGL_ES2)
-    // GL ES 2.0 + GLSL 100
-    const char* glsl_version = "#version 100";
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 2);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_OPENGL_ES_API);
-#elif defined(__APPLE__)
-    // GL 3.2 + GLSL 150
-    const char* glsl_version = "#version 150";
+    // GL 3.3 core + GLSL 330, as the other window renderers: the frame texture swizzle, the fences of the pixel
+    // uploader and the GPU timer queries all need 3.3
+    const char *glsl_version = "#version 330";
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);  // 3.2+ only
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);            // Required on Mac
-#else
-    // GL 3.0 + GLSL 130
-    const char *glsl_version = "#version 130";
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
-    //glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);  // 3.2+ only
-    //glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);            // 3.0+ only
-#endif
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
     // Create window with graphics context
     GLFWwindow *window = glfwCreateWindow(1280, 720, "Dear ImGui GLFW+OpenGL3 example", nullptr, nullptr);
     if (window == nullptr)
         return 1;
     glfwMakeContextCurrent(window);
-    glfwSwapInterval(1); // Enable vsync
+    glfwSwapInterval(1); // Enable vsync - frames are computed off the UI thread, so the UI keeps the display rate
+
+    glewExperimental = GL_TRUE; // Needed in core profile
+    if (glewInit() != GLEW_OK) {
+        fprintf(stderr, "Failed to initialize GLEW\n");
+        return 1;
+    }
 
     // Setup Dear ImGui context
     IMGUI_CHECKVERSION();
@@ -91,21 +144,33 @@ int main(int, char **) {
     //ImFont* font = io.Fonts->AddFontFromFileTTF("c:\\Windows\\Fonts\\ArialUni.ttf", 18.0f, nullptr, io.Fonts->GetGlyphRangesJapanese());
     //IM_ASSERT(font != nullptr);
     // Our state
-    bool show_demo_window = true;
-    bool show_another_window = false;
+    bool show_demo_window = false;
     ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
-    GLuint Texture;
-    glGenTextures(1, &Texture);
-    glBindTexture(GL_TEXTURE_2D, Texture);
-
-    double real_min = -3.0;
-    double real_max = 1.0;
-    double imag_min = -1.5;
-    double imag_max = 1.5;
-
-    int n_iterations = 35;
-    double threshold = 6.0;
+    // `shown` is the last complete frame, `partial` fills in band by band as the worker publishes them;
+    // both are drawn reprojected into the current view, partial on top, so zooming and panning show up at
+    // once and the exact image replaces the preview as it is computed
+    FrameTexture shown, partial;
+    glGenTextures(1, &shown.texture);
+    glGenTextures(1, &partial.texture);
+    utils_shaders::PixelUploader uploader;
+
+    const render_worker::ViewRequest view_initial{0, 0, -3.0, 1.0, -1.5, 1.5, 6.0, 35};
+    render_worker::ViewRequest view = view_initial;
+    render_worker::ViewRequest view_submitted;
+
+    render_worker::RenderWorker worker;
+    auto time_submitted = std::chrono::steady_clock::now();
+    double last_frame_ms = 0.0;
+
+    // frame timing: CPU phases, GPU time through timer queries, overlay (F1 toggles)
+    bool show_stats = true;
+    frame_stats::FrameStats stats({"ui", "upload", "draw", "swap"});
+    if (!result["stats_csv"].as<std::string>().empty() && !stats.open_csv(result["stats_csv"].as<std::string>())) {
+        return 1;
+    }
+    utils_shaders::GpuTimer gpu_timer;
+    utils_shaders::create_gpu_timer(gpu_timer);
 
     // Main loop
 #ifdef __EMSCRIPTEN__
@@ -117,25 +182,15 @@ int main(int, char **) {
     while (!glfwWindowShouldClose(window))
 #endif
     {
-        int width, height;
-        glfwGetWindowSize(window, &width, &height);
-
-        std::vector<float> mandelbrot_grey = mandelbrot::gen_mandelbrot_greyscale(
-                width,
-                height,
-                real_min,
-                real_max,
-                imag_min,
-                imag_max,
-                threshold,
-                n_iterations
-        );
-
         // Poll and handle events (inputs, window resize, etc.)
         // You can read the io.WantCaptureMouse, io.WantCaptureKeyboard flags to tell if dear imgui wants to use your inputs.
         // - When io.WantCaptureMouse is true, do not dispatch mouse input data to your main application, or clear/overwrite your copy of the mouse data.
         // - When io.WantCaptureKeyboard is true, do not dispatch keyboard input data to your main application, or clear/overwrite your copy of the keyboard data.
         // Generally you may always pass all inputs to dear imgui, and hide them from your application based on those two flags.
+        stats.begin_frame();
+        utils_shaders::gpu_timer_collect(gpu_timer, [&stats](uint64_t frame, double gpu_ms) {
+            stats.set_gpu_ms(frame, gpu_ms);
+        });
         glfwPollEvents();
 
         // Start the Dear ImGui frame
@@ -147,36 +202,105 @@ int main(int, char **) {
         if (show_demo_window)
             ImGui::ShowDemoWindow(&show_demo_window);
 
-        // 2. Show a simple window that we create ourselves. We use a Begin/End pair to create a named window.
+        // 2. Mandelbrot controls
         {
-            static float f = 0.0f;
-            static int counter = 0;
-
-            // Create a window called "Hello, world!" and append into it.
-            ImGui::Begin(
-                    "Hello, world!"
-            );
-
-            ImGui::Text(
-                    "This is some useful text.");               // Display some text (you can use a format strings too)
-            ImGui::Checkbox("Demo Window", &show_demo_window);      // Edit bools storing our window open/close state
-            ImGui::Checkbox("Another Window", &show_another_window);
-
-            ImGui::SliderFloat("float", &f, 0.0f, 1.0f);            // Edit 1 float using a slider from 0.0f to 1.0f
-            ImGui::ColorEdit3("clear color", (float *) &clear_color); // Edit 3 floats representing a color
-
-            // Buttons return true when clicked (most widgets return true when edited/activated)
-            if (ImGui::Button(
-                    "Button")
-                    )
-                counter++;
-            ImGui::SameLine();
-            ImGui::Text("counter = %d", counter);
-
+            ImGui::Begin("Mandelbrot");
+            ImGui::SliderInt("iterations", &view.n_iterations, 1, 5000, "%d", ImGuiSliderFlags_Logarithmic);
+            ImGui::InputDouble("threshold", &view.threshold, 0.5, 5.0, "%.2f");
+            if (ImGui::Button("Reset view")) {
+                int width = view.width, height = view.height;
+                view = view_initial;
+                view.width = width;
+                view.height = height;
+            }
+            ImGui::Checkbox("Demo Window", &show_demo_window);
+            ImGui::ColorEdit3("clear color", (float *) &clear_color);
+
+            ImGui::Text("real [%.12g, %.12g]", view.real_min, view.real_max);
+            ImGui::Text("imag [%.12g, %.12g]", view.imag_min, view.imag_max);
+            ImGui::Text("%s, last frame %.1f ms", worker.busy() ? "rendering" : "idle", last_frame_ms);
             ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / io.Framerate, io.Framerate);
             ImGui::End();
         }
 
+        // mouse wheel zooms about the cursor, dragging pans - unless imgui is using the mouse
+        if (!io.WantCaptureMouse && io.DisplaySize.x > 0 && io.DisplaySize.y > 0) {
+            double real_range = view.real_max - view.real_min;
+            double imag_range = view.imag_max - view.imag_min;
+            if (io.MouseWheel != 0.0f) {
+                double scale = io.MouseWheel > 0.0f ? 0.8 : 1.25;
+                double cursor_real = view.real_min + real_range * io.MousePos.x / io.DisplaySize.x;
+                double cursor_imag = view.imag_max - imag_range * io.MousePos.y / io.DisplaySize.y;
+                view.real_min = cursor_real + (view.real_min - cursor_real) * scale;
+                view.real_max = cursor_real + (view.real_max - cursor_real) * scale;
+                view.imag_min = cursor_imag + (view.imag_min - cursor_imag) * scale;
+                view.imag_max = cursor_imag + (view.imag_max - cursor_imag) * scale;
+            }
+            if (ImGui::IsMouseDragging(ImGuiMouseButton_Left, 0.0f)) {
+                double d_real = -io.MouseDelta.x / io.DisplaySize.x * real_range;
+                double d_imag = io.MouseDelta.y / io.DisplaySize.y * imag_range;
+                view.real_min += d_real;
+                view.real_max += d_real;
+                view.imag_min += d_imag;
+                view.imag_max += d_imag;
+            }
+        }
+
+        // recompute only when something the frame depends on has changed
+        glfwGetFramebufferSize(window, &view.width, &view.height);
+        if (view.width > 1 && view.height > 1 && view.n_iterations > 0 && view != view_submitted) {
+            worker.submit(view);
+            view_submitted = view;
+            time_submitted = std::chrono::steady_clock::now();
+        }
+        if (ImGui::IsKeyPressed(ImGuiKey_F1)) {
+            show_stats = !show_stats;
+        }
+        stats.end_phase(PHASE_UI);
+        utils_shaders::gpu_timer_begin(gpu_timer, stats.frame_index());
+
+        // upload the rows of the newest frame that are not on the GPU yet, through the pixel buffers
+        if (worker.take_frame()) {
+            const render_worker::Frame &frame = worker.frame();
+            if (frame.generation != partial.generation || partial.rows > frame.rows_done) {
+                if (frame.request.width != partial.width || frame.request.height != partial.height) {
+                    allocate_frame_texture(partial, frame.request.width, frame.request.height);
+                }
+                partial.request = frame.request;
+                partial.generation = frame.generation;
+                partial.rows = 0;
+            }
+            if (frame.rows_done > partial.rows) {
+                size_t row_bytes = static_cast<size_t>(partial.width);
+                bool uploaded = utils_shaders::upload_texture_rows(
+                        uploader, partial.texture, partial.width, partial.rows, frame.rows_done - partial.rows,
+                        GL_RED, GL_UNSIGNED_BYTE, frame.pixels->data() + partial.rows * row_bytes,
+                        (frame.rows_done - partial.rows) * row_bytes
+                );
+                if (uploaded) {
+                    partial.rows = frame.rows_done;
+                }
+            }
+            if (frame.complete() && partial.rows == frame.rows_done) {
+                std::swap(shown, partial);
+                partial.rows = 0;
+                if (frame.request == view_submitted) {
+                    last_frame_ms = std::chrono::duration<double, std::milli>(
+                            std::chrono::steady_clock::now() - time_submitted
+                    ).count();
+                }
+            }
+        }
+        stats.end_phase(PHASE_UPLOAD);
+
+        if (show_stats) {
+            frame_stats::draw_overlay(stats);
+        }
+        if (io.DisplaySize.x > 0 && io.DisplaySize.y > 0) {
+            draw_reprojected(ImGui::GetBackgroundDrawList(), shown, view, io.DisplaySize);
+            draw_reprojected(ImGui::GetBackgroundDrawList(), partial, view, io.DisplaySize);
+        }
+
         // Rendering
         ImGui::Render();
 
@@ -194,37 +318,23 @@ int main(int, char **) {
 
         glClear(GL_COLOR_BUFFER_BIT);
 
-        glTexImage2D(
-                GL_TEXTURE_2D,
-                0,
-                GL_R8,
-                width,
-                height,
-                0,
-                GL_RED,
-                GL_UNSIGNED_BYTE,
-                mandelbrot_grey.data()
-        );
-        //glGenerateMipmap(GL_TEXTURE_2D);
-
-        // Texture parameters for how this texture will be used
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        glActiveTexture(GL_TEXTURE0); // you can use GL_TEXTURE1, ..., GL_TEXTURE31
-        glBindTexture(GL_TEXTURE_2D, Texture);
-
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        utils_shaders::gpu_timer_end(gpu_timer);
+        stats.end_phase(PHASE_DRAW);
 
         glfwSwapBuffers(window);
+        stats.end_phase(PHASE_SWAP);
+        stats.end_frame();
     }
 #ifdef __EMSCRIPTEN__
     EMSCRIPTEN_MAINLOOP_END;
 #endif
 
     // Cleanup
+    utils_shaders::delete_gpu_timer(gpu_timer);
+    utils_shaders::delete_pixel_uploader(uploader);
+    glDeleteTextures(1, &shown.texture);
+    glDeleteTextures(1, &partial.texture);
     ImGui_ImplOpenGL3_Shutdown();
     ImGui_ImplGlfw_Shutdown();
     ImGui::DestroyContext();
@@ -1,14 +1,271 @@
+#include <atomic>
 #include <chrono>
 
 #include <opencv2/imgcodecs.hpp>
 #include <cxxopts.hpp>
 #include "spdlog/spdlog.h"
+#include "spdlog/sinks/stdout_color_sinks.h"
 
 #include "src/cpp/timer.hpp"
+#include "src/cpp/atlas.hpp"
+#include "src/cpp/buddhabrot.hpp"
+#include "src/cpp/checkpoint.hpp"
+#include "src/cpp/colormaps.hpp"
+#include "src/cpp/formulas.hpp"
+#include "src/cpp/frame_stream.hpp"
+#include "src/cpp/image_io.hpp"
+#include "src/cpp/manifest.hpp"
 #include "src/cpp/mandelbrot.hpp"
+#include "src/cpp/output_sink.hpp"
+#include "src/cpp/thread_pool.hpp"
 #include "src/cpp/utilities_opencv.hpp"
 
 
+// how pixels are coloured: by escape iteration, or by exterior distance estimate (optionally with disk fill),
+// and stored: the pixel format of the image, with the colormap of RGB8 images
+struct Coloring {
+    bool distance = false;
+    bool fill = false;
+    output_sink::PixelFormat format = output_sink::PixelFormat::U8;
+    const colormaps::Colormap *colormap = nullptr;
+    std::string colormap_name;  // of `colormap`, for checkpoint keys
+};
+
+// renders one view straight into `out`; false if the formula has no distance estimate but one was asked for
+template<typename Formula>
+bool render_view(thread_pool::ThreadPool &pool, const Formula &formula, const mandelbrot::ViewParams &vp,
+                 double threshold, int n_iterations, const Coloring &coloring, const output_sink::Sink &out) {
+    if (!coloring.distance) {
+        mandelbrot::render_greyscale(pool, formula, vp, threshold, n_iterations, out);
+        return true;
+    }
+    if constexpr (Formula::has_derivative) {
+        mandelbrot::render_distance(pool, formula, vp, threshold, n_iterations, coloring.fill, out);
+        return true;
+    } else {
+        return false;
+    }
+}
+
+// render_view() into the pixels of `image`, (re)allocated to width x height of the coloring's format
+template<typename Formula>
+bool render_view(thread_pool::ThreadPool &pool, const Formula &formula, int width, int height,
+                 const mandelbrot::ViewParams &vp, double threshold, int n_iterations, const Coloring &coloring,
+                 cv::Mat &image) {
+    output_sink::Sink out = math_cpp_utils_opencv::mat_sink(image, width, height, coloring.format, coloring.colormap);
+    return render_view(pool, formula, vp, threshold, n_iterations, coloring, out);
+}
+
+// Checkpoints of a single-view render (see checkpoint::Journal): finished tiles are journaled to `path` every
+// `interval`, and with `orbits` the orbits of escape-time tiles in flight too, so that a render of hours
+// killed part way resumes where it stopped
+struct Checkpointing {
+    std::string path;   // empty: no checkpoints
+    bool resume = false;
+    bool orbits = false;
+    std::chrono::milliseconds interval{60000};
+};
+
+// tile size of checkpointed renders, the render_greyscale() default
+const int CHECKPOINT_TILE = 64;
+
+// render_view() skipping the tiles `journal` restores from an earlier run and journaling the others as they
+// finish; the journal is opened here and holds the last checkpoint on return. False, logged, on a checkpoint
+// that cannot be used or a formula without the distance estimate asked for.
+template<typename Formula>
+bool render_view_checkpointed(thread_pool::ThreadPool &pool, const formulas::FormulaSpec &formula_spec,
+                              const Formula &formula, const mandelbrot::ViewParams &vp, double threshold,
+                              int n_iterations, const Coloring &coloring, const output_sink::Sink &out,
+                              const Checkpointing &checkpointing, checkpoint::Journal &journal) {
+    if (coloring.distance && !Formula::has_derivative) {
+        spdlog::error("Formula '{}' has no distance estimate", formula_spec.name);
+        return false;
+    }
+    int width = out.width, height = out.height;
+    mandelbrot::RowPlan plan = mandelbrot::plan_rows<Formula>(width, height, vp, CHECKPOINT_TILE);
+    const std::vector<mandelbrot::Tile> &tiles = plan.tiles;
+    checkpoint::Key key = checkpoint::make_key(formula_spec, vp, threshold, n_iterations, out, coloring.colormap_name,
+                                               CHECKPOINT_TILE, coloring.distance, coloring.fill);
+    if (!journal.open(checkpointing.path, key, tiles, out, checkpointing.resume)) {
+        return false;
+    }
+    journal.start(checkpointing.interval);
+    checkpoint::render_tiles(pool, static_cast<int>(tiles.size()), journal, [&](int idx_tile) {
+        const mandelbrot::Tile &tile = tiles[idx_tile];
+        if constexpr (Formula::has_derivative) {
+            if (coloring.distance) {
+                mandelbrot::distance_tile(formula, tile, width, height, vp, threshold, n_iterations, coloring.fill, out);
+                return;
+            }
+        }
+        if (checkpointing.orbits) {
+            checkpoint::escape_tile_resumable(formula, tile, vp, threshold, n_iterations, out, journal, idx_tile);
+        } else {
+            mandelbrot::mandelbrot_sequence_tile(formula, tile, width, height, vp, threshold, n_iterations, out);
+        }
+    });
+    mandelbrot::copy_mirrored_rows(pool, plan, out);
+    journal.finish();
+    return true;
+}
+
+// How images are written. "auto" encodes .png / .pgm / .ppm / .pfm / .qoi paths with image_io (PNG deflated in
+// parallel on the pool) and leaves other extensions to cv::imwrite; "opencv" always uses cv::imwrite; png, pnm
+// and qoi force that encoding whatever the extension.
+struct Encoder {
+    std::string name = "auto";
+    int png_level = 1;
+};
+
+// writes `image` to `path` as `encoder` says; `used` receives the name of the encoder taken, for the timings
+bool save_image(thread_pool::ThreadPool &pool, const std::string &path, cv::Mat &image, const Encoder &encoder,
+                std::string &used) {
+    image_io::Encoding encoding;
+    bool own_encoding = encoder.name == "auto" ? image_io::encoding_for_path(path, encoding)
+                                               : image_io::parse_encoding(encoder.name, encoding);
+    output_sink::Sink view;
+    if (own_encoding && math_cpp_utils_opencv::mat_view(image, view)) {
+        used = image_io::encoding_name(encoding);
+        return image_io::write(pool, path, view, encoding, encoder.png_level);
+    }
+    used = "cv::imwrite";
+    if (!cv::imwrite(path, image)) {
+        spdlog::error("Failed to write image: {}", path);
+        return false;
+    }
+    return true;
+}
+
+// Renders every manifest entry in this process. The worker pool is shared by all entries, and the
+// encoding of image k runs on a separate thread while image k + 1 is computed (a parallel PNG encode also
+// spreads its bands over the pool, between the render's tiles). Two mats alternate so the one being
+// encoded is never overwritten. With a `stream`, the images are its frames, in manifest order, instead of
+// files; a stream whose reader has gone ends the batch.
+int render_batch(const std::vector<manifest::ViewEntry> &entries, thread_pool::ThreadPool &pool,
+                 const Coloring &coloring, const Encoder &image_encoder, frame_stream::FrameStream *stream = nullptr) {
+    thread_pool::ThreadPool encoder(1);
+
+    cv::Mat greyscale_mats[2];
+    std::future<void> encoding;
+    int n_skipped = 0;              // entries that could not be rendered
+    std::atomic<int> n_failed{0};   // images that could not be encoded or streamed
+    std::atomic<bool> stream_broken{false};
+    // images handed to the encoder; skipped entries do not count, so the mat rendered next is never the one
+    // the encoder may still be reading
+    size_t n_submitted = 0;
+
+    long compute_ms = 0;
+    long encode_wait_ms = 0;
+    std::atomic<long> encode_ms{0};
+
+    for (size_t idx_entry = 0; idx_entry < entries.size() && !stream_broken; idx_entry++) {
+        const auto &entry = entries[idx_entry];
+        mandelbrot::ViewParams vp{
+                entry.real_min, entry.real_max, entry.imag_min, entry.imag_max, 0.0, 0.0, 0.0
+        };
+
+        // the mat the encoder may still be reading is the other one
+        cv::Mat &greyscale_mat = greyscale_mats[n_submitted % 2];
+        auto t_compute = std::chrono::steady_clock::now();
+        bool rendered = false;
+        bool known_formula = formulas::visit_formula(entry.formula, [&](const auto &formula) {
+            rendered = render_view(
+                    pool, formula, entry.width, entry.height, vp, entry.threshold, entry.n_iterations, coloring,
+                    greyscale_mat
+            );
+        });
+        if (!known_formula) {
+            spdlog::error("Skip {}: unknown formula '{}' (power {})", entry.img_p, entry.formula.name, entry.formula.power);
+            n_skipped++;
+            continue;
+        }
+        if (!rendered) {
+            spdlog::error("Skip {}: formula '{}' has no distance estimate", entry.img_p, entry.formula.name);
+            n_skipped++;
+            continue;
+        }
+        auto t_wait = std::chrono::steady_clock::now();
+
+        if (encoding.valid()) {
+            encoding.get();
+        }
+        if (stream_broken) {
+            break;
+        }
+        auto t_submit = std::chrono::steady_clock::now();
+        compute_ms += std::chrono::duration_cast<std::chrono::milliseconds>(t_wait - t_compute).count();
+        encode_wait_ms += std::chrono::duration_cast<std::chrono::milliseconds>(t_submit - t_wait).count();
+
+        spdlog::debug("[{}/{}] Save image at: {}", idx_entry + 1, entries.size(), entry.img_p);
+        std::string img_name = entry.img_p;
+        encoding = encoder.submit([&pool, &greyscale_mat, img_name, &image_encoder, stream, &n_failed,
+                                   &stream_broken, &encode_ms] {
+            auto t_encode = std::chrono::steady_clock::now();
+            if (stream != nullptr) {
+                output_sink::Sink frame;
+                if (!math_cpp_utils_opencv::mat_view(greyscale_mat, frame) || !stream->write_frame(pool, frame)) {
+                    n_failed++;
+                    stream_broken = true;
+                }
+            } else {
+                std::string used;
+                if (!save_image(pool, img_name, greyscale_mat, image_encoder, used)) {
+                    n_failed++;
+                }
+            }
+            encode_ms += std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - t_encode).count();
+        });
+        n_submitted++;
+    }
+    if (encoding.valid()) {
+        encoding.get();
+    }
+
+    // after a broken stream the remaining entries are never rendered
+    size_t n_not_reached = entries.size() - n_submitted - n_skipped;
+    spdlog::info("Wrote {} of {} images ({} skipped, {} failed, {} not reached): compute {} ms, encode {} ms, "
+                 "waited on encoder {} ms", n_submitted - n_failed, entries.size(), n_skipped, n_failed.load(),
+                 n_not_reached, compute_ms, encode_ms.load(), encode_wait_ms);
+    return n_failed == 0 && n_skipped == 0 ? 0 : 1;
+}
+
+// Orbit density image of the view through a colormap
+int render_buddhabrot(thread_pool::ThreadPool &pool, const buddhabrot::Params &params, const std::string &colormap_name,
+                      double gamma, const std::string &img_name, const Encoder &encoder) {
+    colormaps::Colormap colormap{};
+    if (!colormaps::find(colormap_name, colormap)) {
+        spdlog::error("Unknown colormap '{}'", colormap_name);
+        return -1;
+    }
+    spdlog::info("Begin buddhabrot: {} samples ({}), iterations [{}, {})", params.n_samples,
+                 params.metropolis ? "Metropolis-Hastings" : "uniform", params.min_iterations, params.max_iterations);
+
+    auto t_render = std::chrono::steady_clock::now();
+    buddhabrot::Stats stats;
+    std::vector<double> density = buddhabrot::render(pool, params, &stats);
+    auto render_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t_render);
+    double n_samples = static_cast<double>(std::max<uint64_t>(stats.n_samples, 1));
+    spdlog::info("Rendered in {} ms: {:.1f}% of samples contributed, {:.1f}% rejected by the cardioid / bulb test{}",
+                 render_ms.count(), 100.0 * stats.n_contributing / n_samples, 100.0 * stats.n_bulb_rejected / n_samples,
+                 params.metropolis ? fmt::format(", {:.1f}% of proposals accepted",
+                                                 100.0 * stats.n_accepted / std::max<uint64_t>(stats.n_proposals, 1))
+                                   : std::string());
+
+    cv::Mat color_mat;
+    math_cpp_utils_opencv::fill_colormap_mat(pool, buddhabrot::tone_map(density, gamma), params.width, params.height,
+                                             colormap, color_mat);
+    spdlog::info("Save image at: {}", img_name);
+    auto t_encode = std::chrono::steady_clock::now();
+    std::string used;
+    if (!save_image(pool, img_name, color_mat, encoder, used)) {
+        return -1;
+    }
+    spdlog::info("Encoded with {} in {} ms", used, std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - t_encode).count());
+    return 0;
+}
+
 int main(int argc, char *argv[]) {
     cxxopts::Options options{argv[0], "Mandelbrot set image rendering tool"};
     options.add_options()
@@ -20,10 +277,62 @@ int main(int argc, char *argv[]) {
             ("imax,imag_max", "Imaginary number maximum", cxxopts::value<double>()->default_value("1.1"))
             ("i,n_iterations", "Number of iterations", cxxopts::value<int>()->default_value("35"))
             ("t,threshold", "Abs value threshold", cxxopts::value<double>()->default_value("6.0"))
-            ("p,img_p", "Image path", cxxopts::value<std::string>()->default_value("mandelbrot.png"));
+            ("p,img_p", "Image path; a .raw path gets the packed pixels, rendered straight into the mapped file",
+             cxxopts::value<std::string>()->default_value("mandelbrot.png"))
+            ("m,manifest", "CSV manifest of views to render in one batch (other options become column defaults)",
+             cxxopts::value<std::string>())
+            ("f,formula", "Iteration formula: mandelbrot, julia, multibrot, burning_ship, tricorn",
+             cxxopts::value<std::string>()->default_value("mandelbrot"))
+            ("power", "Multibrot power (2-8)", cxxopts::value<int>()->default_value("3"))
+            ("julia_re", "Julia constant, real part", cxxopts::value<double>()->default_value("-0.8"))
+            ("julia_im", "Julia constant, imaginary part", cxxopts::value<double>()->default_value("0.156"))
+            ("j,n_threads", "Number of worker threads (0 - all cores)", cxxopts::value<int>()->default_value("0"))
+            ("numa", "Pin worker threads per NUMA node and keep each node's output rows in its own memory",
+             cxxopts::value<bool>()->default_value("false"))
+            ("d,distance", "Color by exterior distance estimate instead of escape iteration (mandelbrot, julia, multibrot)",
+             cxxopts::value<bool>()->default_value("false"))
+            ("de_fill", "With --distance: paint disks proven outside the set without iterating their pixels",
+             cxxopts::value<bool>()->default_value("false"))
+            ("pixel_format", "Image pixels: u8, u16 (16-bit PNG), f32 (needs a .tiff / .exr path) or rgb8 (--colormap)",
+             cxxopts::value<std::string>()->default_value("u8"))
+            ("encoder", "Image encoder: auto (by extension: png, pgm / ppm / pfm and qoi here, others cv::imwrite), "
+                        "opencv, png, pnm or qoi", cxxopts::value<std::string>()->default_value("auto"))
+            ("png_level", "zlib level (0-9) of the parallel PNG encoder", cxxopts::value<int>()->default_value("1"))
+            ("atlas", "Interior / early-escape atlas from build_mandelbrot_atlas, consulted before iterating",
+             cxxopts::value<std::string>()->default_value(""))
+            ("b,buddhabrot", "Render the orbit density of escaping points (Buddhabrot) instead, up to --n_iterations",
+             cxxopts::value<bool>()->default_value("false"))
+            ("samples", "Buddhabrot: number of sampled c values", cxxopts::value<uint64_t>()->default_value("10000000"))
+            ("min_iterations", "Buddhabrot: only orbits escaping at this iteration or later count",
+             cxxopts::value<int>()->default_value("20"))
+            ("metropolis", "Buddhabrot: Metropolis-Hastings sampling near the boundary instead of uniform sampling",
+             cxxopts::value<bool>()->default_value("false"))
+            ("seed", "Buddhabrot: random seed", cxxopts::value<uint64_t>()->default_value("1"))
+            ("colormap", "Colormap of --buddhabrot and --pixel_format rgb8: gist_ncar, prism, flag or ocean",
+             cxxopts::value<std::string>()->default_value("ocean"))
+            ("gamma", "Buddhabrot: exponent applied to the normalised density", cxxopts::value<double>()->default_value("0.5"))
+            ("checkpoint", "Journal finished tiles to <img_p>.ckpt, so a killed render can be resumed (single view only)",
+             cxxopts::value<bool>()->default_value("false"))
+            ("checkpoint_interval", "Seconds between two checkpoints", cxxopts::value<double>()->default_value("60"))
+            ("checkpoint_orbits", "With --checkpoint: also save the orbits of the tiles in flight, for deep escape-time "
+                                  "renders whose single tiles take long", cxxopts::value<bool>()->default_value("false"))
+            ("resume", "Resume the render from its <img_p>.ckpt checkpoint (implies --checkpoint)",
+             cxxopts::value<bool>()->default_value("false"))
+            ("stream", "With --manifest: write the views as the frames of one y4m or raw video stream instead of "
+                       "image files", cxxopts::value<std::string>()->default_value(""))
+            ("stream_p", "Stream path: - for stdout, or a named pipe / file", cxxopts::value<std::string>()->default_value("-"))
+            ("fps", "Frame rate written in the y4m header", cxxopts::value<int>()->default_value("30"));
 
     auto result = options.parse(argc, argv);
 
+    std::string stream_name = result["stream"].as<std::string>();
+    std::string stream_path = result["stream_p"].as<std::string>();
+    if (!stream_name.empty() && stream_path == "-") {
+        // stdout carries the frames, the log moves to stderr
+        spdlog::default_logger()->sinks().clear();
+        spdlog::default_logger()->sinks().push_back(std::make_shared<spdlog::sinks::stderr_color_sink_mt>());
+    }
+
     auto t_0 = std::chrono::high_resolution_clock::now();
 
     int width = result["width"].as<int>();
@@ -39,27 +348,197 @@ int main(int argc, char *argv[]) {
 
     std::string img_name = result["img_p"].as<std::string>();
 
+    formulas::FormulaSpec formula_spec;
+    formula_spec.name = result["formula"].as<std::string>();
+    formula_spec.power = result["power"].as<int>();
+    formula_spec.julia_c = {result["julia_re"].as<double>(), result["julia_im"].as<double>()};
+
+    Coloring coloring;
+    coloring.distance = result["distance"].as<bool>();
+    coloring.fill = result["de_fill"].as<bool>();
+    if (!output_sink::parse_format(result["pixel_format"].as<std::string>(), coloring.format)) {
+        spdlog::error("Unknown pixel format '{}'", result["pixel_format"].as<std::string>());
+        return -1;
+    }
+    Encoder encoder;
+    encoder.name = result["encoder"].as<std::string>();
+    encoder.png_level = result["png_level"].as<int>();
+    image_io::Encoding forced_encoding;
+    if (encoder.name != "auto" && encoder.name != "opencv" && !image_io::parse_encoding(encoder.name, forced_encoding)) {
+        spdlog::error("Unknown encoder '{}'", encoder.name);
+        return -1;
+    }
+    if (encoder.png_level < 0 || encoder.png_level > 9) {
+        spdlog::error("Need 0 <= png_level <= 9");
+        return -1;
+    }
+
+    colormaps::Colormap colormap{};
+    if (coloring.format == output_sink::PixelFormat::RGB8) {
+        if (!colormaps::find(result["colormap"].as<std::string>(), colormap)) {
+            spdlog::error("Unknown colormap '{}'", result["colormap"].as<std::string>());
+            return -1;
+        }
+        coloring.colormap = &colormap;
+        coloring.colormap_name = result["colormap"].as<std::string>();
+    }
+
+    Checkpointing checkpointing;
+    checkpointing.resume = result["resume"].as<bool>();
+    if (result["checkpoint"].as<bool>() || checkpointing.resume) {
+        checkpointing.path = img_name + ".ckpt";
+    }
+    checkpointing.orbits = result["checkpoint_orbits"].as<bool>();
+    if (result["checkpoint_interval"].as<double>() <= 0.0) {
+        spdlog::error("Need checkpoint_interval > 0");
+        return -1;
+    }
+    checkpointing.interval = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::duration<double>(result["checkpoint_interval"].as<double>()));
+    if (!checkpointing.path.empty() && (result["buddhabrot"].as<bool>() || result.count("manifest"))) {
+        spdlog::warn("Checkpoints are only written for single views, --checkpoint / --resume ignored");
+    }
+    if (checkpointing.orbits && coloring.distance) {
+        spdlog::warn("--checkpoint_orbits only applies to escape-time colouring, distance tiles restart from scratch");
+    }
+
     timer::Timer timer;
 
-    spdlog::info("Begin mandelbrot set image generation");
+    atlas::Atlas cells;
+    if (!result["atlas"].as<std::string>().empty()) {
+        if (!cells.load(result["atlas"].as<std::string>())) {
+            return -1;
+        }
+        atlas::install(&cells);
+    }
 
-    auto t_1 = std::chrono::high_resolution_clock::now();
-    auto complex_set = mandelbrot::gen_complex_set(width, height, real_min, real_max, imag_min, imag_max);
-    timer.timeit("gen_complex_set()", t_1);
+    thread_pool::ThreadPool pool(result["n_threads"].as<int>(), result["numa"].as<bool>());
+    if (pool.numa_nodes() > 1) {
+        spdlog::info("Worker threads spread over {} NUMA nodes", pool.numa_nodes());
+    }
 
-    // check sequence condition (divergence to infinity for each value)
-    auto t_2 = std::chrono::high_resolution_clock::now();
-    std::vector<int> mandelbrot_set = mandelbrot::mandelbrot_sequence(complex_set, threshold, n_iterations);
-    timer.timeit("mandelbrot_sequence()", t_2);
+    if (result["buddhabrot"].as<bool>()) {
+        buddhabrot::Params params;
+        params.width = width;
+        params.height = height;
+        params.vp = {real_min, real_max, imag_min, imag_max, 0.0, 0.0, 0.0};
+        params.threshold = threshold;
+        params.min_iterations = result["min_iterations"].as<int>();
+        params.max_iterations = n_iterations;
+        params.n_samples = result["samples"].as<uint64_t>();
+        params.metropolis = result["metropolis"].as<bool>();
+        params.seed = result["seed"].as<uint64_t>();
+
+        auto t_buddhabrot = std::chrono::high_resolution_clock::now();
+        int status = render_buddhabrot(pool, params, result["colormap"].as<std::string>(), result["gamma"].as<double>(),
+                                       img_name, encoder);
+        timer.timeit("render_buddhabrot()", t_buddhabrot);
+        timer.timeit("main()", t_0);
+        timer.logTime();
+        return status;
+    }
+
+    if (result.count("manifest")) {
+        manifest::ViewEntry defaults{
+                width, height, real_min, real_max, imag_min, imag_max, n_iterations, threshold, img_name, formula_spec
+        };
+        std::vector<manifest::ViewEntry> entries;
+        if (!manifest::read_csv(result["manifest"].as<std::string>(), defaults, entries)) {
+            return -1;
+        }
+        spdlog::info("Begin batch render of {} images on {} threads", entries.size(), pool.size());
+
+        frame_stream::FrameStream stream;
+        if (!stream_name.empty()) {
+            frame_stream::Format stream_format;
+            if (!frame_stream::parse_format(stream_name, stream_format)) {
+                spdlog::error("Unknown stream format '{}'", stream_name);
+                return -1;
+            }
+            if (entries.empty()) {
+                return 0;
+            }
+            for (const auto &entry: entries) {
+                if (entry.width != entries.front().width || entry.height != entries.front().height) {
+                    spdlog::error("All frames of a stream need the same size: {} is {}x{}, the first is {}x{}",
+                                  entry.img_p, entry.width, entry.height, entries.front().width, entries.front().height);
+                    return -1;
+                }
+            }
+            if (!stream.open(stream_path, stream_format, entries.front().width, entries.front().height,
+                             coloring.format, result["fps"].as<int>())) {
+                return -1;
+            }
+            if (stream_format == frame_stream::Format::RAW) {
+                spdlog::info("Raw frames: read with -f rawvideo -pix_fmt {} -s {}x{}",
+                             frame_stream::raw_pix_fmt(coloring.format), entries.front().width, entries.front().height);
+            }
+        }
+
+        auto t_batch = std::chrono::high_resolution_clock::now();
+        int status = render_batch(entries, pool, coloring, encoder, stream_name.empty() ? nullptr : &stream);
+        timer.timeit("render_batch()", t_batch);
 
-    auto t_3 = std::chrono::high_resolution_clock::now();
-    cv::Mat greyscale_mat = math_cpp_utils_opencv::get_greyscale_mat(mandelbrot_set, width, height);
-    timer.timeit("get_greyscale_mat()", t_3);
+        timer.timeit("main()", t_0);
+        timer.logTime();
+        return status;
+    }
+
+    spdlog::info("Begin {} set image generation", formula_spec.name);
+
+    mandelbrot::ViewParams vp{real_min, real_max, imag_min, imag_max, 0.0, 0.0, 0.0};
+
+    // a .raw path is mapped and rendered into directly: the pixels reach the file with no copy and no encode
+    cv::Mat greyscale_mat;
+    output_sink::MappedFile raw_file;
+    output_sink::Sink out;
+    bool raw_output = img_name.size() > 4 && img_name.compare(img_name.size() - 4, 4, ".raw") == 0;
+    if (raw_output) {
+        if (!raw_file.create(img_name, width, height, coloring.format)) {
+            return -1;
+        }
+        out = raw_file.sink();
+        out.colormap = coloring.colormap;
+    } else {
+        out = math_cpp_utils_opencv::mat_sink(greyscale_mat, width, height, coloring.format, coloring.colormap);
+    }
+
+    // check sequence condition (divergence to infinity for each value), straight into the image
+    auto t_2 = std::chrono::high_resolution_clock::now();
+    checkpoint::Journal journal;
+    bool checkpointed = !checkpointing.path.empty();
+    bool rendered = false;
+    bool known_formula = formulas::visit_formula(formula_spec, [&](const auto &formula) {
+        if (checkpointed) {
+            rendered = render_view_checkpointed(pool, formula_spec, formula, vp, threshold, n_iterations, coloring, out,
+                                                checkpointing, journal);
+        } else {
+            rendered = render_view(pool, formula, vp, threshold, n_iterations, coloring, out);
+        }
+    });
+    if (!known_formula) {
+        spdlog::error("Unknown formula '{}' (power {})", formula_spec.name, formula_spec.power);
+        return -1;
+    }
+    if (!rendered) {
+        if (!checkpointed) {
+            spdlog::error("Formula '{}' has no distance estimate", formula_spec.name);
+        }
+        return -1;
+    }
+    timer.timeit("render_greyscale()", t_2);
 
     spdlog::info("Save image at: {}", img_name);
     auto t_4 = std::chrono::high_resolution_clock::now();
-    (void) cv::imwrite(img_name, greyscale_mat);
-    timer.timeit("cv::imwrite()", t_4);
+    std::string used = "mapped file";
+    if (raw_output ? !raw_file.flush() : !save_image(pool, img_name, greyscale_mat, encoder, used)) {
+        return -1;
+    }
+    timer.timeit("encode (" + used + ")", t_4);
+    // the image is safe, the checkpoint has served
+    if (checkpointed) {
+        journal.remove();
+    }
 
     timer.timeit("main()", t_0);
     timer.logTime();
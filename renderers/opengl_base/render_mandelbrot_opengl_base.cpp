@@ -2,39 +2,36 @@
 // Created by maksym on 18/10/23.
 //
 #include <cstdio>
-#include <chrono>
+
+#include <cxxopts.hpp>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#include "imgui.h"
+#include "backends/imgui_impl_glfw.h"
+#include "backends/imgui_impl_opengl3.h"
+
+#include "src/cpp/frame_stats_imgui.hpp"
 #include "src/cpp/mandelbrot.hpp"
+#include "src/cpp/output_sink.hpp"
+#include "src/cpp/thread_pool.hpp"
 #include "src/cpp/utilities_shaders.hpp"
 
 static void glfw_error_callback(int error, const char *description) {
     fprintf(stderr, "GLFW Error %d: %s\n", error, description);
 }
 
-std::chrono::time_point<std::chrono::steady_clock> time_last = std::chrono::steady_clock::now();
-int fps_count = 0;
-int fps = 0;
-
-void get_fps() {
-    auto currentTime = std::chrono::steady_clock::now();
+// CPU phases of a frame, see frame_stats::FrameStats
+enum FramePhase { PHASE_COMPUTE, PHASE_UPLOAD, PHASE_DRAW, PHASE_SWAP };
 
-    const auto elapsedTime = std::chrono::duration_cast<std::chrono::nanoseconds>(currentTime - time_last).count();
-    ++fps_count;
+int main(int argc, char *argv[]) {
+    cxxopts::Options options{argv[0], "Mandelbrot set rendered on the CPU and shown through OpenGL"};
+    options.add_options()
+            ("stats_csv", "Write per-frame timings (CPU phases and GPU time) to this CSV file",
+             cxxopts::value<std::string>()->default_value(""));
+    auto result = options.parse(argc, argv);
 
-    if (elapsedTime > 1000000000) {
-        time_last = currentTime;
-        fps = fps_count;
-        fps_count = 0;
-
-        printf("%d fps\n", fps); // print out fps in every second (or you can use it elsewhere)
-    }
-}
-
-
-int main(int, char **) {
     // Initialise GLFW
     glfwSetErrorCallback(glfw_error_callback);
 
@@ -132,11 +129,39 @@ int main(int, char **) {
     // Ensure we can capture the escape key being pressed below
     glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
 
+    // frame timing: CPU phases, GPU time through timer queries, ImGui overlay (F1 toggles)
+    IMGUI_CHECKVERSION();
+    ImGui::CreateContext();
+    ImGui_ImplGlfw_InitForOpenGL(window, true);
+    ImGui_ImplOpenGL3_Init("#version 330");
+    bool show_stats = true;
+
+    frame_stats::FrameStats stats({"compute", "upload", "draw", "swap"});
+    if (!result["stats_csv"].as<std::string>().empty() && !stats.open_csv(result["stats_csv"].as<std::string>())) {
+        return -1;
+    }
+    utils_shaders::GpuTimer gpu_timer;
+    utils_shaders::create_gpu_timer(gpu_timer);
+
+    // the CPU render is written straight into a mapped pixel unpack buffer, which the texture is then
+    // specified from, so a frame is never held in a std::vector
+    thread_pool::ThreadPool pool;
+    mandelbrot::ViewParams vp{real_min, real_max, imag_min, imag_max, 0.0, 0.0, 0.0};
+    auto frame_bytes = static_cast<GLsizeiptr>(static_cast<size_t>(width) * height * sizeof(float));
+    GLuint pbo;
+    glGenBuffers(1, &pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, frame_bytes, nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
     while (
             glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
             glfwWindowShouldClose(window) == 0) {
 
-        get_fps();
+        stats.begin_frame();
+        utils_shaders::gpu_timer_collect(gpu_timer, [&stats](uint64_t frame, double gpu_ms) {
+            stats.set_gpu_ms(frame, gpu_ms);
+        });
 
         // Render on the whole framebuffer, complete from the lower left corner to the upper right
         glViewport(0, 0, width, height);
@@ -144,16 +169,19 @@ int main(int, char **) {
         glClear(GL_COLOR_BUFFER_BIT);
 
         // --------------------- Draw section -------------------------
-        std::vector<float> mandelbrot_grey = mandelbrot::gen_mandelbrot_greyscale(
-                width,
-                height,
-                real_min,
-                real_max,
-                imag_min,
-                imag_max,
-                threshold,
-                n_iterations
-        );
+        // invalidating the whole buffer lets the driver hand out fresh storage while the GPU may still read
+        // the previous frame's
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        void *pixels = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, frame_bytes,
+                                        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (pixels != nullptr) {
+            mandelbrot::render_greyscale(pool, formulas::Mandelbrot{}, vp, threshold, n_iterations,
+                                         output_sink::packed(pixels, width, height, output_sink::PixelFormat::F32));
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        stats.end_phase(PHASE_COMPUTE);
+        utils_shaders::gpu_timer_begin(gpu_timer, stats.frame_index());
+
         glTexImage2D(
                 GL_TEXTURE_2D,
                 0,
@@ -163,8 +191,9 @@ int main(int, char **) {
                 0,
                 GL_RED,
                 GL_FLOAT,
-                mandelbrot_grey.data()
+                nullptr     // offset 0 of the bound unpack buffer
         );
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
         glGenerateMipmap(GL_TEXTURE_2D);
 
         // Poor filtering. Needed !
@@ -175,17 +204,39 @@ int main(int, char **) {
 
         glActiveTexture(GL_TEXTURE0); // you can use GL_TEXTURE1, ..., GL_TEXTURE31
         glBindTexture(GL_TEXTURE_2D, Texture);
+        stats.end_phase(PHASE_UPLOAD);
 
         glUseProgram(shaderProgram);
         glBindVertexArray(VAO);
 
         glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
+
+        ImGui_ImplOpenGL3_NewFrame();
+        ImGui_ImplGlfw_NewFrame();
+        ImGui::NewFrame();
+        if (ImGui::IsKeyPressed(ImGuiKey_F1)) {
+            show_stats = !show_stats;
+        }
+        if (show_stats) {
+            frame_stats::draw_overlay(stats);
+        }
+        ImGui::Render();
+        ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        utils_shaders::gpu_timer_end(gpu_timer);
+        stats.end_phase(PHASE_DRAW);
         // -------------------- END draw section ----------------------
 
         // Swap buffers
         glfwSwapBuffers(window);
         glfwPollEvents();
+        stats.end_phase(PHASE_SWAP);
+        stats.end_frame();
     }
+    glDeleteBuffers(1, &pbo);
+    utils_shaders::delete_gpu_timer(gpu_timer);
+    ImGui_ImplOpenGL3_Shutdown();
+    ImGui_ImplGlfw_Shutdown();
+    ImGui::DestroyContext();
     // terminate GLFW and exiting
     glfwTerminate();
     return 0;
@@ -0,0 +1,305 @@
+//
+// Offscreen render of the GLSL kernel (shaders_mandelbrot.hpp) without a window or display.
+// The context comes from EGL: the Mesa surfaceless platform when present (works with llvmpipe,
+// so CI machines without a GPU can run it), the default display otherwise (e.g. NVIDIA headless).
+//
+#include <chrono>
+#include <cstring>
+#include <fstream>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <opencv2/imgcodecs.hpp>
+#include <cxxopts.hpp>
+#include <spdlog/spdlog.h>
+
+#include "src/cpp/colormaps.hpp"
+#include "src/cpp/mandelbrot.hpp"
+#include "src/cpp/thread_pool.hpp"
+#include "src/cpp/timer.hpp"
+#include "src/cpp/utilities_shaders.hpp"
+#include "src/cpp/shaders_mandelbrot.hpp"
+
+struct HeadlessContext {
+    EGLDisplay display = EGL_NO_DISPLAY;
+    EGLContext context = EGL_NO_CONTEXT;
+};
+
+static bool create_headless_context(HeadlessContext &ctx) {
+    const char *client_extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+            eglGetProcAddress("eglGetPlatformDisplayEXT")
+    );
+    if (client_extensions != nullptr && get_platform_display != nullptr &&
+        std::strstr(client_extensions, "EGL_MESA_platform_surfaceless") != nullptr) {
+        ctx.display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if (ctx.display == EGL_NO_DISPLAY) {
+        ctx.display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    EGLint major, minor;
+    if (ctx.display == EGL_NO_DISPLAY || eglInitialize(ctx.display, &major, &minor) != EGL_TRUE) {
+        spdlog::error("Failed to initialize EGL display (error 0x{:x})", eglGetError());
+        return false;
+    }
+    spdlog::info("EGL {}.{} ({})", major, minor, eglQueryString(ctx.display, EGL_VENDOR));
+
+    // no surface is ever created - rendering goes to an FBO - so any config will do
+    EGLint config_attribs[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+    EGLConfig config = nullptr;
+    EGLint n_configs = 0;
+    eglChooseConfig(ctx.display, config_attribs, &config, 1, &n_configs);
+
+    if (eglBindAPI(EGL_OPENGL_API) != EGL_TRUE) {
+        spdlog::error("EGL implementation has no desktop OpenGL");
+        return false;
+    }
+    EGLint context_attribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3,
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+    };
+    ctx.context = eglCreateContext(
+            ctx.display, n_configs > 0 ? config : EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, context_attribs
+    );
+    if (ctx.context == EGL_NO_CONTEXT ||
+        eglMakeCurrent(ctx.display, EGL_NO_SURFACE, EGL_NO_SURFACE, ctx.context) != EGL_TRUE) {
+        spdlog::error("Failed to create a surfaceless OpenGL 3.3 core context (error 0x{:x})", eglGetError());
+        return false;
+    }
+    spdlog::info("GL renderer: {}, version: {}",
+                 reinterpret_cast<const char *>(glGetString(GL_RENDERER)),
+                 reinterpret_cast<const char *>(glGetString(GL_VERSION)));
+    return true;
+}
+
+static void destroy_headless_context(HeadlessContext &ctx) {
+    eglMakeCurrent(ctx.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (ctx.context != EGL_NO_CONTEXT) {
+        eglDestroyContext(ctx.display, ctx.context);
+    }
+    eglTerminate(ctx.display);
+}
+
+static bool ends_with(const std::string &value, const std::string &suffix) {
+    return value.size() >= suffix.size() && value.compare(value.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+int main(int argc, char *argv[]) {
+    cxxopts::Options options{argv[0], "Headless Mandelbrot set GLSL rendering tool"};
+    options.add_options()
+            ("w,width", "Image width", cxxopts::value<int>()->default_value("1980"))
+            ("h,height", "Image height", cxxopts::value<int>()->default_value("1080"))
+            ("rmin,real_min", "Real number minimum", cxxopts::value<double>()->default_value("-2.5"))
+            ("rmax,real_max", "Real number maximum", cxxopts::value<double>()->default_value("1.0"))
+            ("imin,imag_min", "Imaginary number minimum", cxxopts::value<double>()->default_value("-1.1"))
+            ("imax,imag_max", "Imaginary number maximum", cxxopts::value<double>()->default_value("1.1"))
+            ("i,n_iterations", "Number of iterations", cxxopts::value<int>()->default_value("200"))
+            ("t,threshold", "Abs value threshold", cxxopts::value<float>()->default_value("6.0"))
+            ("p,img_p", "Output path; '.raw' writes packed RGB8 rows, anything else goes through cv::imwrite",
+             cxxopts::value<std::string>()->default_value("mandelbrot_gl.png"))
+            ("tile", "Tile edge in pixels; each tile is a separate draw to stay under driver timeouts",
+             cxxopts::value<int>()->default_value("512"))
+            ("compare_cpu", "Also render the view with the CPU engine and report both timings");
+    auto result = options.parse(argc, argv);
+
+    auto t_0 = std::chrono::high_resolution_clock::now();
+
+    int width = result["width"].as<int>();
+    int height = result["height"].as<int>();
+    int tile_size = std::max(16, result["tile"].as<int>());
+    int n_iterations = result["n_iterations"].as<int>();
+    float threshold = result["threshold"].as<float>();
+    std::string img_name = result["img_p"].as<std::string>();
+    bool raw_output = ends_with(img_name, ".raw");
+
+    mandelbrot::ViewParams vp{
+            result["real_min"].as<double>(), result["real_max"].as<double>(),
+            result["imag_min"].as<double>(), result["imag_max"].as<double>(),
+            0.0, 0.0, 0.0
+    };
+
+    timer::Timer timer;
+
+    HeadlessContext ctx;
+    if (!create_headless_context(ctx)) {
+        return -1;
+    }
+
+    // --------- full-screen quad, same layout as render_mandelbrot_opengl_shader
+    float vertices[] = {
+            -1.0f, -1.0f, 0.0f, 0.0f, // Bottom-left
+            1.0f, -1.0f, 1.0f, 0.0f, // Bottom-right
+            -1.0f, 1.0f, 0.0f, 1.0f, // Top-left
+            1.0f, 1.0f, 1.0f, 1.0f, // Top-right
+    };
+    unsigned int indices[] = {0, 1, 2, 1, 2, 3};
+
+    GLuint VAO, VBO, EBO;
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &EBO);
+
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *) nullptr);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *) (2 * sizeof(float)));
+    glEnableVertexAttribArray(1);
+
+    GLuint shader_program = utils_shaders::LoadShadersFromSource(
+            shaders_mandelbrot::VERTEX_SRC, shaders_mandelbrot::FRAGMENT_SRC.c_str()
+    );
+    if (shader_program == 0) {
+        spdlog::error("Error loading shader");
+        return -1;
+    }
+
+    // --------- colormap texture
+    int n_colors = sizeof(colormaps::cmap_ocean_256) / (3 * sizeof(colormaps::cmap_ocean_256[0]));
+    GLuint tex_colormap;
+    glGenTextures(1, &tex_colormap);
+    glBindTexture(GL_TEXTURE_1D, tex_colormap);
+    glTexImage1D(GL_TEXTURE_1D, 0, GL_RGB32F, n_colors, 0, GL_RGB, GL_FLOAT, colormaps::cmap_ocean_256);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    // --------- tile-sized render target
+    GLuint tex_target, fbo;
+    glGenTextures(1, &tex_target);
+    glBindTexture(GL_TEXTURE_2D, tex_target);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, tile_size, tile_size, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glGenFramebuffers(1, &fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex_target, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        spdlog::error("Offscreen framebuffer is incomplete");
+        return -1;
+    }
+
+    // --------- two pack PBOs: tile k is read back while tile k - 1 is copied out
+    GLuint pbos[2];
+    size_t pbo_bytes = static_cast<size_t>(tile_size) * tile_size * 3;
+    glGenBuffers(2, pbos);
+    for (GLuint pbo: pbos) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, static_cast<GLsizeiptr>(pbo_bytes), nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    mandelbrot::ShaderView shader_view = mandelbrot::gen_shader_view(width, height, vp);
+
+    glUseProgram(shader_program);
+    glUniform1i(glGetUniformLocation(shader_program, "colormap"), 0);
+    glUniform4fv(glGetUniformLocation(shader_program, "view_origin"), 1, shader_view.origin);
+    glUniform4fv(glGetUniformLocation(shader_program, "view_step"), 1, shader_view.step);
+    GLint loc_pixel_offset = glGetUniformLocation(shader_program, "pixel_offset");
+    glUniform1f(glGetUniformLocation(shader_program, "threshold"), threshold);
+    glUniform1i(glGetUniformLocation(shader_program, "n_iterations"), n_iterations);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_1D, tex_colormap);
+
+    GLenum err_setup = glGetError();
+    if (err_setup != 0) {
+        spdlog::error("Got !=0 error code from OpenGL: {}", err_setup);
+        return -1;
+    }
+
+    // GL reads rows bottom-up and pixel row 0 is imag_min,
+    // so the image comes out in the same row order as the CPU engine's
+    // BGR for cv::imwrite, RGB for raw output
+    cv::Mat image(height, width, CV_8UC3);
+    GLenum read_format = raw_output ? GL_RGB : GL_BGR;
+
+    auto copy_tile_out = [&](const mandelbrot::Tile &tile, GLuint pbo) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo);
+        auto *pixels = static_cast<const uchar *>(glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY));
+        if (pixels != nullptr) {
+            size_t row_bytes = static_cast<size_t>(tile.x1 - tile.x0) * 3;
+            for (int i_row = tile.y0; i_row < tile.y1; i_row++) {
+                std::memcpy(image.ptr<uchar>(i_row) + static_cast<size_t>(tile.x0) * 3,
+                            pixels + (i_row - tile.y0) * row_bytes, row_bytes);
+            }
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    };
+
+    std::vector<mandelbrot::Tile> tiles = mandelbrot::gen_tiles(width, height, tile_size);
+    spdlog::info("Render {}x{} in {} tiles of up to {}x{}", width, height, tiles.size(), tile_size, tile_size);
+
+    auto t_gpu = std::chrono::high_resolution_clock::now();
+    for (size_t idx_tile = 0; idx_tile < tiles.size(); idx_tile++) {
+        const auto &tile = tiles[idx_tile];
+        int tile_w = tile.x1 - tile.x0;
+        int tile_h = tile.y1 - tile.y0;
+
+        glUniform2f(loc_pixel_offset, static_cast<float>(tile.x0), static_cast<float>(tile.y0));
+        glViewport(0, 0, tile_w, tile_h);
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbos[idx_tile % 2]);
+        glReadPixels(0, 0, tile_w, tile_h, read_format, GL_UNSIGNED_BYTE, nullptr);
+        // submit now so a long tile starts while the previous one is copied out
+        glFlush();
+
+        if (idx_tile > 0) {
+            copy_tile_out(tiles[idx_tile - 1], pbos[(idx_tile - 1) % 2]);
+        }
+    }
+    if (!tiles.empty()) {
+        copy_tile_out(tiles.back(), pbos[(tiles.size() - 1) % 2]);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    timer.timeit("GPU render + readback", t_gpu);
+
+    GLenum err_render = glGetError();
+    if (err_render != 0) {
+        spdlog::error("Got !=0 error code from OpenGL: {}", err_render);
+        return -1;
+    }
+
+    spdlog::info("Save image at: {}", img_name);
+    auto t_save = std::chrono::high_resolution_clock::now();
+    if (raw_output) {
+        std::ofstream raw_stream(img_name, std::ios::binary);
+        raw_stream.write(reinterpret_cast<const char *>(image.data), static_cast<std::streamsize>(image.total() * 3));
+        if (!raw_stream) {
+            spdlog::error("Failed to write image: {}", img_name);
+            return -1;
+        }
+    } else if (!cv::imwrite(img_name, image)) {
+        spdlog::error("Failed to write image: {}", img_name);
+        return -1;
+    }
+    timer.timeit("save image", t_save);
+
+    if (result.count("compare_cpu")) {
+        thread_pool::ThreadPool pool;
+        std::vector<int> mandelbrot_set;
+        auto t_cpu = std::chrono::high_resolution_clock::now();
+        mandelbrot::render_greyscale(pool, width, height, vp, threshold, n_iterations, mandelbrot_set);
+        timer.timeit("CPU render_greyscale() on " + std::to_string(pool.size()) + " threads", t_cpu);
+    }
+
+    glDeleteBuffers(2, pbos);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteTextures(1, &tex_target);
+    glDeleteTextures(1, &tex_colormap);
+    glDeleteProgram(shader_program);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+    glDeleteVertexArrays(1, &VAO);
+    destroy_headless_context(ctx);
+
+    timer.timeit("main()", t_0);
+    timer.logTime();
+    return 0;
+}
@@ -1,7 +1,11 @@
 //
 // Created by maksym on 18/10/23.
 //
+
+#include <algorithm>
+#include <cfloat>
 #include <chrono>
+#include <cmath>
 
 #include <spdlog/spdlog.h>
 #include <cxxopts.hpp>
@@ -9,8 +13,16 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#include "imgui.h"
+#include "backends/imgui_impl_glfw.h"
+#include "backends/imgui_impl_opengl3.h"
+
 #include "src/cpp/colormaps.hpp"
+#include "src/cpp/fixed_point.hpp"
+#include "src/cpp/frame_stats_imgui.hpp"
 #include "src/cpp/mandelbrot.hpp"
+#include "src/cpp/perturbation.hpp"
+#include "src/cpp/resolution_scaler.hpp"
 #include "src/cpp/utilities_shaders.hpp"
 #include "src/cpp/shaders_mandelbrot.hpp"
 
@@ -23,6 +35,13 @@ struct MouseState {
     double last_x = 0.0, last_y = 0.0;
 };
 
+// perturbation anchor, at the widest precision a reference orbit is computed in
+using Anchor = fixed_point::Fixed<fixed_point::MAX_LIMBS>;
+
+// up to this many fraction bits (see fixed_point::fraction_bits_for_view()) a long double reference orbit keeps
+// 24 bits below the pixel spacing; deeper views take theirs in fixed point
+const int LONG_DOUBLE_FRACTION_BITS = 104;
+
 struct AppState {
     mandelbrot::ViewParams *vp = nullptr;
     mandelbrot::ViewParams *vp_initial = nullptr;
@@ -33,6 +52,10 @@ struct AppState {
     int n_iters_delta = 1;
     int n_iters_delta_initial = 1;
     float threshold = 6.0f;
+    bool show_stats = true;
+    // perturbation mode keeps the view centred on 0 and the centre itself here, at higher precision
+    Anchor anchor_re, anchor_im;
+    Anchor anchor_re_initial, anchor_im_initial;
 };
 
 static void scroll_callback(GLFWwindow *window, double /*xoffset*/, double yoffset) {
@@ -63,10 +86,15 @@ static void key_callback(GLFWwindow *window, int key, int /*scancode*/, int acti
             break;
         case GLFW_KEY_R:
             app->vp->reset(*app->vp_initial);
+            app->anchor_re = app->anchor_re_initial;
+            app->anchor_im = app->anchor_im_initial;
             app->n_iters_delta = app->n_iters_delta_initial;
             spdlog::debug("RESET complex set!");
             app->view_dirty = true;
             break;
+        case GLFW_KEY_F1:
+            app->show_stats = !app->show_stats;
+            break;
         case GLFW_KEY_UP:    app->vp->pan_imag(app->vp->imag_delta);  app->view_dirty = true; break;
         case GLFW_KEY_DOWN:  app->vp->pan_imag(-app->vp->imag_delta); app->view_dirty = true; break;
         case GLFW_KEY_LEFT:  app->vp->pan_real(-app->vp->real_delta);  app->view_dirty = true; break;
@@ -93,29 +121,129 @@ static void cursor_pos_callback(GLFWwindow *window, double xpos, double ypos) {
     app->view_dirty = true;
 }
 
-std::chrono::time_point<std::chrono::steady_clock> time_last = std::chrono::steady_clock::now();
-
-int fps_count = 0;
-int fps = 0;
+// GL objects of the perturbation mode; the image is kept in `target` and only recomputed when the view changes
+struct PerturbationGL {
+    GLuint program = 0;
+    utils_shaders::RenderTarget target;
+    GLuint orbit_buffer = 0, tex_orbit = 0;
+    GLint loc_ref_orbit = -1, loc_ref_length = -1, loc_ref_pixel = -1, loc_ref_c = -1, loc_pixel_step = -1;
+    GLint loc_interior_test = -1;
+    GLint loc_threshold = -1, loc_glitch_tolerance = -1, loc_n_iterations = -1, loc_colormap = -1;
+    std::vector<float> orbit;
+    std::vector<unsigned char> pixels;
+};
 
-void get_fps() {
-    auto time_current = std::chrono::steady_clock::now();
+// Moves the view centre into the anchor so the double view bounds only carry the (tiny) offsets from it.
+static void recenter_view(AppState &app) {
+    double center_re = (app.vp->real_min + app.vp->real_max) / 2.0;
+    double center_im = (app.vp->imag_min + app.vp->imag_max) / 2.0;
+    app.anchor_re = app.anchor_re + Anchor(center_re);
+    app.anchor_im = app.anchor_im + Anchor(center_im);
+    app.vp->pan_real(-center_re);
+    app.vp->pan_imag(-center_im);
+}
 
-    const auto time_elapsed = (
-            std::chrono::duration_cast<std::chrono::nanoseconds>(time_current - time_last)
-                    .count()
-    );
-    ++fps_count;
+// Reference orbit of anchor + (offset_re, offset_im) at the precision the view needs: long double for shallow
+// views, else the narrowest fixed_point::Fixed with enough fraction bits.
+static int view_reference_orbit(const AppState &app, int width, double offset_re, double offset_im,
+                                std::vector<float> &orbit) {
+    Anchor ref_re = app.anchor_re + Anchor(offset_re);
+    Anchor ref_im = app.anchor_im + Anchor(offset_im);
+    int fraction_bits = fixed_point::fraction_bits_for_view(app.vp->real_max - app.vp->real_min, width);
+    if (fraction_bits <= LONG_DOUBLE_FRACTION_BITS) {
+        return perturbation::reference_orbit(static_cast<long double>(ref_re), static_cast<long double>(ref_im),
+                                             app.threshold, app.n_iterations, orbit);
+    }
+    int ref_length = 0;
+    bool visited = fixed_point::visit_precision(fraction_bits, [&](auto zero) {
+        decltype(zero) cr, ci;
+        fixed_point::narrow(ref_re, cr);
+        fixed_point::narrow(ref_im, ci);
+        ref_length = perturbation::reference_orbit(cr, ci, app.threshold, app.n_iterations, orbit);
+    });
+    if (!visited) {
+        // deeper than Anchor resolves, the anchor is all the precision there is
+        ref_length = perturbation::reference_orbit(ref_re, ref_im, app.threshold, app.n_iterations, orbit);
+    }
+    return ref_length;
+}
 
-    if (time_elapsed > 1000000000) {
-        time_last = time_current;
-        fps = fps_count;
-        fps_count = 0;
+// Renders the view into pert.target: the first pass uses a reference at the image centre, every following
+// pass takes a new reference inside the pixels the previous passes marked as glitched (alpha 0) and, through
+// blending on the destination alpha, only replaces those. Returns the number of pixels still glitched.
+static long long render_perturbation(const AppState &app, PerturbationGL &pert, int width, int height,
+                                     int tex_unit_colormap, int tex_unit_orbit, int glitch_passes) {
+    const mandelbrot::ViewParams &vp = *app.vp;
+    double real_step = (vp.real_max - vp.real_min) / (width - 1.0);
+    double imag_step = (vp.imag_max - vp.imag_min) / (height - 1.0);
+    int ref_x = width / 2, ref_y = height / 2;
+    long long n_glitched = 0;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, pert.target.fbo);
+    glUseProgram(pert.program);
+    glActiveTexture(GL_TEXTURE0 + tex_unit_orbit);
+    glBindTexture(GL_TEXTURE_BUFFER, pert.tex_orbit);
+    glUniform1i(pert.loc_ref_orbit, tex_unit_orbit);
+    glUniform1i(pert.loc_colormap, tex_unit_colormap);
+    glUniform1i(pert.loc_n_iterations, app.n_iterations);
+    glUniform1f(pert.loc_threshold, app.threshold);
+    glUniform2f(pert.loc_pixel_step, static_cast<float>(real_step), static_cast<float>(imag_step));
+
+    for (int idx_pass = 0; idx_pass <= glitch_passes; idx_pass++) {
+        double offset_re = vp.real_min + ref_x * real_step, offset_im = vp.imag_min + ref_y * imag_step;
+        int ref_length = view_reference_orbit(app, width, offset_re, offset_im, pert.orbit);
+
+        glBindBuffer(GL_TEXTURE_BUFFER, pert.orbit_buffer);
+        glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(pert.orbit.size() * sizeof(float)),
+                     pert.orbit.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        // re-attach: the orbit length changes between passes and some drivers keep the old store otherwise
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32F, pert.orbit_buffer);
+
+        glUniform1i(pert.loc_ref_length, ref_length);
+        glUniform2f(pert.loc_ref_pixel, static_cast<float>(ref_x), static_cast<float>(ref_y));
+        auto ref_c_re = static_cast<float>(app.anchor_re + Anchor(offset_re));
+        auto ref_c_im = static_cast<float>(app.anchor_im + Anchor(offset_im));
+        glUniform2f(pert.loc_ref_c, ref_c_re, ref_c_im);
+        // the shader's cardioid / bulb test adds dc to ref_c in float: only meaningful while a pixel step is
+        // a few float ulps of ref_c at least
+        double c_scale = std::max({std::fabs(static_cast<double>(ref_c_re)),
+                                   std::fabs(static_cast<double>(ref_c_im)), 0.25});
+        glUniform1i(pert.loc_interior_test,
+                    std::min(std::fabs(real_step), std::fabs(imag_step)) >= 4.0 * FLT_EPSILON * c_scale);
+
+        if (idx_pass > 0) {
+            // keep pixels that are done (dst alpha 1), take the new result where dst alpha is 0
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_ONE_MINUS_DST_ALPHA, GL_DST_ALPHA);
+        }
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
 
-        spdlog::info("fps: {}", fps);
+        // the glitch mask comes back through a full readback - only paid when the view changes
+        pert.pixels.resize(static_cast<size_t>(width) * height * 4);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pert.pixels.data());
+        auto glitched = [&pert, width](int x, int y) {
+            return pert.pixels[(static_cast<size_t>(y) * width + x) * 4 + 3] == 0;
+        };
+        n_glitched = 0;
+        for (size_t idx = 3; idx < pert.pixels.size(); idx += 4) {
+            n_glitched += pert.pixels[idx] == 0;
+        }
+        if (idx_pass == glitch_passes || !perturbation::pick_glitch_reference(width, height, glitched, ref_x, ref_y)) {
+            break;
+        }
     }
+    glDisable(GL_BLEND);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return n_glitched;
 }
 
+// CPU phases of a frame, see frame_stats::FrameStats
+enum FramePhase { PHASE_VIEW, PHASE_UPLOAD, PHASE_DRAW, PHASE_SWAP };
+
+// the view counts as idle (and is drawn at full resolution) this long after the last change
+const double IDLE_AFTER_MS = 300.0;
+
 int main(int argc, char *argv[]) {
     spdlog::set_level(spdlog::level::debug);
 
@@ -128,7 +256,25 @@ int main(int argc, char *argv[]) {
             ("imin,imag_min", "Imaginary number minimum", cxxopts::value<float>()->default_value("-1.1"))
             ("imax,imag_max", "Imaginary number maximum", cxxopts::value<float>()->default_value("1.1"))
             ("i,n_iterations", "Number of iterations", cxxopts::value<int>()->default_value("100"))
-            ("t,threshold", "Abs value threshold", cxxopts::value<float>()->default_value("6.0"));
+            ("t,threshold", "Abs value threshold", cxxopts::value<float>()->default_value("6.0"))
+            ("b,iter_budget", "Iterations per frame for progressive rendering of high iteration counts "
+                              "(0 - the whole iteration in one draw)", cxxopts::value<int>()->default_value("0"))
+            ("p,perturbation", "Iterate float deltas against a high precision reference orbit (deep zoom)",
+             cxxopts::value<bool>()->default_value("false"))
+            ("anchor_re", "Perturbation: real part of the point the view bounds are relative to, as a decimal "
+                          "of any length", cxxopts::value<std::string>()->default_value("0"))
+            ("anchor_im", "Perturbation: imaginary part of the point the view bounds are relative to",
+             cxxopts::value<std::string>()->default_value("0"))
+            ("glitch_passes", "Perturbation passes with a new reference for glitched pixels",
+             cxxopts::value<int>()->default_value("8"))
+            ("glitch_tolerance", "Perturbation glitch detection tolerance",
+             cxxopts::value<float>()->default_value("0.001"))
+            ("target_ms", "Frame time to hold while the view changes by rendering at a lower resolution "
+                          "(0 - always full resolution)", cxxopts::value<float>()->default_value("20"))
+            ("min_scale", "Lowest fraction of the window resolution used while the view changes",
+             cxxopts::value<float>()->default_value("0.25"))
+            ("stats_csv", "Write per-frame timings (CPU phases and GPU time) to this CSV file",
+             cxxopts::value<std::string>()->default_value(""));
     auto result = options.parse(argc, argv);
 
     // Initialise GLFW
@@ -158,6 +304,22 @@ int main(int argc, char *argv[]) {
     app.height = height;
     app.n_iterations = result["n_iterations"].as<int>();
     app.threshold = result["threshold"].as<float>();
+    int iter_budget = result["iter_budget"].as<int>();
+    bool use_perturbation = result["perturbation"].as<bool>();
+    int glitch_passes = result["glitch_passes"].as<int>();
+    float glitch_tolerance = result["glitch_tolerance"].as<float>();
+    if (use_perturbation && iter_budget > 0) {
+        spdlog::error("--perturbation and --iter_budget cannot be combined");
+        return -1;
+    }
+    if (!Anchor::from_string(result["anchor_re"].as<std::string>(), app.anchor_re_initial) ||
+        !Anchor::from_string(result["anchor_im"].as<std::string>(), app.anchor_im_initial)) {
+        spdlog::error("Could not parse the anchor: {}, {}", result["anchor_re"].as<std::string>(),
+                      result["anchor_im"].as<std::string>());
+        return -1;
+    }
+    app.anchor_re = app.anchor_re_initial;
+    app.anchor_im = app.anchor_im_initial;
 
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -232,27 +394,135 @@ int main(int argc, char *argv[]) {
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
     glBindVertexArray(0);
 
-    GLuint shader_program = utils_shaders::LoadShadersFromSource(shaders_mandelbrot::VERTEX_SRC, shaders_mandelbrot::FRAGMENT_SRC);
+    GLuint shader_program = utils_shaders::LoadShadersFromSource(
+            shaders_mandelbrot::VERTEX_SRC, shaders_mandelbrot::FRAGMENT_SRC.c_str()
+    );
 
     if (shader_program == 0) {
         spdlog::error("Error loading shader");
         return -1;
     }
 
-    // ------------ create COMPLEX VALUES TEXTURE ----------------------------
-    std::vector<float> complex_set = mandelbrot::gen_complex_set_2_shader(width, height, vp);
-    mandelbrot::print_complex_set_bounds(complex_set, width, height);
-
-    GLuint tex_complex;
-    glGenTextures(1, &tex_complex);
-    glBindTexture(GL_TEXTURE_2D, tex_complex);
-    // GL_RG stores 2 values per pixel - Red, Green
-    // Red will store real part of complex number and Green - imaginary
-    glTexImage2D(
-            GL_TEXTURE_2D, 0, GL_RGBA32F, width, height, 0, GL_RGBA, GL_FLOAT, complex_set.data()
-    );
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // ------------ frame timing: CPU phases, GPU time through timer queries, ImGui overlay (F1 toggles)
+    IMGUI_CHECKVERSION();
+    ImGui::CreateContext();
+    ImGui_ImplGlfw_InitForOpenGL(window, true);
+    ImGui_ImplOpenGL3_Init("#version 330");
+
+    frame_stats::FrameStats stats({"view", "upload", "draw", "swap"});
+    if (!result["stats_csv"].as<std::string>().empty() && !stats.open_csv(result["stats_csv"].as<std::string>())) {
+        return -1;
+    }
+    utils_shaders::GpuTimer gpu_timer;
+    utils_shaders::create_gpu_timer(gpu_timer);
+
+    // ------------ frame cache: the single-pass kernel renders into an offscreen target that is blitted to the
+    // window every frame and only redrawn when something it depends on changes
+    bool use_frame_cache = iter_budget == 0 && !use_perturbation;
+    utils_shaders::RenderTarget frame_target;
+    bool frame_dirty = true;
+    int frame_n_iterations = app.n_iterations;
+    float frame_threshold = app.threshold;
+
+    // ------------ dynamic resolution: while the view changes, the kernel renders into the lower left part of
+    // the frame target at a size picked from the measured frame time, and the blit upscales it
+    float target_ms = result["target_ms"].as<float>();
+    bool use_dynamic_resolution = target_ms > 0.0f && use_frame_cache;
+    resolution_scaler::ResolutionScaler scaler(target_ms, result["min_scale"].as<float>());
+    int render_width = width, render_height = height;
+    bool prev_frame_scaled = false;
+    bool frame_scaled = false;  // the cached frame is below full resolution
+    double latest_gpu_ms = -1.0;
+    auto time_view_changed = std::chrono::steady_clock::now();
+
+    if (use_frame_cache) {
+        if (!utils_shaders::create_render_target(frame_target, width, height, {GL_RGBA8})) {
+            spdlog::error("Could not create the frame render target");
+            return -1;
+        }
+    }
+    if (use_dynamic_resolution) {
+        spdlog::info("Dynamic resolution: target {} ms per frame", target_ms);
+    }
+
+    // ------------ progressive mode: (z, iter) state ping-pongs between two float targets
+    GLuint accum_program = 0, accum_display_program = 0;
+    utils_shaders::RenderTarget accum_targets[2];
+    int accum_src = 0;              // target holding the latest state
+    bool accum_reset = true;        // next pass starts every pixel from z = 0
+    int accum_iterations_done = 0;  // iterations every running pixel has completed
+    int accum_n_iterations = app.n_iterations;
+    GLint loc_accum_state_z_prev = -1, loc_accum_state_iter_prev = -1, loc_accum_reset_state = -1;
+    GLint loc_accum_iter_budget = -1, loc_accum_n_iterations = -1, loc_accum_threshold = -1;
+    GLint loc_accum_view_origin = -1, loc_accum_view_step = -1, loc_accum_pixel_offset = -1;
+    GLint loc_display_state_iter = -1, loc_display_colormap = -1, loc_display_n_iterations = -1;
+
+    if (iter_budget > 0) {
+        accum_program = utils_shaders::LoadShadersFromSource(
+                shaders_mandelbrot::VERTEX_SRC, shaders_mandelbrot::FRAGMENT_ACCUM_SRC.c_str()
+        );
+        accum_display_program = utils_shaders::LoadShadersFromSource(
+                shaders_mandelbrot::VERTEX_SRC, shaders_mandelbrot::FRAGMENT_ACCUM_DISPLAY_SRC.c_str()
+        );
+        for (auto &target: accum_targets) {
+            if (!utils_shaders::create_render_target(target, width, height, {GL_RGBA32F, GL_RG32F})) {
+                spdlog::error("Float render targets are not supported");
+                return -1;
+            }
+        }
+        loc_accum_state_z_prev = glGetUniformLocation(accum_program, "state_z_prev");
+        loc_accum_state_iter_prev = glGetUniformLocation(accum_program, "state_iter_prev");
+        loc_accum_reset_state = glGetUniformLocation(accum_program, "reset_state");
+        loc_accum_iter_budget = glGetUniformLocation(accum_program, "iter_budget");
+        loc_accum_n_iterations = glGetUniformLocation(accum_program, "n_iterations");
+        loc_accum_threshold = glGetUniformLocation(accum_program, "threshold");
+        loc_accum_view_origin = glGetUniformLocation(accum_program, "view_origin");
+        loc_accum_view_step = glGetUniformLocation(accum_program, "view_step");
+        loc_accum_pixel_offset = glGetUniformLocation(accum_program, "pixel_offset");
+        loc_display_state_iter = glGetUniformLocation(accum_display_program, "state_iter");
+        loc_display_colormap = glGetUniformLocation(accum_display_program, "colormap");
+        loc_display_n_iterations = glGetUniformLocation(accum_display_program, "n_iterations");
+        spdlog::info("Progressive rendering: {} iterations per frame", iter_budget);
+    }
+
+    // ------------ perturbation mode: reference orbit in a buffer texture, image cached in an RGBA8 target
+    PerturbationGL pert;
+    bool pert_dirty = true;
+    int pert_n_iterations = app.n_iterations;
+    float pert_threshold = app.threshold;
+
+    if (use_perturbation) {
+        pert.program = utils_shaders::LoadShadersFromSource(
+                shaders_mandelbrot::VERTEX_SRC, shaders_mandelbrot::FRAGMENT_PERTURBATION_SRC.c_str()
+        );
+        if (!utils_shaders::create_render_target(pert.target, width, height, {GL_RGBA8})) {
+            spdlog::error("Could not create the perturbation render target");
+            return -1;
+        }
+        glGenBuffers(1, &pert.orbit_buffer);
+        glGenTextures(1, &pert.tex_orbit);
+
+        pert.loc_ref_orbit = glGetUniformLocation(pert.program, "ref_orbit");
+        pert.loc_ref_length = glGetUniformLocation(pert.program, "ref_length");
+        pert.loc_ref_pixel = glGetUniformLocation(pert.program, "ref_pixel");
+        pert.loc_ref_c = glGetUniformLocation(pert.program, "ref_c");
+        pert.loc_pixel_step = glGetUniformLocation(pert.program, "pixel_step");
+        pert.loc_interior_test = glGetUniformLocation(pert.program, "interior_test");
+        pert.loc_threshold = glGetUniformLocation(pert.program, "threshold");
+        pert.loc_glitch_tolerance = glGetUniformLocation(pert.program, "glitch_tolerance");
+        pert.loc_n_iterations = glGetUniformLocation(pert.program, "n_iterations");
+        pert.loc_colormap = glGetUniformLocation(pert.program, "colormap");
+        glUseProgram(pert.program);
+        glUniform1f(pert.loc_glitch_tolerance, glitch_tolerance);
+        glUseProgram(0);
+
+        recenter_view(app);
+        spdlog::info("Perturbation rendering: up to {} glitch passes", glitch_passes);
+    }
+
+    // ------------ view uniforms: c is reconstructed per fragment from origin + pixel * step
+    mandelbrot::ShaderView shader_view = mandelbrot::gen_shader_view(width, height, vp);
+    spdlog::debug("View bounds: real=[{}, {}], imag=[{}, {}]", vp.real_min, vp.real_max, vp.imag_min, vp.imag_max);
     // -------------------------------------------------------------
 
     // --------------- create COLORMAP TEXTURE ------------------------------
@@ -269,10 +539,14 @@ int main(int argc, char *argv[]) {
     GLint loc_threshold = glGetUniformLocation(shader_program, "threshold");
     GLint loc_n_iterations = glGetUniformLocation(shader_program, "n_iterations");
     GLint loc_colormap = glGetUniformLocation(shader_program, "colormap");
-    GLint loc_complex_set = glGetUniformLocation(shader_program, "complexSet");
+    GLint loc_view_origin = glGetUniformLocation(shader_program, "view_origin");
+    GLint loc_view_step = glGetUniformLocation(shader_program, "view_step");
+    GLint loc_pixel_offset = glGetUniformLocation(shader_program, "pixel_offset");
 
-    int tex_unit_complex_set = 1;
     int tex_unit_colormap = 0;
+    int tex_unit_state_z = 1;
+    int tex_unit_state_iter = 2;
+    int tex_unit_orbit = 3;
 
     glfwSetWindowTitle(window, "Mandelbrot | zoom: 1x");
 
@@ -284,7 +558,32 @@ int main(int argc, char *argv[]) {
     while (glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS &&
            glfwWindowShouldClose(window) == 0) {
 
-        get_fps();
+        stats.begin_frame();
+        utils_shaders::gpu_timer_collect(gpu_timer, [&stats, &latest_gpu_ms](uint64_t frame, double gpu_ms) {
+            stats.set_gpu_ms(frame, gpu_ms);
+            latest_gpu_ms = gpu_ms;
+        });
+
+        // follow the window size; every cached image and per-pixel state is per framebuffer size
+        int fb_width, fb_height;
+        glfwGetFramebufferSize(window, &fb_width, &fb_height);
+        if (fb_width > 1 && fb_height > 1 && (fb_width != width || fb_height != height)) {
+            width = app.width = fb_width;
+            height = app.height = fb_height;
+            spdlog::debug("framebuffer width={}, height={}", width, height);
+            if (use_frame_cache) {
+                utils_shaders::create_render_target(frame_target, width, height, {GL_RGBA8});
+            }
+            if (iter_budget > 0) {
+                for (auto &target: accum_targets) {
+                    utils_shaders::create_render_target(target, width, height, {GL_RGBA32F, GL_RG32F});
+                }
+            }
+            if (use_perturbation) {
+                utils_shaders::create_render_target(pert.target, width, height, {GL_RGBA8});
+            }
+            app.view_dirty = true;
+        }
 
         // Render on the whole framebuffer, complete from the lower left corner to
         // the upper right
@@ -294,34 +593,176 @@ int main(int argc, char *argv[]) {
         // --------------------- Draw section -------------------------
         if (app.view_dirty) {
             app.view_dirty = false;
-            complex_set = mandelbrot::gen_complex_set_2_shader(width, height, vp);
-            mandelbrot::print_complex_set_bounds(complex_set, width, height);
-            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_FLOAT, complex_set.data());
+            accum_reset = true;
+            pert_dirty = true;
+            frame_dirty = true;
+            shader_view = mandelbrot::gen_shader_view(width, height, vp);
+            spdlog::debug("View bounds: real=[{}, {}], imag=[{}, {}]", vp.real_min, vp.real_max, vp.imag_min, vp.imag_max);
             double zoom = (vp_initial.real_max - vp_initial.real_min) / (vp.real_max - vp.real_min);
-            glfwSetWindowTitle(window, ("Mandelbrot | zoom: " + std::to_string((long long)zoom) + "x").c_str());
+            // perturbation zooms go far past what a long long holds
+            std::string zoom_text = zoom < 1e15 ? std::to_string((long long)zoom) : fmt::format("{:.3g}", zoom);
+            glfwSetWindowTitle(window, ("Mandelbrot | zoom: " + zoom_text + "x").c_str());
+            time_view_changed = std::chrono::steady_clock::now();
+        }
+        if (app.n_iterations != frame_n_iterations || app.threshold != frame_threshold) {
+            frame_n_iterations = app.n_iterations;
+            frame_threshold = app.threshold;
+            frame_dirty = true;
+            time_view_changed = std::chrono::steady_clock::now();
+        }
+        double ms_since_change = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - time_view_changed).count();
+        bool idle = ms_since_change > IDLE_AFTER_MS;
+        if (use_dynamic_resolution && idle && frame_scaled) {
+            // the view settled on a reduced-resolution frame: redraw it at full resolution
+            frame_dirty = true;
         }
-        glUseProgram(shader_program);
 
-        glActiveTexture(GL_TEXTURE0 + tex_unit_complex_set);
-        glBindTexture(GL_TEXTURE_2D, tex_complex);
-        glUniform1i(loc_complex_set, tex_unit_complex_set);
+        bool render_frame = use_frame_cache && frame_dirty;
+        if (render_frame) {
+            if (use_dynamic_resolution && !idle) {
+                // GPU timer results lag a few frames and are meaningless on some drivers (llvmpipe reports ~0),
+                // the CPU frame time covers those; whichever is larger is what limits the frame rate
+                if (prev_frame_scaled) {
+                    scaler.update(std::max(stats.last().total_ms, latest_gpu_ms));
+                }
+                scaler.render_size(width, height, render_width, render_height);
+            } else {
+                render_width = width;
+                render_height = height;
+            }
+            frame_scaled = render_width != width || render_height != height;
+            shader_view = mandelbrot::gen_shader_view(render_width, render_height, vp);
+        }
+        prev_frame_scaled = render_frame && frame_scaled;
+        stats.end_phase(PHASE_VIEW);
+        utils_shaders::gpu_timer_begin(gpu_timer, stats.frame_index());
 
         glActiveTexture(GL_TEXTURE0 + tex_unit_colormap);
         glBindTexture(GL_TEXTURE_1D, tex_colormap);
-        glUniform1i(loc_colormap, tex_unit_colormap);
+        glBindVertexArray(VAO);
 
-        glUniform1f(loc_threshold, app.threshold);
-        glUniform1i(loc_n_iterations, app.n_iterations);
+        if (use_perturbation) {
+            if (pert_dirty || app.n_iterations != pert_n_iterations || app.threshold != pert_threshold) {
+                pert_dirty = false;
+                pert_n_iterations = app.n_iterations;
+                pert_threshold = app.threshold;
+                recenter_view(app);
+                long long n_glitched = render_perturbation(app, pert, width, height,
+                                                           tex_unit_colormap, tex_unit_orbit, glitch_passes);
+                if (n_glitched > 0) {
+                    spdlog::debug("{} pixels still glitched after {} passes", n_glitched, glitch_passes);
+                }
+            }
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, pert.target.fbo);
+            glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        } else if (iter_budget > 0) {
+            if (app.n_iterations < accum_n_iterations) {
+                // fewer iterations: pixels may already be past the new cap, start over
+                accum_reset = true;
+            } else {
+                // more iterations: running pixels sit at the old cap and simply continue from there
+                accum_iterations_done = std::min(accum_iterations_done, accum_n_iterations);
+            }
+            accum_n_iterations = app.n_iterations;
+
+            if (accum_reset || accum_iterations_done < app.n_iterations) {
+                const auto &src = accum_targets[accum_src];
+                const auto &dst = accum_targets[1 - accum_src];
+
+                glBindFramebuffer(GL_FRAMEBUFFER, dst.fbo);
+                glUseProgram(accum_program);
+
+                glActiveTexture(GL_TEXTURE0 + tex_unit_state_z);
+                glBindTexture(GL_TEXTURE_2D, src.textures[0]);
+                glActiveTexture(GL_TEXTURE0 + tex_unit_state_iter);
+                glBindTexture(GL_TEXTURE_2D, src.textures[1]);
+                glUniform1i(loc_accum_state_z_prev, tex_unit_state_z);
+                glUniform1i(loc_accum_state_iter_prev, tex_unit_state_iter);
+                glUniform1i(loc_accum_reset_state, accum_reset);
+                glUniform1i(loc_accum_iter_budget, iter_budget);
+                glUniform1i(loc_accum_n_iterations, app.n_iterations);
+                glUniform1f(loc_accum_threshold, app.threshold);
+                glUniform4fv(loc_accum_view_origin, 1, shader_view.origin);
+                glUniform4fv(loc_accum_view_step, 1, shader_view.step);
+                glUniform2f(loc_accum_pixel_offset, 0.0f, 0.0f);
+
+                glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
+
+                accum_src = 1 - accum_src;
+                accum_iterations_done = accum_reset ? iter_budget : accum_iterations_done + iter_budget;
+                accum_reset = false;
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            }
+
+            glUseProgram(accum_display_program);
+            glActiveTexture(GL_TEXTURE0 + tex_unit_state_iter);
+            glBindTexture(GL_TEXTURE_2D, accum_targets[accum_src].textures[1]);
+            glUniform1i(loc_display_state_iter, tex_unit_state_iter);
+            glUniform1i(loc_display_colormap, tex_unit_colormap);
+            glUniform1i(loc_display_n_iterations, app.n_iterations);
+        }
+        if (render_frame) {
+            glUseProgram(shader_program);
+            glUniform1i(loc_colormap, tex_unit_colormap);
+            glUniform1f(loc_threshold, app.threshold);
+            glUniform1i(loc_n_iterations, app.n_iterations);
+            glUniform4fv(loc_view_origin, 1, shader_view.origin);
+            glUniform4fv(loc_view_step, 1, shader_view.step);
+            glUniform2f(loc_pixel_offset, 0.0f, 0.0f);
+        }
 
-        glBindVertexArray(VAO);
+        stats.end_phase(PHASE_UPLOAD);
 
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
+        if (render_frame) {
+            glBindFramebuffer(GL_FRAMEBUFFER, frame_target.fbo);
+            glViewport(0, 0, render_width, render_height);
+            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glViewport(0, 0, width, height);
+            frame_dirty = false;
+        }
+        if (use_frame_cache) {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, frame_target.fbo);
+            glBlitFramebuffer(0, 0, render_width, render_height, 0, 0, width, height, GL_COLOR_BUFFER_BIT,
+                              frame_scaled ? GL_LINEAR : GL_NEAREST);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        } else if (iter_budget > 0) {
+            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, nullptr);
+        }
+        if (app.show_stats) {
+            ImGui_ImplOpenGL3_NewFrame();
+            ImGui_ImplGlfw_NewFrame();
+            ImGui::NewFrame();
+            frame_stats::draw_overlay(stats);
+            ImGui::Render();
+            ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        }
+        utils_shaders::gpu_timer_end(gpu_timer);
+        stats.end_phase(PHASE_DRAW);
         // -------------------- END draw section ----------------------
 
         // Swap buffers
         glfwSwapBuffers(window);
-        glfwPollEvents();
+        stats.end_phase(PHASE_SWAP);
+        stats.end_frame();
+
+        // Nothing left to compute: sleep until input instead of spinning on an unchanged image.
+        // Progressive passes keep polling, and a reduced-resolution frame wakes up when the view turns idle.
+        bool accumulating = iter_budget > 0 && (accum_reset || accum_iterations_done < app.n_iterations);
+        if (accumulating || app.view_dirty) {
+            glfwPollEvents();
+        } else if (use_dynamic_resolution && frame_scaled) {
+            glfwWaitEventsTimeout(std::max(0.0, IDLE_AFTER_MS - ms_since_change) / 1000.0 + 0.001);
+        } else {
+            glfwWaitEvents();
+        }
     }
+    utils_shaders::delete_gpu_timer(gpu_timer);
+    ImGui_ImplOpenGL3_Shutdown();
+    ImGui_ImplGlfw_Shutdown();
+    ImGui::DestroyContext();
     // Delete buffer
     glDeleteBuffers(1, &VBO);
     glDeleteBuffers(1, &EBO);
@@ -329,8 +770,22 @@ int main(int argc, char *argv[]) {
     glDeleteVertexArrays(1, &VAO);
     // Delete shader program
     glDeleteProgram(shader_program);
+    if (iter_budget > 0) {
+        glDeleteProgram(accum_program);
+        glDeleteProgram(accum_display_program);
+        utils_shaders::delete_render_target(accum_targets[0]);
+        utils_shaders::delete_render_target(accum_targets[1]);
+    }
+    if (use_frame_cache) {
+        utils_shaders::delete_render_target(frame_target);
+    }
+    if (use_perturbation) {
+        glDeleteProgram(pert.program);
+        utils_shaders::delete_render_target(pert.target);
+        glDeleteTextures(1, &pert.tex_orbit);
+        glDeleteBuffers(1, &pert.orbit_buffer);
+    }
     // Delete textures
-    glDeleteTextures(1, &tex_complex);
     glDeleteTextures(1, &tex_colormap);
     // terminate GLFW and exiting
     glfwTerminate();
@@ -0,0 +1,302 @@
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+#include "atlas.hpp"
+#include "formulas.hpp"
+#include "interval.hpp"
+#include "mandelbrot.hpp"
+#include "thread_pool.hpp"
+
+#ifndef AREA_HPP
+#define AREA_HPP
+
+// Area and escape-time statistics of a region of the plane, reduced straight into counters - no image.
+//
+// The region is split into a grid of cells, the parallel work units. A cell is settled as a whole when the
+// atlas or the disk arithmetic of interval.hpp proves it interior or escaping at one iteration (Mandelbrot
+// only), or when the distance estimate at its centre proves it exterior (formulas with a derivative);
+// otherwise it is split in four, down to max_depth. Leaf cells that are still unsettled - the
+// boundary - are sampled at jittered points of a samples x samples grid, and get refine^2 times as many
+// samples when those disagree, so sampling effort goes where the boundary is.
+//
+// "Interior" means "does not escape within n_iterations", as in the renders. The standard error covers the
+// sampling of leaf cells: each adds the posterior variance of its interior fraction under a uniform prior,
+// (k + 1)(n - k + 1) / ((n + 2)^2 (n + 3)) for k of n samples inside, which stays non-zero for leaves whose
+// samples all agree but could still hold a filament. It does not cover the bias of the iteration cap.
+namespace area {
+
+    struct Region {
+        double re_min, re_max, im_min, im_max;
+    };
+
+    struct Params {
+        Region region{-2.0, 0.5, -1.25, 1.25}; // holds the whole Mandelbrot set
+        double threshold = 2.0;
+        int n_iterations = 10000;
+        int grid = 32;          // cells per side of the initial split
+        int max_depth = 8;      // quadtree splits below a grid cell
+        int samples = 4;        // samples per side of a leaf cell
+        int refine = 4;         // leaves with mixed samples get (refine * samples)^2 more
+        int regions_x = 1, regions_y = 1; // grid of the per-region statistics, must divide `grid`
+        uint64_t seed = 1;
+    };
+
+    // log2 bins of escape iterations: bin 0 holds iteration 0, bin k holds [2^(k-1), 2^k)
+    const int N_HISTOGRAM_BINS = 33;
+
+    inline int histogram_bin(int iteration) {
+        int bin = 0;
+        for (; iteration > 0; iteration >>= 1) {
+            bin++;
+        }
+        return bin;
+    }
+
+    struct RegionStats {
+        double interior_area = 0.0;
+        double escape_area = 0.0;
+        double iteration_area = 0.0; // sum of escape iteration x area, see mean_escape_iteration()
+        double variance = 0.0;       // of interior_area
+
+        double mean_escape_iteration() const { return escape_area > 0.0 ? iteration_area / escape_area : 0.0; }
+
+        double std_error() const { return std::sqrt(variance); }
+
+        void add(const RegionStats &other, double weight = 1.0) {
+            interior_area += weight * other.interior_area;
+            escape_area += weight * other.escape_area;
+            iteration_area += weight * other.iteration_area;
+            variance += weight * weight * other.variance;
+        }
+    };
+
+    struct Estimate {
+        RegionStats total;
+        std::vector<RegionStats> regions;   // row-major from im_min
+        std::vector<double> escape_histogram = std::vector<double>(N_HISTOGRAM_BINS, 0.0); // area per bin
+        double certified_interior_area = 0.0;
+        double certified_escape_area = 0.0;
+        double sampled_area = 0.0;          // area of the leaf cells, the only part with sampling error
+        uint64_t n_samples = 0;
+        uint64_t n_leaves = 0;
+    };
+
+    namespace detail {
+        // what one grid cell adds to the estimate, before symmetry weighting
+        struct CellResult {
+            RegionStats stats;
+            std::vector<double> escape_histogram = std::vector<double>(N_HISTOGRAM_BINS, 0.0);
+            double certified_interior_area = 0.0, certified_escape_area = 0.0, sampled_area = 0.0;
+            uint64_t n_samples = 0, n_leaves = 0;
+
+            void add_escape(double cell_area, int iteration) {
+                stats.escape_area += cell_area;
+                stats.iteration_area += cell_area * iteration;
+                escape_histogram[histogram_bin(iteration)] += cell_area;
+            }
+        };
+
+        // escape_iteration() shared by the whole rectangle, interval::UNCERTIFIED if it is not proven
+        inline int certify_cell(double re0, double re1, double im0, double im1, double threshold, int n_iterations) {
+            if (const atlas::Atlas *cells = atlas::installed()) {
+                int iteration = cells->lookup(re0, re1, im0, im1, threshold, n_iterations);
+                if (iteration != interval::UNCERTIFIED) {
+                    return iteration;
+                }
+            }
+            double re = (re0 + re1) / 2.0, im = (im0 + im1) / 2.0;
+            double radius = std::hypot(re1 - re0, im1 - im0) / 2.0;
+            return interval::certify_mandelbrot_disk(
+                    {re, im, radius + 4.0 * DBL_EPSILON * (std::fabs(re) + std::fabs(im))}, threshold, n_iterations
+            );
+        }
+
+        // n_side x n_side jittered samples of the rectangle, escapes added to `out` at weight 1 per sample;
+        // returns how many are interior
+        template<typename Formula>
+        long sample_cell(const Formula &formula, const Params &params, double re0, double re1, double im0, double im1,
+                         int n_side, std::mt19937_64 &rng, CellResult &out) {
+            std::uniform_real_distribution<double> jitter(0.0, 1.0);
+            double re_step = (re1 - re0) / n_side, im_step = (im1 - im0) / n_side;
+            long n_interior = 0;
+            for (int row = 0; row < n_side; row++) {
+                for (int col = 0; col < n_side; col++) {
+                    double re = re0 + (col + jitter(rng)) * re_step;
+                    double im = im0 + (row + jitter(rng)) * im_step;
+                    int iteration = params.n_iterations;
+                    if (!std::is_same<Formula, formulas::Mandelbrot>::value || !mandelbrot::in_cardioid_or_bulb(re, im)) {
+                        iteration = mandelbrot::escape_iteration(formula, re, im, params.threshold, params.n_iterations);
+                    }
+                    if (iteration == params.n_iterations) {
+                        n_interior++;
+                    } else {
+                        out.add_escape(1.0, iteration);
+                    }
+                }
+            }
+            return n_interior;
+        }
+
+        // A leaf cell from its samples: a coarse pass, and a fine pass too if the coarse one is mixed. Both are
+        // unbiased, so pooling their samples at equal weight is too. Returns false if the coarse pass was
+        // mixed and `split_if_mixed` asks to split the cell rather than refine it (nothing added then).
+        template<typename Formula>
+        bool sample_leaf(const Formula &formula, const Params &params, double re0, double re1, double im0, double im1,
+                         bool split_if_mixed, std::mt19937_64 &rng, CellResult &out) {
+            CellResult counts;
+            long n = static_cast<long>(params.samples) * params.samples;
+            long k = sample_cell(formula, params, re0, re1, im0, im1, params.samples, rng, counts);
+            bool mixed = k > 0 && k < n;
+            if (mixed && split_if_mixed) {
+                return false;
+            }
+            if (mixed && params.refine > 1) {
+                int fine_side = params.samples * params.refine;
+                k += sample_cell(formula, params, re0, re1, im0, im1, fine_side, rng, counts);
+                n += static_cast<long>(fine_side) * fine_side;
+            }
+
+            double cell_area = (re1 - re0) * (im1 - im0);
+            double per_sample = cell_area / static_cast<double>(n);
+            counts.stats.interior_area = static_cast<double>(k);
+            counts.stats.variance = static_cast<double>(n) * n * static_cast<double>(k + 1) * static_cast<double>(n - k + 1) /
+                                    ((n + 2.0) * (n + 2.0) * (n + 3.0));
+            out.stats.add(counts.stats, per_sample);
+            for (int bin = 0; bin < N_HISTOGRAM_BINS; bin++) {
+                out.escape_histogram[bin] += per_sample * counts.escape_histogram[bin];
+            }
+            out.sampled_area += cell_area;
+            out.n_samples += static_cast<uint64_t>(n);
+            out.n_leaves++;
+            return true;
+        }
+
+        // True if the distance estimate at the centre proves the whole cell outside the set (see
+        // escape_distance()); the cell is then added as exterior, with escape statistics from a coarse sample.
+        // This settles the exterior cells that certify_cell() cannot, where escape iterations vary.
+        template<typename Formula>
+        bool exterior_by_distance(const Formula &formula, const Params &params, double re0, double re1, double im0,
+                                  double im1, std::mt19937_64 &rng, CellResult &out) {
+            if constexpr (Formula::has_derivative) {
+                double re = (re0 + re1) / 2.0, im = (im0 + im1) / 2.0;
+                if (std::is_same<Formula, formulas::Mandelbrot>::value && mandelbrot::in_cardioid_or_bulb(re, im)) {
+                    return false;
+                }
+                double distance = mandelbrot::escape_distance(formula, re, im, params.threshold, params.n_iterations);
+                if (distance < std::hypot(re1 - re0, im1 - im0) / 2.0) {
+                    return false;
+                }
+                CellResult counts;
+                long n = static_cast<long>(params.samples) * params.samples;
+                long n_escaped = n - sample_cell(formula, params, re0, re1, im0, im1, params.samples, rng, counts);
+                if (n_escaped == 0) {
+                    return false;
+                }
+                double cell_area = (re1 - re0) * (im1 - im0);
+                double per_sample = cell_area / static_cast<double>(n_escaped);
+                out.stats.add(counts.stats, per_sample);
+                for (int bin = 0; bin < N_HISTOGRAM_BINS; bin++) {
+                    out.escape_histogram[bin] += per_sample * counts.escape_histogram[bin];
+                }
+                out.certified_escape_area += cell_area;
+                out.n_samples += static_cast<uint64_t>(n);
+                return true;
+            } else {
+                (void) formula, (void) params, (void) re0, (void) re1, (void) im0, (void) im1, (void) rng, (void) out;
+                return false;
+            }
+        }
+
+        // Mandelbrot cells are certified first and split while they are not; other formulas have no
+        // certificate, so their cells are split only where a coarse sample is mixed
+        template<typename Formula>
+        void estimate_cell(const Formula &formula, const Params &params, double re0, double re1, double im0,
+                           double im1, int depth, std::mt19937_64 &rng, CellResult &out) {
+            bool can_split = depth < params.max_depth;
+            if constexpr (std::is_same<Formula, formulas::Mandelbrot>::value) {
+                double cell_area = (re1 - re0) * (im1 - im0);
+                int iteration = certify_cell(re0, re1, im0, im1, params.threshold, params.n_iterations);
+                if (iteration == params.n_iterations) {
+                    out.stats.interior_area += cell_area;
+                    out.certified_interior_area += cell_area;
+                    return;
+                }
+                if (iteration != interval::UNCERTIFIED) {
+                    out.add_escape(cell_area, iteration);
+                    out.certified_escape_area += cell_area;
+                    return;
+                }
+                if (exterior_by_distance(formula, params, re0, re1, im0, im1, rng, out)) {
+                    return;
+                }
+                if (!can_split && sample_leaf(formula, params, re0, re1, im0, im1, false, rng, out)) {
+                    return;
+                }
+            } else if (exterior_by_distance(formula, params, re0, re1, im0, im1, rng, out) ||
+                       sample_leaf(formula, params, re0, re1, im0, im1, can_split, rng, out)) {
+                return;
+            }
+
+            double re_mid = (re0 + re1) / 2.0, im_mid = (im0 + im1) / 2.0;
+            estimate_cell(formula, params, re0, re_mid, im0, im_mid, depth + 1, rng, out);
+            estimate_cell(formula, params, re_mid, re1, im0, im_mid, depth + 1, rng, out);
+            estimate_cell(formula, params, re0, re_mid, im_mid, im1, depth + 1, rng, out);
+            estimate_cell(formula, params, re_mid, re1, im_mid, im1, depth + 1, rng, out);
+        }
+    }
+
+    // Estimates interior area and escape statistics of params.region on the pool. For conjugate-symmetric
+    // formulas and a region symmetric about the real axis, only the upper half is computed and mirrored.
+    template<typename Formula>
+    Estimate estimate(thread_pool::ThreadPool &pool, const Formula &formula, const Params &params) {
+        Estimate result;
+        result.regions.assign(static_cast<size_t>(params.regions_x) * params.regions_y, RegionStats{});
+        const Region &region = params.region;
+        double re_step = (region.re_max - region.re_min) / params.grid;
+        double im_step = (region.im_max - region.im_min) / params.grid;
+
+        bool mirrored = Formula::conjugate_symmetric && region.im_min == -region.im_max && params.grid % 2 == 0;
+        int first_row = mirrored ? params.grid / 2 : 0;
+        int n_rows = params.grid - first_row;
+        int cells_per_region_x = params.grid / params.regions_x, cells_per_region_y = params.grid / params.regions_y;
+
+        std::mutex result_mutex;
+        pool.parallel_for(n_rows * params.grid, [&](int idx_cell) {
+            int row = first_row + idx_cell / params.grid, col = idx_cell % params.grid;
+            std::mt19937_64 rng(params.seed * 0x9E3779B97F4A7C15ull + static_cast<uint64_t>(row) * params.grid + col);
+            detail::CellResult cell;
+            double re0 = region.re_min + col * re_step, im0 = region.im_min + row * im_step;
+            detail::estimate_cell(formula, params, re0, re0 + re_step, im0, im0 + im_step, 0, rng, cell);
+
+            // a mirrored cell counts twice with the same samples: its errors double rather than add in quadrature
+            double weight = mirrored ? 2.0 : 1.0;
+            int region_col = col / cells_per_region_x;
+            int region_row = row / cells_per_region_y;
+            int mirror_row = (params.grid - 1 - row) / cells_per_region_y;
+
+            std::lock_guard<std::mutex> lock(result_mutex);
+            if (mirrored && mirror_row != region_row) {
+                result.regions[static_cast<size_t>(region_row) * params.regions_x + region_col].add(cell.stats);
+                result.regions[static_cast<size_t>(mirror_row) * params.regions_x + region_col].add(cell.stats);
+            } else {
+                result.regions[static_cast<size_t>(region_row) * params.regions_x + region_col].add(cell.stats, weight);
+            }
+            result.total.add(cell.stats, weight);
+            for (int bin = 0; bin < N_HISTOGRAM_BINS; bin++) {
+                result.escape_histogram[bin] += weight * cell.escape_histogram[bin];
+            }
+            result.certified_interior_area += weight * cell.certified_interior_area;
+            result.certified_escape_area += weight * cell.certified_escape_area;
+            result.sampled_area += weight * cell.sampled_area;
+            result.n_samples += cell.n_samples;
+            result.n_leaves += cell.n_leaves;
+        });
+        return result;
+    }
+}
+
+#endif
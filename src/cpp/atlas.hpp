@@ -0,0 +1,254 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "spdlog/spdlog.h"
+
+#include "interval.hpp"
+
+#ifndef ATLAS_HPP
+#define ATLAS_HPP
+
+// Precomputed quadtree over a square of the c plane whose leaves are cells proven interior to the Mandelbrot
+// set, or proven to escape at one shared iteration. Built offline (tools/atlas_builder) and mapped read-only
+// at startup, so tiles inside such cells skip iteration without re-proving anything.
+//
+// File layout (native endianness): a Header followed by n_nodes uint32 nodes, node 0 being the root.
+// A node is a leaf code (NODE_UNKNOWN, NODE_INTERIOR, or ESCAPE_FLAG | iteration) or the index of the first
+// of its 4 children, which are stored next to each other in the order lower left, lower right, upper left,
+// upper right.
+namespace atlas {
+
+    const char MAGIC[4] = {'M', 'B', 'Q', 'T'};
+    const uint32_t FORMAT_VERSION = 1;
+
+    const uint32_t NODE_UNKNOWN = 0xFFFFFFFFu;
+    const uint32_t NODE_INTERIOR = 0xFFFFFFFEu;
+    const uint32_t ESCAPE_FLAG = 0x80000000u;
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        double threshold;       // escape leaves are only valid for this threshold
+        uint32_t n_iterations;  // iteration cap of the build; escape leaves hold iterations below it
+        uint32_t max_depth;
+        double re_min, im_min, size;
+        uint64_t n_nodes;
+    };
+    static_assert(sizeof(Header) == 56, "atlas header layout must not depend on the compiler");
+
+    inline bool is_leaf(uint32_t node) { return node >= ESCAPE_FLAG; }
+
+    // Read-only view of an atlas file mapped into memory
+    class Atlas {
+
+    private:
+        void *mapping = nullptr;
+        size_t mapping_size = 0;
+        const Header *header = nullptr;
+        const uint32_t *nodes = nullptr;
+
+        void unmap() {
+            if (mapping != nullptr) {
+                munmap(mapping, mapping_size);
+            }
+            mapping = nullptr;
+            mapping_size = 0;
+            header = nullptr;
+            nodes = nullptr;
+        }
+
+        // the leaf code shared by every leaf under `node` that overlaps the query, NODE_UNKNOWN if they differ
+        uint32_t lookup_node(uint32_t node, double x0, double y0, double size,
+                             double re_lo, double re_hi, double im_lo, double im_hi) const {
+            if (is_leaf(node)) {
+                return node;
+            }
+            double half = size / 2.0;
+            uint32_t shared = 0;
+            bool has_shared = false;
+            for (uint32_t idx_child = 0; idx_child < 4; idx_child++) {
+                double cx = x0 + (idx_child % 2) * half, cy = y0 + (idx_child / 2) * half;
+                if (re_hi < cx || re_lo > cx + half || im_hi < cy || im_lo > cy + half) {
+                    continue;
+                }
+                uint32_t code = lookup_node(nodes[node + idx_child], cx, cy, half, re_lo, re_hi, im_lo, im_hi);
+                if (code == NODE_UNKNOWN || (has_shared && code != shared)) {
+                    return NODE_UNKNOWN;
+                }
+                shared = code;
+                has_shared = true;
+            }
+            return has_shared ? shared : NODE_UNKNOWN;
+        }
+
+    public:
+        Atlas() = default;
+
+        ~Atlas() { unmap(); }
+
+        Atlas(const Atlas &) = delete;
+        Atlas &operator=(const Atlas &) = delete;
+
+        bool load(const std::string &path) {
+            unmap();
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                spdlog::error("Could not open atlas: {}", path);
+                return false;
+            }
+            struct stat file_stat{};
+            if (fstat(fd, &file_stat) != 0 || static_cast<size_t>(file_stat.st_size) < sizeof(Header)) {
+                spdlog::error("Atlas {} is too small to hold a header", path);
+                close(fd);
+                return false;
+            }
+            mapping_size = static_cast<size_t>(file_stat.st_size);
+            mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (mapping == MAP_FAILED) {
+                mapping = nullptr;
+                spdlog::error("Could not map atlas: {}", path);
+                return false;
+            }
+
+            header = static_cast<const Header *>(mapping);
+            if (std::memcmp(header->magic, MAGIC, sizeof(MAGIC)) != 0 || header->version != FORMAT_VERSION) {
+                spdlog::error("{} is not an atlas of format version {}", path, FORMAT_VERSION);
+                unmap();
+                return false;
+            }
+            if (header->n_nodes == 0 || mapping_size != sizeof(Header) + header->n_nodes * sizeof(uint32_t)) {
+                spdlog::error("Atlas {} is truncated: expected {} nodes", path, header->n_nodes);
+                unmap();
+                return false;
+            }
+            nodes = reinterpret_cast<const uint32_t *>(static_cast<const char *>(mapping) + sizeof(Header));
+            spdlog::info("Atlas {}: {} nodes, depth {}, built for {} iterations, threshold {}",
+                         path, header->n_nodes, header->max_depth, header->n_iterations, header->threshold);
+            return true;
+        }
+
+        bool loaded() const { return header != nullptr; }
+
+        const Header &info() const { return *header; }
+
+        // Escape iteration (as escape_iteration() returns it) shared by every c in the rectangle,
+        // interval::UNCERTIFIED if the atlas does not settle it. Interior leaves hold for any iteration cap
+        // and any threshold >= 2 (orbits of the set stay within |z| <= 2); escape leaves only for the
+        // threshold the atlas was built with.
+        int lookup(double re_lo, double re_hi, double im_lo, double im_hi, double threshold, int n_iterations) const {
+            if (!loaded() || re_lo < header->re_min || im_lo < header->im_min ||
+                re_hi > header->re_min + header->size || im_hi > header->im_min + header->size) {
+                return interval::UNCERTIFIED;
+            }
+            uint32_t code = lookup_node(nodes[0], header->re_min, header->im_min, header->size,
+                                        re_lo, re_hi, im_lo, im_hi);
+            if (code == NODE_INTERIOR) {
+                return threshold >= 2.0 ? n_iterations : interval::UNCERTIFIED;
+            }
+            if (code != NODE_UNKNOWN && threshold == header->threshold) {
+                return std::min(static_cast<int>(code & ~ESCAPE_FLAG), n_iterations);
+            }
+            return interval::UNCERTIFIED;
+        }
+    };
+
+    namespace detail {
+        inline const Atlas *&installed_atlas() {
+            static const Atlas *atlas = nullptr;
+            return atlas;
+        }
+    }
+
+    // Makes the engine consult `atlas` before certifying or iterating Mandelbrot tiles (nullptr to stop).
+    // The atlas must outlive every render started while it is installed.
+    inline void install(const Atlas *atlas) { detail::installed_atlas() = atlas; }
+
+    inline const Atlas *installed() { return detail::installed_atlas(); }
+
+    // ------------------------------------ building ------------------------------------
+
+    // Subtree of one cell in the node encoding, with links relative to the vector: element 0 is the cell's
+    // own node, its children (if any) follow.
+    using Subtree = std::vector<uint32_t>;
+
+    // Combines the subtrees of 4 sibling cells into their parent's; 4 equal leaves collapse into one.
+    inline Subtree merge_children(const Subtree children[4]) {
+        if (is_leaf(children[0][0]) && children[0].size() == 1) {
+            bool all_same = true;
+            for (int idx_child = 1; idx_child < 4; idx_child++) {
+                all_same = all_same && children[idx_child].size() == 1 && children[idx_child][0] == children[0][0];
+            }
+            if (all_same) {
+                return {children[0][0]};
+            }
+        }
+
+        // parent link, 4 child nodes, then the descendants of each child in turn
+        Subtree merged{1, 0, 0, 0, 0};
+        for (int idx_child = 0; idx_child < 4; idx_child++) {
+            const Subtree &child = children[idx_child];
+            // child element k >= 1 lands at merged index base + k - 1
+            auto base = static_cast<uint32_t>(merged.size());
+            auto rebase = [base](uint32_t node) { return is_leaf(node) ? node : base + node - 1; };
+            merged[1 + idx_child] = rebase(child[0]);
+            for (size_t k = 1; k < child.size(); k++) {
+                merged.push_back(rebase(child[k]));
+            }
+        }
+        return merged;
+    }
+
+    // Proves what it can about the square cell [x0, x0 + size] x [y0, y0 + size], splitting it until
+    // `max_depth` where a leaf cannot be proven. Interior leaves need a trap (see interval::is_trap()),
+    // surviving n_iterations is not enough, since the atlas serves renders with any iteration cap.
+    inline Subtree build_cell(double x0, double y0, double size, int depth, int max_depth,
+                              double threshold, int n_iterations) {
+        double half = size / 2.0;
+        interval::Disk c{x0 + half, y0 + half, half * std::sqrt(2.0) * (1.0 + 1e-12)};
+        bool trapped = false;
+        int iteration = interval::certify_mandelbrot_disk(c, threshold, n_iterations, &trapped);
+        if (trapped) {
+            return {NODE_INTERIOR};
+        }
+        if (iteration != interval::UNCERTIFIED && iteration < n_iterations) {
+            return {ESCAPE_FLAG | static_cast<uint32_t>(iteration)};
+        }
+        if (depth >= max_depth) {
+            return {NODE_UNKNOWN};
+        }
+        Subtree children[4];
+        for (int idx_child = 0; idx_child < 4; idx_child++) {
+            children[idx_child] = build_cell(x0 + (idx_child % 2) * half, y0 + (idx_child / 2) * half, half,
+                                             depth + 1, max_depth, threshold, n_iterations);
+        }
+        return merge_children(children);
+    }
+
+    bool write(const std::string &path, const Header &header, const Subtree &nodes) {
+        std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!out.is_open()) {
+            spdlog::error("Could not open atlas for writing: {}", path);
+            return false;
+        }
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(nodes.data()),
+                  static_cast<std::streamsize>(nodes.size() * sizeof(uint32_t)));
+        if (!out.good()) {
+            spdlog::error("Failed to write atlas: {}", path);
+            return false;
+        }
+        return true;
+    }
+}
+
+#endif
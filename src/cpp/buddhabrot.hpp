@@ -0,0 +1,332 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "spdlog/spdlog.h"
+
+#include "mandelbrot.hpp"
+#include "thread_pool.hpp"
+
+#ifndef BUDDHABROT_HPP
+#define BUDDHABROT_HPP
+
+// Buddhabrot (orbit density) rendering: random c values are iterated under z^2 + c and every orbit that
+// escapes within [min_iterations, max_iterations) adds each z it visits to a density histogram of the view.
+//
+// Uniform sampling wastes most samples: c in the main cardioid or the period-2 bulb never escape (rejected
+// up front with in_cardioid_or_bulb()), and most of the rest escape at once or leave no point in a zoomed
+// view. With `metropolis`, each worker runs a Metropolis-Hastings chain over c whose target density is the
+// number of orbit points landing in the view, so samples concentrate on the few c near the boundary that
+// draw the picture. Each step then deposits its orbit with weight 1 / (points in view), which undoes the
+// bias: both modes estimate the same image, the chains with far less noise for the same samples.
+//
+// Every NUMA node of the pool has one histogram, first touched by one of its workers, which the chains running
+// there share: a chain buffers its deposits and adds them a band of rows at a time under that band's lock, so
+// memory stays at one frame per node whatever the thread count. Uniform sampling counts in uint32_t, the
+// weighted Metropolis-Hastings deposits in double. The node histograms are summed once all chains are done.
+namespace buddhabrot {
+
+    struct Params {
+        int width = 1920, height = 1080;
+        mandelbrot::ViewParams vp{-2.0, 1.0, -1.2, 1.2, 0.0, 0.0, 0.0};
+        double threshold = 2.0;
+        int min_iterations = 20;
+        int max_iterations = 1000;
+        uint64_t n_samples = 10000000;
+        bool metropolis = false;
+        uint64_t seed = 1;
+    };
+
+    struct Stats {
+        uint64_t n_samples = 0;
+        uint64_t n_bulb_rejected = 0;   // c in the cardioid / bulb, not iterated
+        uint64_t n_contributing = 0;    // samples whose orbit landed in the view
+        uint64_t n_proposals = 0;       // Metropolis-Hastings proposals, without the draws finding the start
+        uint64_t n_accepted = 0;        // Metropolis-Hastings proposals taken
+    };
+
+    // uniform sampling draws c from |c| <= 2, which holds the whole set
+    const double SAMPLE_RADIUS = 2.0;
+    // share of Metropolis-Hastings proposals drawn uniformly rather than as a small step, so a chain can
+    // leave a region it is stuck in
+    const double UNIFORM_PROPOSAL_RATE = 0.2;
+    // uniform draws a chain may take to find its first contributing c
+    const int MAX_START_ATTEMPTS = 1000000;
+    // deposits a chain buffers before adding them to its histogram, and rows of a histogram under one lock
+    const size_t DEPOSIT_BATCH = 1 << 16;
+    const int BAND_ROWS = 16;
+
+    // A frame of counts shared by several chains, added to through a Depositor.
+    template<typename Count>
+    struct SharedHistogram {
+        std::vector<Count> counts;
+        size_t band_pixels = 0;
+        int n_bands = 0;
+        std::unique_ptr<std::mutex[]> band_mutexes;
+
+        void allocate(int width, int height) {
+            counts.assign(static_cast<size_t>(width) * height, Count(0));
+            band_pixels = static_cast<size_t>(width) * BAND_ROWS;
+            n_bands = (height + BAND_ROWS - 1) / BAND_ROWS;
+            band_mutexes.reset(new std::mutex[n_bands]);
+        }
+    };
+
+    // One chain's buffered deposits into a SharedHistogram. A full buffer is sorted by band (counting sort)
+    // and added band by band, starting at a band of the chain's own so chains flushing together spread out.
+    template<typename Count>
+    class Depositor {
+
+    private:
+        SharedHistogram<Count> &histogram;
+        int first_band;
+        std::vector<std::pair<uint32_t, Count>> pending, sorted;
+        std::vector<size_t> band_begin;
+
+    public:
+        Depositor(SharedHistogram<Count> &histogram, int first_band)
+                : histogram(histogram), first_band(first_band % histogram.n_bands) {
+            pending.reserve(DEPOSIT_BATCH);
+        }
+
+        ~Depositor() { flush(); }
+
+        Depositor(const Depositor &) = delete;
+        Depositor &operator=(const Depositor &) = delete;
+
+        void add(uint32_t pixel, Count weight) {
+            pending.emplace_back(pixel, weight);
+            if (pending.size() == DEPOSIT_BATCH) {
+                flush();
+            }
+        }
+
+        void flush() {
+            if (pending.empty()) {
+                return;
+            }
+            int n_bands = histogram.n_bands;
+            band_begin.assign(n_bands + 1, 0);
+            for (const auto &deposit: pending) {
+                band_begin[deposit.first / histogram.band_pixels + 1]++;
+            }
+            for (int band = 0; band < n_bands; band++) {
+                band_begin[band + 1] += band_begin[band];
+            }
+            sorted.resize(pending.size());
+            std::vector<size_t> next(band_begin.begin(), band_begin.end() - 1);
+            for (const auto &deposit: pending) {
+                sorted[next[deposit.first / histogram.band_pixels]++] = deposit;
+            }
+            for (int offset = 0; offset < n_bands; offset++) {
+                int band = (first_band + offset) % n_bands;
+                if (band_begin[band] == band_begin[band + 1]) {
+                    continue;
+                }
+                std::lock_guard<std::mutex> lock(histogram.band_mutexes[band]);
+                for (size_t idx = band_begin[band]; idx < band_begin[band + 1]; idx++) {
+                    histogram.counts[sorted[idx].first] += sorted[idx].second;
+                }
+            }
+            pending.clear();
+        }
+    };
+
+    // Iterates c and collects the pixel index of every z that lands in the view. Returns false, with `hits`
+    // unspecified, unless the orbit escapes at an iteration in [min_iterations, max_iterations).
+    inline bool trace_orbit(double cr, double ci, const Params &params, std::vector<uint32_t> &hits) {
+        hits.clear();
+        const mandelbrot::ViewParams &vp = params.vp;
+        double x_scale = (params.width - 1.0) / (vp.real_max - vp.real_min);
+        double y_scale = (params.height - 1.0) / (vp.imag_max - vp.imag_min);
+        double threshold_sq = params.threshold * params.threshold;
+
+        double zr = 0.0, zi = 0.0;
+        for (int idx_iter = 0; idx_iter < params.max_iterations; idx_iter++) {
+            double zr_new = zr * zr - zi * zi + cr;
+            zi = 2.0 * zr * zi + ci;
+            zr = zr_new;
+            if (zr * zr + zi * zi > threshold_sq) {
+                return idx_iter >= params.min_iterations;
+            }
+            // nearest pixel, as gen_complex_set() places them
+            double x = (zr - vp.real_min) * x_scale + 0.5, y = (zi - vp.imag_min) * y_scale + 0.5;
+            if (x >= 0.0 && x < params.width && y >= 0.0 && y < params.height) {
+                hits.push_back(static_cast<uint32_t>(static_cast<int>(y) * params.width + static_cast<int>(x)));
+            }
+        }
+        return false;
+    }
+
+    inline void sample_uniform(std::mt19937_64 &rng, double &cr, double &ci) {
+        std::uniform_real_distribution<double> uniform(-SAMPLE_RADIUS, SAMPLE_RADIUS);
+        do {
+            cr = uniform(rng);
+            ci = uniform(rng);
+        } while (cr * cr + ci * ci > SAMPLE_RADIUS * SAMPLE_RADIUS);
+    }
+
+    // points of the orbit of c in the view, 0 if it does not count (bulb, no escape, escape out of range)
+    inline size_t contribution(double cr, double ci, const Params &params, std::vector<uint32_t> &hits, Stats &stats) {
+        stats.n_samples++;
+        if (mandelbrot::in_cardioid_or_bulb(cr, ci)) {
+            stats.n_bulb_rejected++;
+            return 0;
+        }
+        if (!trace_orbit(cr, ci, params, hits) || hits.empty()) {
+            return 0;
+        }
+        stats.n_contributing++;
+        return hits.size();
+    }
+
+    inline void run_uniform(const Params &params, uint64_t n_samples, std::mt19937_64 &rng,
+                            Depositor<uint32_t> &histogram, Stats &stats) {
+        std::vector<uint32_t> hits;
+        for (uint64_t idx = 0; idx < n_samples; idx++) {
+            double cr, ci;
+            sample_uniform(rng, cr, ci);
+            if (contribution(cr, ci, params, hits, stats) > 0) {
+                for (uint32_t pixel: hits) {
+                    histogram.add(pixel, 1);
+                }
+            }
+        }
+    }
+
+    // Metropolis-Hastings chain whose stationary density is proportional to the contribution of c. Small
+    // steps are exponentially distributed between 1e-4 and ~5e-3 of the view width, so the chain explores
+    // the neighbourhood of a good c at the scale of the view.
+    inline void run_metropolis(const Params &params, uint64_t n_samples, std::mt19937_64 &rng,
+                               Depositor<double> &histogram, Stats &stats) {
+        std::uniform_real_distribution<double> unit(0.0, 1.0);
+        std::vector<uint32_t> hits, proposal_hits;
+
+        double cr = 0.0, ci = 0.0;
+        size_t score = 0;
+        for (int attempt = 0; attempt < MAX_START_ATTEMPTS && score == 0; attempt++) {
+            sample_uniform(rng, cr, ci);
+            score = contribution(cr, ci, params, hits, stats);
+        }
+        if (score == 0) {
+            spdlog::warn("No orbit reaches the view after {} samples, chain dropped", MAX_START_ATTEMPTS);
+            return;
+        }
+
+        double step_scale = params.vp.real_max - params.vp.real_min;
+        for (uint64_t idx = 0; idx < n_samples; idx++) {
+            double proposal_r, proposal_i;
+            if (unit(rng) < UNIFORM_PROPOSAL_RATE) {
+                sample_uniform(rng, proposal_r, proposal_i);
+            } else {
+                double radius = step_scale * 1e-4 * std::exp(4.0 * unit(rng));
+                double angle = 2.0 * M_PI * unit(rng);
+                proposal_r = cr + radius * std::cos(angle);
+                proposal_i = ci + radius * std::sin(angle);
+            }
+            stats.n_proposals++;
+            size_t proposal_score = contribution(proposal_r, proposal_i, params, proposal_hits, stats);
+            // both proposal kinds are symmetric, so the acceptance ratio is the ratio of the targets
+            if (proposal_score > 0 && unit(rng) * score < proposal_score) {
+                cr = proposal_r;
+                ci = proposal_i;
+                score = proposal_score;
+                hits.swap(proposal_hits);
+                stats.n_accepted++;
+            }
+            double weight = 1.0 / static_cast<double>(score);
+            for (uint32_t pixel: hits) {
+                histogram.add(pixel, weight);
+            }
+        }
+    }
+
+    // one chain per pool worker, run into the histogram of the node the chain's share of parallel_for() is on
+    template<typename Count>
+    std::vector<double> run_chains(thread_pool::ThreadPool &pool, const Params &params, std::vector<Stats> &chain_stats) {
+        int n_chains = pool.size();
+        int n_nodes = pool.numa_nodes();
+        std::vector<SharedHistogram<Count>> histograms(n_nodes);
+        std::unique_ptr<std::once_flag[]> allocated(new std::once_flag[n_nodes]);
+        std::vector<int> chain_node(n_chains, 0);
+        for (int node = 0; node < n_nodes; node++) {
+            std::pair<int, int> items = pool.node_items(node, n_chains);
+            std::fill(chain_node.begin() + items.first, chain_node.begin() + items.second, node);
+        }
+        chain_stats.assign(n_chains, Stats{});
+
+        pool.parallel_for(n_chains, [&](int idx_chain) {
+            int node = chain_node[idx_chain];
+            std::call_once(allocated[node], [&] { histograms[node].allocate(params.width, params.height); });
+            Depositor<Count> depositor(histograms[node], idx_chain * 7);
+            std::mt19937_64 rng(params.seed * 0x9E3779B97F4A7C15ull + static_cast<uint64_t>(idx_chain));
+            uint64_t n_samples = params.n_samples / n_chains + (static_cast<uint64_t>(idx_chain) < params.n_samples % n_chains);
+            if constexpr (std::is_same<Count, double>::value) {
+                run_metropolis(params, n_samples, rng, depositor, chain_stats[idx_chain]);
+            } else {
+                run_uniform(params, n_samples, rng, depositor, chain_stats[idx_chain]);
+            }
+        });
+
+        size_t n_pixels = static_cast<size_t>(params.width) * params.height;
+        std::vector<double> density(n_pixels, 0.0);
+        pool.parallel_for(params.height, [&](int row) {
+            size_t begin = static_cast<size_t>(row) * params.width, end = begin + params.width;
+            for (const SharedHistogram<Count> &histogram: histograms) {
+                if (histogram.counts.empty()) {
+                    continue;   // no chain ran on this node
+                }
+                for (size_t idx = begin; idx < end; idx++) {
+                    density[idx] += static_cast<double>(histogram.counts[idx]);
+                }
+            }
+        });
+        return density;
+    }
+
+    // Orbit density of the view, row-major from imag_min like render_greyscale(), in arbitrary units:
+    // hits per sample for uniform sampling, the same up to a constant factor for Metropolis-Hastings.
+    inline std::vector<double> render(thread_pool::ThreadPool &pool, const Params &params, Stats *stats = nullptr) {
+        std::vector<Stats> chain_stats;
+        std::vector<double> density = params.metropolis ? run_chains<double>(pool, params, chain_stats)
+                                                        : run_chains<uint32_t>(pool, params, chain_stats);
+        if (stats != nullptr) {
+            *stats = Stats{};
+            for (const Stats &chain: chain_stats) {
+                stats->n_samples += chain.n_samples;
+                stats->n_bulb_rejected += chain.n_bulb_rejected;
+                stats->n_contributing += chain.n_contributing;
+                stats->n_proposals += chain.n_proposals;
+                stats->n_accepted += chain.n_accepted;
+            }
+        }
+        return density;
+    }
+
+    // Density to [0, 1] for a colormap: scaled by a high percentile of the non-empty pixels, so a few hot
+    // pixels do not darken the image, clamped and raised to `gamma` to lift the faint orbits.
+    inline std::vector<float> tone_map(const std::vector<double> &density, double gamma, double percentile = 0.999) {
+        std::vector<double> non_empty;
+        std::copy_if(density.begin(), density.end(), std::back_inserter(non_empty), [](double v) { return v > 0.0; });
+        std::vector<float> values(density.size(), 0.0f);
+        if (non_empty.empty()) {
+            return values;
+        }
+        auto nth = non_empty.begin() + static_cast<long>(percentile * (non_empty.size() - 1));
+        std::nth_element(non_empty.begin(), nth, non_empty.end());
+        double white = *nth;
+        for (size_t idx = 0; idx < density.size(); idx++) {
+            values[idx] = static_cast<float>(std::pow(std::min(density[idx] / white, 1.0), gamma));
+        }
+        return values;
+    }
+}
+
+#endif
@@ -0,0 +1,552 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "spdlog/spdlog.h"
+
+#include "formulas.hpp"
+#include "mandelbrot.hpp"
+#include "output_sink.hpp"
+#include "thread_pool.hpp"
+
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+// Checkpoints of a tiled render, so a render killed after hours resumes where it stopped.
+//
+// Two files (native endianness), both starting with a Header that pins down the render:
+//   - the journal `path`: append-only records of finished tiles, each a RecordHeader and the tile's rows in
+//     the output's pixel format. A record cut short by a crash fails its CRC and is dropped on resume.
+//   - the state file `path.state`, optional: the orbits (z and iteration count) of the tiles in flight, for
+//     renders whose single tiles run for long. Rewritten whole at every checkpoint, through a rename.
+//
+// Workers never wait on the disk: a finished tile is one atomic store, an orbit snapshot is offered with
+// try_lock() and skipped if the writer holds the lock. A writer thread of the Journal wakes every interval,
+// appends the tiles finished since the last time, syncs, and rewrites the state file.
+namespace checkpoint {
+
+    const char MAGIC[8] = {'M', 'B', 'C', 'K', 'P', 'T', 0, 0};
+    const uint32_t FORMAT_VERSION = 2;
+
+    // iterations between two orbit snapshots of a tile in flight
+    const int STATE_SLICE = 4096;
+
+    // everything the pixels depend on; a checkpoint is only resumed by the same render
+    struct Key {
+        double real_min, real_max, imag_min, imag_max;
+        double threshold;
+        double julia_re, julia_im;
+        int32_t width, height, tile_size, n_iterations;
+        int32_t power, format, distance, fill, bgr;
+        char formula[16];
+        char colormap[16];  // of RGB8 renders, empty otherwise
+    };
+    static_assert(sizeof(Key) == 128, "checkpoint key layout must not depend on the compiler");
+
+    inline Key make_key(const formulas::FormulaSpec &formula, const mandelbrot::ViewParams &vp, double threshold,
+                        int n_iterations, const output_sink::Sink &out, const std::string &colormap, int tile_size,
+                        bool distance, bool fill) {
+        Key key;
+        std::memset(&key, 0, sizeof(Key));
+        key.real_min = vp.real_min;
+        key.real_max = vp.real_max;
+        key.imag_min = vp.imag_min;
+        key.imag_max = vp.imag_max;
+        key.threshold = threshold;
+        key.julia_re = formula.julia_c.real();
+        key.julia_im = formula.julia_c.imag();
+        key.width = out.width;
+        key.height = out.height;
+        key.tile_size = tile_size;
+        key.n_iterations = n_iterations;
+        key.power = formula.power;
+        key.format = static_cast<int32_t>(out.format);
+        key.distance = distance;
+        key.fill = fill;
+        std::strncpy(key.formula, formula.name.c_str(), sizeof(key.formula) - 1);
+        if (out.format == output_sink::PixelFormat::RGB8) {
+            key.bgr = out.bgr;
+            std::strncpy(key.colormap, colormap.c_str(), sizeof(key.colormap) - 1);
+        }
+        return key;
+    }
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t n_tiles;
+        Key key;
+    };
+    static_assert(sizeof(Header) == 144, "checkpoint header layout must not depend on the compiler");
+
+    struct RecordHeader {
+        uint32_t tile;
+        uint32_t n_bytes;
+        uint32_t crc;       // of the payload
+        uint32_t iterations_done;   // state records only
+    };
+
+    // the orbits of one tile in flight, pixels row-major over the tile
+    struct TileState {
+        int iterations_done = 0;            // every pixel still iterating has been iterated this far
+        std::vector<double> zr, zi;
+        std::vector<int32_t> escaped_at;    // escape iteration, -1 while still iterating
+    };
+
+    namespace detail {
+
+        inline bool write_all(int fd, const void *data, size_t n_bytes) {
+            const auto *bytes = static_cast<const unsigned char *>(data);
+            while (n_bytes > 0) {
+                ssize_t n_written = ::write(fd, bytes, n_bytes);
+                if (n_written <= 0) {
+                    return false;
+                }
+                bytes += n_written;
+                n_bytes -= static_cast<size_t>(n_written);
+            }
+            return true;
+        }
+
+        inline bool read_all(int fd, void *data, size_t n_bytes) {
+            auto *bytes = static_cast<unsigned char *>(data);
+            while (n_bytes > 0) {
+                ssize_t n_read = ::read(fd, bytes, n_bytes);
+                if (n_read <= 0) {
+                    return false;
+                }
+                bytes += n_read;
+                n_bytes -= static_cast<size_t>(n_read);
+            }
+            return true;
+        }
+
+        inline uint32_t crc(const void *data, size_t n_bytes) {
+            return static_cast<uint32_t>(crc32(0, static_cast<const Bytef *>(data), static_cast<uInt>(n_bytes)));
+        }
+
+        inline size_t tile_row_bytes(const mandelbrot::Tile &tile, const output_sink::Sink &out) {
+            return static_cast<size_t>(tile.x1 - tile.x0) * output_sink::bytes_per_pixel(out.format);
+        }
+    }
+
+    class Journal {
+
+    private:
+        // per tile: not finished, finished but not journaled yet, journaled
+        enum : uint8_t { PENDING = 0, FINISHED = 1, JOURNALED = 2 };
+
+        std::string path;
+        Header header{};
+        std::vector<mandelbrot::Tile> tiles;
+        output_sink::Sink out;
+        int fd = -1;
+        std::unique_ptr<std::atomic<uint8_t>[]> tile_status;
+        int restored = 0;
+
+        std::mutex states_mutex;
+        std::map<int, TileState> states;
+
+        std::thread writer;
+        std::mutex writer_mutex;
+        std::condition_variable writer_cv;
+        bool stopping = false;
+        bool failed = false;
+
+        std::string state_path() const { return path + ".state"; }
+
+        bool write_header(int to_fd) const { return detail::write_all(to_fd, &header, sizeof(Header)); }
+
+        // header of `from_fd` matches this render
+        bool read_header(int from_fd) const {
+            Header stored{};
+            return detail::read_all(from_fd, &stored, sizeof(Header)) &&
+                   std::memcmp(&stored, &header, sizeof(Header)) == 0;
+        }
+
+        // replays the journal into `out`; returns the length of its valid prefix
+        off_t replay() {
+            off_t valid = sizeof(Header);
+            std::vector<unsigned char> payload;
+            RecordHeader record{};
+            while (detail::read_all(fd, &record, sizeof(RecordHeader))) {
+                if (record.tile >= tiles.size()) {
+                    break;
+                }
+                const mandelbrot::Tile &tile = tiles[record.tile];
+                size_t row_bytes = detail::tile_row_bytes(tile, out);
+                if (record.n_bytes != row_bytes * (tile.y1 - tile.y0)) {
+                    break;
+                }
+                payload.resize(record.n_bytes);
+                if (!detail::read_all(fd, payload.data(), payload.size()) ||
+                    detail::crc(payload.data(), payload.size()) != record.crc) {
+                    break;
+                }
+                for (int y = tile.y0; y < tile.y1; y++) {
+                    std::memcpy(out.row(y) + static_cast<size_t>(tile.x0) * output_sink::bytes_per_pixel(out.format),
+                                payload.data() + (y - tile.y0) * row_bytes, row_bytes);
+                }
+                if (tile_status[record.tile].exchange(JOURNALED) != JOURNALED) {
+                    restored++;
+                }
+                valid += static_cast<off_t>(sizeof(RecordHeader) + record.n_bytes);
+            }
+            return valid;
+        }
+
+        // orbit states of the tiles that were in flight; a damaged state file only loses those orbits
+        void load_states() {
+            int state_fd = ::open(state_path().c_str(), O_RDONLY);
+            if (state_fd < 0) {
+                return;
+            }
+            if (!read_header(state_fd)) {
+                spdlog::warn("Ignore {}: it belongs to another render", state_path());
+                ::close(state_fd);
+                return;
+            }
+            RecordHeader record{};
+            while (detail::read_all(state_fd, &record, sizeof(RecordHeader))) {
+                if (record.tile >= tiles.size() || record.n_bytes % 20 != 0) {
+                    break;
+                }
+                size_t n_pixels = record.n_bytes / 20;
+                std::vector<unsigned char> payload(record.n_bytes);
+                if (!detail::read_all(state_fd, payload.data(), payload.size()) ||
+                    detail::crc(payload.data(), payload.size()) != record.crc) {
+                    spdlog::warn("{} is damaged, the orbits after tile {} are lost", state_path(), record.tile);
+                    break;
+                }
+                TileState state;
+                state.iterations_done = static_cast<int>(record.iterations_done);
+                state.zr.resize(n_pixels);
+                state.zi.resize(n_pixels);
+                state.escaped_at.resize(n_pixels);
+                std::memcpy(state.zr.data(), payload.data(), 8 * n_pixels);
+                std::memcpy(state.zi.data(), payload.data() + 8 * n_pixels, 8 * n_pixels);
+                std::memcpy(state.escaped_at.data(), payload.data() + 16 * n_pixels, 4 * n_pixels);
+                if (tile_status[record.tile] == PENDING) {
+                    states[static_cast<int>(record.tile)] = std::move(state);
+                }
+            }
+            ::close(state_fd);
+        }
+
+        // appends the tiles finished since the last call and rewrites the state file
+        void flush() {
+            std::vector<unsigned char> payload;
+            bool appended = false;
+            for (size_t idx_tile = 0; idx_tile < tiles.size(); idx_tile++) {
+                if (tile_status[idx_tile].load(std::memory_order_acquire) != FINISHED) {
+                    continue;
+                }
+                const mandelbrot::Tile &tile = tiles[idx_tile];
+                size_t row_bytes = detail::tile_row_bytes(tile, out);
+                payload.resize(row_bytes * (tile.y1 - tile.y0));
+                for (int y = tile.y0; y < tile.y1; y++) {
+                    std::memcpy(payload.data() + (y - tile.y0) * row_bytes,
+                                out.row(y) + static_cast<size_t>(tile.x0) * output_sink::bytes_per_pixel(out.format),
+                                row_bytes);
+                }
+                RecordHeader record{static_cast<uint32_t>(idx_tile), static_cast<uint32_t>(payload.size()),
+                                    detail::crc(payload.data(), payload.size()), 0};
+                if (!detail::write_all(fd, &record, sizeof(RecordHeader)) ||
+                    !detail::write_all(fd, payload.data(), payload.size())) {
+                    report_failure("Could not append to checkpoint " + path);
+                    return;
+                }
+                tile_status[idx_tile] = JOURNALED;
+                appended = true;
+            }
+            if (appended && fdatasync(fd) != 0) {
+                report_failure("Could not sync checkpoint " + path);
+            }
+            write_states();
+        }
+
+        void write_states() {
+            std::vector<std::pair<int, TileState>> in_flight;
+            {
+                std::lock_guard<std::mutex> lock(states_mutex);
+                for (auto it = states.begin(); it != states.end();) {
+                    if (tile_status[it->first] != PENDING) {
+                        it = states.erase(it);
+                    } else {
+                        in_flight.emplace_back(it->first, it->second);
+                        ++it;
+                    }
+                }
+            }
+            if (in_flight.empty()) {
+                ::unlink(state_path().c_str());
+                return;
+            }
+            std::string tmp_path = state_path() + ".tmp";
+            int state_fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            bool ok = state_fd >= 0 && write_header(state_fd);
+            std::vector<unsigned char> payload;
+            for (const auto &[idx_tile, state]: in_flight) {
+                if (!ok) {
+                    break;
+                }
+                size_t n_pixels = state.zr.size();
+                payload.resize(20 * n_pixels);
+                std::memcpy(payload.data(), state.zr.data(), 8 * n_pixels);
+                std::memcpy(payload.data() + 8 * n_pixels, state.zi.data(), 8 * n_pixels);
+                std::memcpy(payload.data() + 16 * n_pixels, state.escaped_at.data(), 4 * n_pixels);
+                RecordHeader record{static_cast<uint32_t>(idx_tile), static_cast<uint32_t>(payload.size()),
+                                    detail::crc(payload.data(), payload.size()),
+                                    static_cast<uint32_t>(state.iterations_done)};
+                ok = detail::write_all(state_fd, &record, sizeof(RecordHeader)) &&
+                     detail::write_all(state_fd, payload.data(), payload.size());
+            }
+            ok = ok && fdatasync(state_fd) == 0;
+            if (state_fd >= 0) {
+                ::close(state_fd);
+            }
+            if (!ok || std::rename(tmp_path.c_str(), state_path().c_str()) != 0) {
+                report_failure("Could not write checkpoint state " + state_path());
+            }
+        }
+
+        // the render goes on without checkpoints; logged once
+        void report_failure(const std::string &message) {
+            if (!failed) {
+                spdlog::error("{}, checkpoints are not up to date", message);
+            }
+            failed = true;
+        }
+
+        void writer_loop(std::chrono::milliseconds interval) {
+            std::unique_lock<std::mutex> lock(writer_mutex);
+            while (!stopping) {
+                writer_cv.wait_for(lock, interval, [this] { return stopping; });
+                lock.unlock();
+                flush();
+                lock.lock();
+            }
+        }
+
+    public:
+        Journal() = default;
+
+        ~Journal() {
+            finish();
+            if (fd >= 0) {
+                ::close(fd);
+            }
+        }
+
+        Journal(const Journal &) = delete;
+        Journal &operator=(const Journal &) = delete;
+
+        // Opens the checkpoint at `path` for the render described by `key`, drawing `tiles` into `out`.
+        // With `resume`, the tiles of a matching checkpoint are restored into `out` (see done()) along with
+        // the saved orbits; a checkpoint of another render is an error rather than overwritten. Otherwise,
+        // or if there is no checkpoint yet, a new one is started.
+        bool open(const std::string &checkpoint_path, const Key &key, const std::vector<mandelbrot::Tile> &render_tiles,
+                  const output_sink::Sink &render_out, bool resume) {
+            path = checkpoint_path;
+            tiles = render_tiles;
+            out = render_out;
+            std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+            header.version = FORMAT_VERSION;
+            header.n_tiles = static_cast<uint32_t>(tiles.size());
+            header.key = key;
+            tile_status.reset(new std::atomic<uint8_t>[tiles.size()]);
+            for (size_t idx_tile = 0; idx_tile < tiles.size(); idx_tile++) {
+                tile_status[idx_tile] = PENDING;
+            }
+
+            if (resume) {
+                fd = ::open(path.c_str(), O_RDWR);
+                if (fd >= 0) {
+                    if (!read_header(fd)) {
+                        spdlog::error("Checkpoint {} is of another render (view, size, formula, format or colormap differ)", path);
+                        return false;
+                    }
+                    off_t valid = replay();
+                    // drop a record cut short by the crash, so the next ones follow a valid prefix
+                    if (ftruncate(fd, valid) != 0 || lseek(fd, valid, SEEK_SET) != valid) {
+                        spdlog::error("Could not truncate checkpoint {}", path);
+                        return false;
+                    }
+                    load_states();
+                    spdlog::info("Resumed {}: {} of {} tiles done, {} tiles with saved orbits", path, restored,
+                                 tiles.size(), states.size());
+                    return true;
+                }
+                spdlog::info("No checkpoint at {}, starting afresh", path);
+            }
+            fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0 || !write_header(fd)) {
+                spdlog::error("Could not create checkpoint {}", path);
+                return false;
+            }
+            ::unlink(state_path().c_str());
+            return true;
+        }
+
+        // starts writing checkpoints every `interval`
+        void start(std::chrono::milliseconds interval) {
+            writer = std::thread([this, interval] { writer_loop(interval); });
+        }
+
+        // writes the last checkpoint and stops the writer
+        void finish() {
+            if (!writer.joinable()) {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(writer_mutex);
+                stopping = true;
+            }
+            writer_cv.notify_all();
+            writer.join();
+        }
+
+        // deletes the checkpoint files, once the finished image is safely written
+        void remove() {
+            finish();
+            ::unlink(path.c_str());
+            ::unlink(state_path().c_str());
+        }
+
+        int n_restored() const { return restored; }
+
+        bool done(int idx_tile) const { return tile_status[idx_tile].load(std::memory_order_acquire) != PENDING; }
+
+        // called by the worker once every pixel of the tile is in `out`
+        void tile_done(int idx_tile) { tile_status[idx_tile].store(FINISHED, std::memory_order_release); }
+
+        // a snapshot of the orbits of a tile in flight; dropped if the writer is busy with the last one
+        void offer_state(int idx_tile, const TileState &state) {
+            std::unique_lock<std::mutex> lock(states_mutex, std::try_to_lock);
+            if (lock.owns_lock()) {
+                states[idx_tile] = state;
+            }
+        }
+
+        // the saved orbits of a tile about to start, false if there are none
+        bool take_state(int idx_tile, TileState &state) {
+            std::lock_guard<std::mutex> lock(states_mutex);
+            auto it = states.find(idx_tile);
+            if (it == states.end()) {
+                return false;
+            }
+            state = it->second;
+            return true;
+        }
+    };
+
+    // Escape-time tile like mandelbrot::mandelbrot_sequence_tile(), iterated in slices of STATE_SLICE
+    // iterations over all its pixels, so that the orbits can be offered to the journal between slices and a
+    // resumed render picks up a long tile part way. Pixels get exactly the same iteration counts.
+    template<typename Formula>
+    void escape_tile_resumable(const Formula &formula, const mandelbrot::Tile &tile, const mandelbrot::ViewParams &vp,
+                               double threshold, int n_iterations, const output_sink::Sink &out, Journal &journal,
+                               int idx_tile) {
+        int size_x = out.width, size_y = out.height;
+        if (mandelbrot::certify_tile(formula, tile, size_x, size_y, vp, threshold, n_iterations) != interval::UNCERTIFIED) {
+            mandelbrot::mandelbrot_sequence_tile(formula, tile, size_x, size_y, vp, threshold, n_iterations, out);
+            return;
+        }
+        int tile_w = tile.x1 - tile.x0;
+        size_t n_pixels = static_cast<size_t>(tile_w) * (tile.y1 - tile.y0);
+        std::vector<double> cr(n_pixels), ci(n_pixels);
+        TileState state;
+        bool resumed = journal.take_state(idx_tile, state) && state.zr.size() == n_pixels;
+        if (!resumed) {
+            state = TileState{};
+            state.zr.resize(n_pixels);
+            state.zi.resize(n_pixels);
+            state.escaped_at.assign(n_pixels, -1);
+        }
+        for (int i_row = tile.y0; i_row < tile.y1; i_row++) {
+            double imag_value = mandelbrot::interpolate(vp.imag_min, vp.imag_max, i_row / (size_y - 1.0));
+            for (int i_col = tile.x0; i_col < tile.x1; i_col++) {
+                double real_value = mandelbrot::interpolate(vp.real_min, vp.real_max, i_col / (size_x - 1.0));
+                size_t idx = static_cast<size_t>(i_row - tile.y0) * tile_w + (i_col - tile.x0);
+                double zr, zi;
+                formula.start(real_value, imag_value, zr, zi, cr[idx], ci[idx]);
+                if (!resumed) {
+                    state.zr[idx] = zr;
+                    state.zi[idx] = zi;
+                }
+            }
+        }
+
+        double threshold_sq = threshold * threshold;
+        while (state.iterations_done < n_iterations) {
+            int slice_end = std::min(n_iterations, state.iterations_done + STATE_SLICE);
+            bool any_active = false;
+            for (size_t idx = 0; idx < n_pixels; idx++) {
+                if (state.escaped_at[idx] >= 0) {
+                    continue;
+                }
+                double zr = state.zr[idx], zi = state.zi[idx];
+                int idx_iter = state.iterations_done;
+                for (; idx_iter < slice_end; idx_iter++) {
+                    formula.step(zr, zi, cr[idx], ci[idx]);
+                    if (zr * zr + zi * zi > threshold_sq) {
+                        break;
+                    }
+                }
+                state.zr[idx] = zr;
+                state.zi[idx] = zi;
+                if (idx_iter < slice_end) {
+                    state.escaped_at[idx] = idx_iter;
+                } else {
+                    any_active = true;
+                }
+            }
+            state.iterations_done = slice_end;
+            if (!any_active) {
+                break;
+            }
+            if (slice_end < n_iterations) {
+                journal.offer_state(idx_tile, state);
+            }
+        }
+
+        std::vector<double> shades(static_cast<size_t>(tile_w));
+        for (int i_row = tile.y0; i_row < tile.y1; i_row++) {
+            for (int i_col = tile.x0; i_col < tile.x1; i_col++) {
+                int escaped_at = state.escaped_at[static_cast<size_t>(i_row - tile.y0) * tile_w + (i_col - tile.x0)];
+                shades[i_col - tile.x0] = mandelbrot::iteration_to_shade(escaped_at >= 0 ? escaped_at : n_iterations,
+                                                                         n_iterations);
+            }
+            out.write_row(i_row, tile.x0, tile.x1, shades.data());
+        }
+    }
+
+    // parallel_for over the tiles the journal does not hold yet; tile_fn(idx_tile) draws one into the output
+    template<typename TileFn>
+    void render_tiles(thread_pool::ThreadPool &pool, int n_tiles, Journal &journal, TileFn &&tile_fn) {
+        pool.parallel_for(n_tiles, [&](int idx_tile) {
+            if (journal.done(idx_tile)) {
+                return;
+            }
+            tile_fn(idx_tile);
+            journal.tile_done(idx_tile);
+        });
+    }
+}
+
+#endif
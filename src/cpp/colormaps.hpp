@@ -4,6 +4,10 @@
 
 #ifndef MATH_CPP_COLORMAPS_HPP
 #define MATH_CPP_COLORMAPS_HPP
+
+#include <algorithm>
+#include <string>
+
 namespace colormaps {
     const float cmap_gist_ncar_256[] = {
             0.0, 0.0, 0.502,
@@ -580,5 +584,38 @@ namespace colormaps {
             0.9882352941176471, 0.9921568627450981, 0.9882352941176471, 0.9941176470588236,
             0.996078431372549, 1.0, 1.0, 1.0
     };
+
+    // a colormap table: n_colors RGB triples in [0, 1]
+    struct Colormap {
+        const float *rgb;
+        int n_colors;
+    };
+
+    template<size_t N>
+    constexpr Colormap make_colormap(const float (&table)[N]) { return {table, static_cast<int>(N / 3)}; }
+
+    // the tables above by name ("gist_ncar", "prism", "flag", "ocean"); false for an unknown name
+    inline bool find(const std::string &name, Colormap &colormap) {
+        if (name == "gist_ncar") {
+            colormap = make_colormap(cmap_gist_ncar_256);
+        } else if (name == "prism") {
+            colormap = make_colormap(cmap_prism_256);
+        } else if (name == "flag") {
+            colormap = make_colormap(cmap_flag_256);
+        } else if (name == "ocean") {
+            colormap = make_colormap(cmap_ocean_256);
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    // 8-bit RGB of `value` in [0, 1], nearest table entry
+    inline void lookup(const Colormap &colormap, float value, unsigned char rgb[3]) {
+        int idx = static_cast<int>(std::clamp(value, 0.0f, 1.0f) * static_cast<float>(colormap.n_colors - 1) + 0.5f);
+        for (int channel = 0; channel < 3; channel++) {
+            rgb[channel] = static_cast<unsigned char>(255.0f * colormap.rgb[3 * idx + channel] + 0.5f);
+        }
+    }
 }
 #endif //MATH_CPP_COLORMAPS_HPP
@@ -0,0 +1,383 @@
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+#ifndef FIXED_POINT_HPP
+#define FIXED_POINT_HPP
+
+// Fixed-size, stack-allocated fixed-point numbers for high-precision reference orbits (see perturbation.hpp).
+// Fixed<N_LIMBS> holds N_LIMBS 64-bit limbs in two's complement, least significant first: the top limb is the
+// signed integer part and the others are the fraction, so FRACTION_BITS = 64 * (N_LIMBS - 1). Reference orbits
+// stay within |z| <= threshold, so the integer part never overflows and every value carries the full fraction,
+// which is what a fixed zoom depth needs, without the exponent handling and allocations of a bignum.
+//
+// Products are truncated to the result's precision: columns below the last fraction limb are skipped except
+// for one guard column, so a product is within a few units of the last place. Loops run over the compile-time
+// limb count and unroll; square() computes each cross product once, about half the work of operator*().
+namespace fixed_point {
+
+    using u128 = unsigned __int128;
+
+    template<int N_LIMBS>
+    class Fixed {
+        static_assert(N_LIMBS >= 2, "need an integer limb and at least one fraction limb");
+
+    public:
+        static constexpr int FRACTION_BITS = 64 * (N_LIMBS - 1);
+
+        uint64_t limbs[N_LIMBS];
+
+        Fixed() : limbs{} {}
+
+        explicit Fixed(long double value) : limbs{} {
+            bool negative = value < 0;
+            long double magnitude = std::fabs(value);
+            long double integer = std::floor(magnitude);
+            limbs[N_LIMBS - 1] = static_cast<uint64_t>(integer);
+            long double fraction = magnitude - integer;
+            for (int idx = N_LIMBS - 2; idx >= 0 && fraction > 0; idx--) {
+                fraction = std::ldexp(fraction, 64);
+                long double limb = std::floor(fraction);
+                limbs[idx] = static_cast<uint64_t>(limb);
+                fraction -= limb;
+            }
+            if (negative) {
+                negate();
+            }
+        }
+
+        explicit Fixed(double value) : Fixed(static_cast<long double>(value)) {}
+
+        explicit Fixed(int value) : Fixed(static_cast<long double>(value)) {}
+
+        bool negative() const { return static_cast<int64_t>(limbs[N_LIMBS - 1]) < 0; }
+
+        void negate() {
+            uint64_t carry = 1;
+            for (int idx = 0; idx < N_LIMBS; idx++) {
+                u128 sum = static_cast<u128>(~limbs[idx]) + carry;
+                limbs[idx] = static_cast<uint64_t>(sum);
+                carry = static_cast<uint64_t>(sum >> 64);
+            }
+        }
+
+        Fixed abs() const {
+            Fixed magnitude = *this;
+            if (negative()) {
+                magnitude.negate();
+            }
+            return magnitude;
+        }
+
+        // magnitude * factor, for small non-negative values and factors (parsing); false once the product
+        // no longer fits the signed integer limb
+        bool mul_small(uint32_t factor) {
+            uint64_t carry = 0;
+            for (int idx = 0; idx < N_LIMBS; idx++) {
+                u128 product = static_cast<u128>(limbs[idx]) * factor + carry;
+                limbs[idx] = static_cast<uint64_t>(product);
+                carry = static_cast<uint64_t>(product >> 64);
+            }
+            return carry == 0 && !negative();
+        }
+
+        bool is_zero() const { return std::all_of(limbs, limbs + N_LIMBS, [](uint64_t limb) { return limb == 0; }); }
+
+        // magnitude / divisor, truncated, for non-negative values
+        void div_small(uint32_t divisor) {
+            uint64_t remainder = 0;
+            for (int idx = N_LIMBS - 1; idx >= 0; idx--) {
+                u128 current = (static_cast<u128>(remainder) << 64) | limbs[idx];
+                limbs[idx] = static_cast<uint64_t>(current / divisor);
+                remainder = static_cast<uint64_t>(current % divisor);
+            }
+        }
+
+        // the top 128 bits of the fraction are all a double or float can hold
+        explicit operator long double() const {
+            Fixed magnitude = abs();
+            long double value = static_cast<long double>(magnitude.limbs[N_LIMBS - 1]) +
+                                std::ldexp(static_cast<long double>(magnitude.limbs[N_LIMBS - 2]), -64);
+            if (N_LIMBS > 2) {
+                value += std::ldexp(static_cast<long double>(magnitude.limbs[std::max(N_LIMBS - 3, 0)]), -128);
+            }
+            return negative() ? -value : value;
+        }
+
+        explicit operator double() const { return static_cast<double>(static_cast<long double>(*this)); }
+
+        explicit operator float() const { return static_cast<float>(static_cast<long double>(*this)); }
+
+        // Decimal "[-]digits[.digits][e[-]digits]", exact up to the last fraction bit. Coordinates of deep
+        // views have to come in as text: a double cannot even tell neighbouring pixels apart. False for
+        // values beyond the integer limb; values below the last fraction bit parse as 0.
+        static bool from_string(const std::string &text, Fixed &out) {
+            size_t pos = 0;
+            bool negative = false;
+            if (pos < text.size() && (text[pos] == '-' || text[pos] == '+')) {
+                negative = text[pos] == '-';
+                pos++;
+            }
+            size_t integer_begin = pos;
+            while (pos < text.size() && std::isdigit(static_cast<unsigned char>(text[pos]))) {
+                pos++;
+            }
+            size_t integer_end = pos, fraction_begin = pos, fraction_end = pos;
+            if (pos < text.size() && text[pos] == '.') {
+                fraction_begin = ++pos;
+                while (pos < text.size() && std::isdigit(static_cast<unsigned char>(text[pos]))) {
+                    pos++;
+                }
+                fraction_end = pos;
+            }
+            if (integer_begin == integer_end && fraction_begin == fraction_end) {
+                return false;
+            }
+            int exponent = 0;
+            if (pos < text.size() && (text[pos] == 'e' || text[pos] == 'E')) {
+                size_t n_parsed = 0;
+                try {
+                    exponent = std::stoi(text.substr(pos + 1), &n_parsed);
+                } catch (const std::exception &) {
+                    return false;
+                }
+                pos += 1 + n_parsed;
+            }
+            if (pos != text.size()) {
+                return false;
+            }
+
+            Fixed value;
+            // fraction from its last digit up: f <- (digit + f) / 10
+            for (size_t idx = fraction_end; idx > fraction_begin; idx--) {
+                value.limbs[N_LIMBS - 1] = static_cast<uint64_t>(text[idx - 1] - '0');
+                value.div_small(10);
+            }
+            Fixed integer;
+            for (size_t idx = integer_begin; idx < integer_end; idx++) {
+                if (!integer.mul_small(10)) {
+                    return false;
+                }
+                integer.limbs[N_LIMBS - 1] += static_cast<uint64_t>(text[idx] - '0');
+                if (integer.negative()) {
+                    return false;
+                }
+            }
+            value = value + integer;
+            if (value.negative()) {
+                return false;
+            }
+            // both loops end within ~19 + FRACTION_BITS * log10(2) steps: on overflow or once the value is 0
+            for (; exponent > 0 && !value.is_zero(); exponent--) {
+                if (!value.mul_small(10)) {
+                    return false;
+                }
+            }
+            for (; exponent < 0 && !value.is_zero(); exponent++) {
+                value.div_small(10);
+            }
+            if (negative) {
+                value.negate();
+            }
+            out = value;
+            return true;
+        }
+
+        // n_digits decimal places, truncated
+        std::string to_string(int n_digits) const {
+            Fixed magnitude = abs();
+            std::string text = (negative() ? "-" : "") + std::to_string(magnitude.limbs[N_LIMBS - 1]) + ".";
+            magnitude.limbs[N_LIMBS - 1] = 0;
+            for (int idx = 0; idx < n_digits; idx++) {
+                magnitude.mul_small(10);
+                text += static_cast<char>('0' + magnitude.limbs[N_LIMBS - 1]);
+                magnitude.limbs[N_LIMBS - 1] = 0;
+            }
+            return text;
+        }
+    };
+
+    namespace detail {
+        // 192-bit column accumulator of the product-scanning (column by column) multiplication
+        struct Accumulator {
+            u128 low = 0;       // bits 0-127
+            uint64_t high = 0;  // bits 128-191
+
+            void add(u128 value) {
+                low += value;
+                high += low < value;
+            }
+
+            void add(const Accumulator &other) {
+                add(other.low);
+                high += other.high;
+            }
+
+            void twice() {
+                high = (high << 1) | static_cast<uint64_t>(low >> 127);
+                low <<= 1;
+            }
+
+            // emits the finished column and carries the rest into the next one
+            uint64_t shift() {
+                auto column = static_cast<uint64_t>(low);
+                low = (low >> 64) | (static_cast<u128>(high) << 64);
+                high = 0;
+                return column;
+            }
+        };
+
+        // Magnitudes a * b, truncated. Limb k of the result is column k + N - 1 of the full product;
+        // column N - 2 is only computed for the carry it feeds into the first kept column.
+        template<int N>
+        void mul_magnitudes(const uint64_t *a, const uint64_t *b, uint64_t *out) {
+            Accumulator acc;
+            for (int column = N - 2; column <= 2 * N - 2; column++) {
+                for (int idx = std::max(0, column - (N - 1)); idx <= std::min(column, N - 1); idx++) {
+                    acc.add(static_cast<u128>(a[idx]) * b[column - idx]);
+                }
+                uint64_t limb = acc.shift();
+                if (column >= N - 1) {
+                    out[column - (N - 1)] = limb;
+                }
+            }
+        }
+
+        // a * a with each cross product a_i a_j (i < j) computed once and doubled
+        template<int N>
+        void square_magnitude(const uint64_t *a, uint64_t *out) {
+            Accumulator acc;
+            for (int column = N - 2; column <= 2 * N - 2; column++) {
+                Accumulator cross;
+                int idx_begin = std::max(0, column - (N - 1));
+                for (int idx = idx_begin; 2 * idx < column; idx++) {
+                    cross.add(static_cast<u128>(a[idx]) * a[column - idx]);
+                }
+                cross.twice();
+                if (column % 2 == 0) {
+                    cross.add(static_cast<u128>(a[column / 2]) * a[column / 2]);
+                }
+                acc.add(cross);
+                uint64_t limb = acc.shift();
+                if (column >= N - 1) {
+                    out[column - (N - 1)] = limb;
+                }
+            }
+        }
+    }
+
+    template<int N>
+    Fixed<N> operator+(const Fixed<N> &a, const Fixed<N> &b) {
+        Fixed<N> sum;
+        uint64_t carry = 0;
+        for (int idx = 0; idx < N; idx++) {
+            u128 limb_sum = static_cast<u128>(a.limbs[idx]) + b.limbs[idx] + carry;
+            sum.limbs[idx] = static_cast<uint64_t>(limb_sum);
+            carry = static_cast<uint64_t>(limb_sum >> 64);
+        }
+        return sum;
+    }
+
+    template<int N>
+    Fixed<N> operator-(const Fixed<N> &a) {
+        Fixed<N> negated = a;
+        negated.negate();
+        return negated;
+    }
+
+    template<int N>
+    Fixed<N> operator-(const Fixed<N> &a, const Fixed<N> &b) {
+        Fixed<N> difference;
+        uint64_t borrow = 0;
+        for (int idx = 0; idx < N; idx++) {
+            u128 limb_difference = static_cast<u128>(a.limbs[idx]) - b.limbs[idx] - borrow;
+            difference.limbs[idx] = static_cast<uint64_t>(limb_difference);
+            borrow = static_cast<uint64_t>(limb_difference >> 64) & 1;
+        }
+        return difference;
+    }
+
+    template<int N>
+    Fixed<N> operator*(const Fixed<N> &a, const Fixed<N> &b) {
+        Fixed<N> a_abs = a.abs(), b_abs = b.abs(), product;
+        detail::mul_magnitudes<N>(a_abs.limbs, b_abs.limbs, product.limbs);
+        if (a.negative() != b.negative()) {
+            product.negate();
+        }
+        return product;
+    }
+
+    template<int N>
+    Fixed<N> square(const Fixed<N> &a) {
+        Fixed<N> a_abs = a.abs(), product;
+        detail::square_magnitude<N>(a_abs.limbs, product.limbs);
+        return product;
+    }
+
+    template<int N>
+    bool operator<(const Fixed<N> &a, const Fixed<N> &b) {
+        if (a.limbs[N - 1] != b.limbs[N - 1]) {
+            return static_cast<int64_t>(a.limbs[N - 1]) < static_cast<int64_t>(b.limbs[N - 1]);
+        }
+        for (int idx = N - 2; idx >= 0; idx--) {
+            if (a.limbs[idx] != b.limbs[idx]) {
+                return a.limbs[idx] < b.limbs[idx];
+            }
+        }
+        return false;
+    }
+
+    template<int N>
+    bool operator>(const Fixed<N> &a, const Fixed<N> &b) { return b < a; }
+
+    template<int N>
+    bool operator==(const Fixed<N> &a, const Fixed<N> &b) { return std::equal(a.limbs, a.limbs + N, b.limbs); }
+
+    // `from` at the precision of Fixed<N>: the integer limb and the top fraction limbs, padded with zeros when
+    // N is wider. Narrowing truncates towards minus infinity, within one unit of the last kept limb.
+    template<int N, int M>
+    void narrow(const Fixed<M> &from, Fixed<N> &to) {
+        for (int idx = 0; idx < N; idx++) {
+            int idx_from = idx + M - N;
+            to.limbs[idx] = idx_from >= 0 ? from.limbs[idx_from] : 0;
+        }
+    }
+
+    // ------------------------------------ precision choice ------------------------------------
+
+    const int MAX_LIMBS = 24;
+
+    // fraction bits a reference orbit needs for a view `view_width` wide at `width_px` pixels: the pixel
+    // spacing, plus a limb of headroom for the rounding the orbit accumulates
+    inline int fraction_bits_for_view(double view_width, int width_px) {
+        return static_cast<int>(std::ceil(std::log2(static_cast<double>(width_px) / view_width))) + 64;
+    }
+
+    template<int N, typename Visitor>
+    bool visit_limbs(int n_limbs, Visitor &&visitor) {
+        if constexpr (N > MAX_LIMBS) {
+            (void) n_limbs;
+            (void) visitor;
+            return false;
+        } else {
+            if (n_limbs <= N) {
+                visitor(Fixed<N>{});
+                return true;
+            }
+            return visit_limbs<N + 1>(n_limbs, visitor);
+        }
+    }
+
+    // Calls visitor(Fixed<N>{}) for the smallest N with at least `fraction_bits` fraction bits, like
+    // formulas::visit_formula(). Returns false beyond MAX_LIMBS.
+    template<typename Visitor>
+    bool visit_precision(int fraction_bits, Visitor &&visitor) {
+        int n_limbs = 1 + (std::max(fraction_bits, 1) + 63) / 64;
+        return visit_limbs<2>(n_limbs, visitor);
+    }
+}
+
+#endif
@@ -0,0 +1,228 @@
+#include <cmath>
+#include <complex>
+#include <string>
+
+#ifndef FORMULAS_HPP
+#define FORMULAS_HPP
+
+// Iteration formulas for the escape-time engine. Each formula is a small policy type with
+//   start(pr, pi, zr, zi, cr, ci) - initial z and the constant c for the pixel at (pr, pi)
+//   step(zr, zi, cr, ci)          - one iteration z -> f(z, c), in place
+// The engine is templated on the policy, so every formula is compiled into its own tight loop
+// and shares the tiling, scheduling and output code.
+// Holomorphic formulas (has_derivative) also track the derivative of z by the pixel, for distance estimation:
+//   derivative_start(dzr, dzi)        - initial dz
+//   derivative_step(zr, zi, dzr, dzi) - dz -> f'(z) dz (+ 1 when the pixel is c), with z from before step()
+//   degree                            - degree of f in z
+namespace formulas {
+
+    // z^2 + c, z0 = 0
+    struct Mandelbrot {
+        // orbit of conj(c) is the conjugate of the orbit of c
+        static constexpr bool conjugate_symmetric = true;
+        static constexpr bool has_derivative = true;
+        static constexpr int degree = 2;
+
+        void start(double pr, double pi, double &zr, double &zi, double &cr, double &ci) const {
+            zr = 0.0;
+            zi = 0.0;
+            cr = pr;
+            ci = pi;
+        }
+
+        void step(double &zr, double &zi, double cr, double ci) const {
+            double zr_new = zr * zr - zi * zi + cr;
+            zi = 2.0 * zr * zi + ci;
+            zr = zr_new;
+        }
+
+        // dz/dc: dz0 = 0, dz -> 2 z dz + 1
+        void derivative_start(double &dzr, double &dzi) const {
+            dzr = 0.0;
+            dzi = 0.0;
+        }
+
+        void derivative_step(double zr, double zi, double &dzr, double &dzi) const {
+            double dzr_new = 2.0 * (zr * dzr - zi * dzi) + 1.0;
+            dzi = 2.0 * (zr * dzi + zi * dzr);
+            dzr = dzr_new;
+        }
+    };
+
+    // z^2 + c with a fixed c, z0 = pixel
+    struct Julia {
+        static constexpr bool conjugate_symmetric = false;
+        static constexpr bool has_derivative = true;
+        static constexpr int degree = 2;
+        std::complex<double> c{-0.8, 0.156};
+
+        void start(double pr, double pi, double &zr, double &zi, double &cr, double &ci) const {
+            zr = pr;
+            zi = pi;
+            cr = c.real();
+            ci = c.imag();
+        }
+
+        void step(double &zr, double &zi, double cr, double ci) const {
+            double zr_new = zr * zr - zi * zi + cr;
+            zi = 2.0 * zr * zi + ci;
+            zr = zr_new;
+        }
+
+        // dz/dz0: dz0 = 1, dz -> 2 z dz
+        void derivative_start(double &dzr, double &dzi) const {
+            dzr = 1.0;
+            dzi = 0.0;
+        }
+
+        void derivative_step(double zr, double zi, double &dzr, double &dzi) const {
+            double dzr_new = 2.0 * (zr * dzr - zi * dzi);
+            dzi = 2.0 * (zr * dzi + zi * dzr);
+            dzr = dzr_new;
+        }
+    };
+
+    // z^D by square-and-multiply resolved at compile time: the recursion unrolls into plain multiplies
+    template<int D>
+    inline void complex_ipow(double zr, double zi, double &out_r, double &out_i) {
+        static_assert(D >= 1, "power must be positive");
+        if constexpr (D == 1) {
+            out_r = zr;
+            out_i = zi;
+        } else {
+            double half_r, half_i;
+            complex_ipow<D / 2>(zr, zi, half_r, half_i);
+            double sq_r = half_r * half_r - half_i * half_i;
+            double sq_i = 2.0 * half_r * half_i;
+            if constexpr (D % 2 == 0) {
+                out_r = sq_r;
+                out_i = sq_i;
+            } else {
+                out_r = sq_r * zr - sq_i * zi;
+                out_i = sq_r * zi + sq_i * zr;
+            }
+        }
+    }
+
+    // z^D + c, z0 = 0
+    template<int D>
+    struct Multibrot {
+        static constexpr bool conjugate_symmetric = true;
+        static constexpr bool has_derivative = true;
+        static constexpr int degree = D;
+
+        void start(double pr, double pi, double &zr, double &zi, double &cr, double &ci) const {
+            zr = 0.0;
+            zi = 0.0;
+            cr = pr;
+            ci = pi;
+        }
+
+        void step(double &zr, double &zi, double cr, double ci) const {
+            double pow_r, pow_i;
+            complex_ipow<D>(zr, zi, pow_r, pow_i);
+            zr = pow_r + cr;
+            zi = pow_i + ci;
+        }
+
+        // dz/dc: dz0 = 0, dz -> D z^(D-1) dz + 1
+        void derivative_start(double &dzr, double &dzi) const {
+            dzr = 0.0;
+            dzi = 0.0;
+        }
+
+        void derivative_step(double zr, double zi, double &dzr, double &dzi) const {
+            double pow_r, pow_i;
+            complex_ipow<D - 1>(zr, zi, pow_r, pow_i);
+            double dzr_new = D * (pow_r * dzr - pow_i * dzi) + 1.0;
+            dzi = D * (pow_r * dzi + pow_i * dzr);
+            dzr = dzr_new;
+        }
+    };
+
+    // (|Re z| + i|Im z|)^2 + c, z0 = 0
+    struct BurningShip {
+        static constexpr bool conjugate_symmetric = false;
+        // not holomorphic: no complex derivative, so no distance estimate
+        static constexpr bool has_derivative = false;
+
+        void start(double pr, double pi, double &zr, double &zi, double &cr, double &ci) const {
+            zr = 0.0;
+            zi = 0.0;
+            cr = pr;
+            ci = pi;
+        }
+
+        void step(double &zr, double &zi, double cr, double ci) const {
+            double ar = std::fabs(zr);
+            double ai = std::fabs(zi);
+            zr = ar * ar - ai * ai + cr;
+            zi = 2.0 * ar * ai + ci;
+        }
+    };
+
+    // conj(z)^2 + c, z0 = 0
+    struct Tricorn {
+        static constexpr bool conjugate_symmetric = true;
+        static constexpr bool has_derivative = false;
+
+        void start(double pr, double pi, double &zr, double &zi, double &cr, double &ci) const {
+            zr = 0.0;
+            zi = 0.0;
+            cr = pr;
+            ci = pi;
+        }
+
+        void step(double &zr, double &zi, double cr, double ci) const {
+            double zr_new = zr * zr - zi * zi + cr;
+            zi = -2.0 * zr * zi + ci;
+            zr = zr_new;
+        }
+    };
+
+    // runtime description of a formula, as given on the command line / in a manifest
+    struct FormulaSpec {
+        std::string name = "mandelbrot";
+        int power = 2;
+        std::complex<double> julia_c{-0.8, 0.156};
+    };
+
+    const int MULTIBROT_MAX_POWER = 8;
+
+    template<int D, typename Visitor>
+    bool visit_multibrot(int power, Visitor &&visitor) {
+        if constexpr (D > MULTIBROT_MAX_POWER) {
+            (void) power;
+            (void) visitor;
+            return false;
+        } else {
+            if (power == D) {
+                visitor(Multibrot<D>{});
+                return true;
+            }
+            return visit_multibrot<D + 1>(power, visitor);
+        }
+    }
+
+    // Calls visitor(formula) with the concrete formula type named by spec, so a single generic lambda
+    // is instantiated once per formula. Returns false for an unknown name or unsupported power.
+    template<typename Visitor>
+    bool visit_formula(const FormulaSpec &spec, Visitor &&visitor) {
+        if (spec.name == "mandelbrot") {
+            visitor(Mandelbrot{});
+        } else if (spec.name == "julia") {
+            visitor(Julia{spec.julia_c});
+        } else if (spec.name == "multibrot") {
+            return visit_multibrot<2>(spec.power, visitor);
+        } else if (spec.name == "burning_ship") {
+            visitor(BurningShip{});
+        } else if (spec.name == "tricorn") {
+            visitor(Tricorn{});
+        } else {
+            return false;
+        }
+        return true;
+    }
+}
+
+#endif
@@ -0,0 +1,175 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "spdlog/spdlog.h"
+
+#ifndef FRAME_STATS_HPP
+#define FRAME_STATS_HPP
+
+namespace frame_stats {
+
+    // timings of one frame; gpu_ms stays negative until (and unless) the GPU timer result arrives
+    struct FrameRecord {
+        uint64_t frame = 0;
+        double total_ms = 0.0;
+        std::vector<double> phase_ms;
+        double gpu_ms = -1.0;
+    };
+
+    // Per-frame CPU timing split into named phases, plus GPU time reported later by a timer query.
+    // The last `capacity` frames are kept for percentiles; with open_csv() every frame is also written
+    // out once its GPU result had time to arrive.
+    //
+    //   stats.begin_frame();
+    //   ... stats.end_phase(0); ... stats.end_phase(1); ...
+    //   stats.end_frame();
+    class FrameStats {
+
+    private:
+        using clock = std::chrono::steady_clock;
+
+        // frames a CSV row waits for its GPU time; larger than the query ring of GpuTimer
+        static constexpr uint64_t CSV_LATENCY = 8;
+
+        std::vector<std::string> phase_names;
+        std::vector<FrameRecord> history;
+        uint64_t n_frames = 0;
+        FrameRecord current;
+        clock::time_point frame_start, phase_start;
+
+        std::ofstream csv;
+        uint64_t csv_next = 0;
+
+        static double ms_since(clock::time_point start) {
+            return std::chrono::duration<double, std::milli>(clock::now() - start).count();
+        }
+
+        size_t n_recorded() const { return static_cast<size_t>(std::min<uint64_t>(n_frames, history.size())); }
+
+        template<typename Value>
+        double percentile(double p, Value &&value) const {
+            std::vector<double> values;
+            values.reserve(n_recorded());
+            for (size_t i = 0; i < n_recorded(); i++) {
+                double v = value(history[i]);
+                if (v >= 0.0) {
+                    values.push_back(v);
+                }
+            }
+            if (values.empty()) {
+                return -1.0;
+            }
+            size_t rank = std::min(values.size() - 1, static_cast<size_t>(p / 100.0 * values.size()));
+            std::nth_element(values.begin(), values.begin() + static_cast<long>(rank), values.end());
+            return values[rank];
+        }
+
+        void write_csv_rows(uint64_t frame_end) {
+            // rows older than the history were overwritten and are lost; only happens if capacity < CSV_LATENCY
+            csv_next = std::max(csv_next, n_frames > history.size() ? n_frames - history.size() : 0);
+            for (; csv_next < frame_end; csv_next++) {
+                const FrameRecord &record = history[csv_next % history.size()];
+                csv << record.frame << ',' << record.total_ms;
+                for (double ms: record.phase_ms) {
+                    csv << ',' << ms;
+                }
+                csv << ',' << record.gpu_ms << '\n';
+            }
+        }
+
+    public:
+        explicit FrameStats(std::vector<std::string> phase_names, size_t capacity = 240)
+                : phase_names(std::move(phase_names)), history(std::max<size_t>(capacity, CSV_LATENCY)) {}
+
+        ~FrameStats() {
+            if (csv.is_open()) {
+                write_csv_rows(n_frames);
+            }
+        }
+
+        FrameStats(const FrameStats &) = delete;
+        FrameStats &operator=(const FrameStats &) = delete;
+
+        bool open_csv(const std::string &path) {
+            csv.open(path, std::ios::out | std::ios::trunc);
+            if (!csv.is_open()) {
+                spdlog::error("Could not open frame stats file: {}", path);
+                return false;
+            }
+            csv << "frame,total_ms";
+            for (const auto &name: phase_names) {
+                csv << ',' << name << "_ms";
+            }
+            csv << ",gpu_ms\n";
+            csv_next = n_frames;
+            return true;
+        }
+
+        const std::vector<std::string> &phases() const { return phase_names; }
+
+        // index of the frame being timed (valid between begin_frame and end_frame)
+        uint64_t frame_index() const { return n_frames; }
+
+        void begin_frame() {
+            current.frame = n_frames;
+            current.phase_ms.assign(phase_names.size(), 0.0);
+            current.gpu_ms = -1.0;
+            frame_start = phase_start = clock::now();
+        }
+
+        // adds the time since the previous end_phase (or begin_frame) to `phase`
+        void end_phase(int phase) {
+            auto now = clock::now();
+            current.phase_ms[phase] += std::chrono::duration<double, std::milli>(now - phase_start).count();
+            phase_start = now;
+        }
+
+        void end_frame() {
+            current.total_ms = ms_since(frame_start);
+            history[n_frames % history.size()] = current;
+            n_frames++;
+            if (csv.is_open() && n_frames > CSV_LATENCY) {
+                write_csv_rows(n_frames - CSV_LATENCY);
+            }
+        }
+
+        void set_gpu_ms(uint64_t frame, double ms) {
+            FrameRecord &record = history[frame % history.size()];
+            if (frame < n_frames && record.frame == frame) {
+                record.gpu_ms = ms;
+            }
+        }
+
+        // the last finished frame; only valid after the first end_frame()
+        const FrameRecord &last() const { return history[(n_frames + history.size() - 1) % history.size()]; }
+
+        // p-th percentile (0..100) over the kept frames, -1 when there is nothing to report
+        double total_percentile(double p) const {
+            return percentile(p, [](const FrameRecord &record) { return record.total_ms; });
+        }
+
+        double phase_percentile(int phase, double p) const {
+            return percentile(p, [phase](const FrameRecord &record) { return record.phase_ms[phase]; });
+        }
+
+        double gpu_percentile(double p) const {
+            return percentile(p, [](const FrameRecord &record) { return record.gpu_ms; });
+        }
+
+        // total frame times, oldest first (for plotting)
+        std::vector<float> total_history() const {
+            std::vector<float> values;
+            values.reserve(n_recorded());
+            for (uint64_t frame = n_frames - n_recorded(); frame < n_frames; frame++) {
+                values.push_back(static_cast<float>(history[frame % history.size()].total_ms));
+            }
+            return values;
+        }
+    };
+}
+
+#endif
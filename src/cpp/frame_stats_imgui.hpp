@@ -0,0 +1,56 @@
+#include <string>
+#include <vector>
+
+#include "imgui.h"
+
+#include "frame_stats.hpp"
+
+#ifndef FRAME_STATS_IMGUI_HPP
+#define FRAME_STATS_IMGUI_HPP
+
+namespace frame_stats {
+
+    // Small translucent window in the top-left corner: frame time percentiles, the CPU phase breakdown
+    // and GPU time. A GPU time close to the frame time means GPU-bound; a large CPU phase means a stall there.
+    // Call between ImGui::NewFrame() and ImGui::Render().
+    void draw_overlay(const FrameStats &stats) {
+        const float pad = 10.0f;
+        ImGui::SetNextWindowPos(ImVec2(pad, pad), ImGuiCond_Always);
+        ImGui::SetNextWindowBgAlpha(0.6f);
+        ImGuiWindowFlags flags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize |
+                                 ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing |
+                                 ImGuiWindowFlags_NoNav | ImGuiWindowFlags_NoMove;
+        if (!ImGui::Begin("Frame stats", nullptr, flags)) {
+            ImGui::End();
+            return;
+        }
+
+        double p50 = stats.total_percentile(50.0);
+        ImGui::Text("frame ms  p50 %6.2f  p95 %6.2f  p99 %6.2f  (%.0f fps)",
+                    p50, stats.total_percentile(95.0), stats.total_percentile(99.0), p50 > 0.0 ? 1000.0 / p50 : 0.0);
+        double gpu_p50 = stats.gpu_percentile(50.0);
+        if (gpu_p50 >= 0.0) {
+            ImGui::Text("gpu ms    p50 %6.2f  p95 %6.2f  p99 %6.2f",
+                        gpu_p50, stats.gpu_percentile(95.0), stats.gpu_percentile(99.0));
+        } else {
+            ImGui::Text("gpu ms    n/a");
+        }
+
+        ImGui::Separator();
+        const auto &phases = stats.phases();
+        for (int idx_phase = 0; idx_phase < static_cast<int>(phases.size()); idx_phase++) {
+            ImGui::Text("%-9s p50 %6.2f  p95 %6.2f  p99 %6.2f", phases[idx_phase].c_str(),
+                        stats.phase_percentile(idx_phase, 50.0), stats.phase_percentile(idx_phase, 95.0),
+                        stats.phase_percentile(idx_phase, 99.0));
+        }
+
+        std::vector<float> history = stats.total_history();
+        if (!history.empty()) {
+            ImGui::PlotLines("##frame_ms", history.data(), static_cast<int>(history.size()), 0, "frame ms",
+                             0.0f, static_cast<float>(2.0 * stats.total_percentile(99.0)), ImVec2(0.0f, 60.0f));
+        }
+        ImGui::End();
+    }
+}
+
+#endif
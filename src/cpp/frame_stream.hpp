@@ -0,0 +1,238 @@
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "spdlog/spdlog.h"
+
+#include "output_sink.hpp"
+#include "thread_pool.hpp"
+
+#ifndef FRAME_STREAM_HPP
+#define FRAME_STREAM_HPP
+
+// Rendered frames as one uncompressed video stream on stdout, a named pipe or a file, for an encoder to read
+// directly (ffmpeg -i - ...): no image file per frame and no PNG compress / decompress in between.
+//   - Y4M (YUV4MPEG2): a header with the size and frame rate, then each frame after a FRAME line. Greyscale
+//     frames go as mono / mono16; rgb8 frames are converted to 4:4:4 BT.601 (limited range) planes.
+//   - raw: the packed pixels only, RGB order, 16-bit samples in native byte order; the reader is told the
+//     size and pixel format (-f rawvideo -pix_fmt gray|gray16le|grayf32le|rgb24 -s WxH).
+// Writes block while the reader is behind, so a slow encoder holds the renderer back instead of frames piling
+// up in memory.
+namespace frame_stream {
+
+    enum class Format {
+        Y4M,
+        RAW
+    };
+
+    // false for an unknown name; names are y4m and raw
+    inline bool parse_format(const std::string &name, Format &format) {
+        if (name == "y4m") {
+            format = Format::Y4M;
+        } else if (name == "raw") {
+            format = Format::RAW;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    // the ffmpeg pixel format of raw frames, for the log line that tells how to read the stream
+    inline const char *raw_pix_fmt(output_sink::PixelFormat format) {
+        switch (format) {
+            case output_sink::PixelFormat::U8:
+                return "gray";
+            case output_sink::PixelFormat::U16:
+                return "gray16le";
+            case output_sink::PixelFormat::F32:
+                return "grayf32le";
+            case output_sink::PixelFormat::RGB8:
+                return "rgb24";
+            case output_sink::PixelFormat::I32:
+                break;
+        }
+        return "";
+    }
+
+    namespace detail {
+
+        // BT.601 limited range, the integer approximation most encoders use
+        inline void rgb_to_yuv(int r, int g, int b, unsigned char &y, unsigned char &u, unsigned char &v) {
+            y = static_cast<unsigned char>(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+            u = static_cast<unsigned char>(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            v = static_cast<unsigned char>(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+
+    class FrameStream {
+
+    private:
+        int fd = -1;
+        bool owns_fd = false;
+        std::string path;
+        Format format = Format::Y4M;
+        int width = 0, height = 0;
+        output_sink::PixelFormat pixel_format = output_sink::PixelFormat::U8;
+        std::vector<unsigned char> frame;
+        uint64_t n_frames = 0;
+
+        bool write_all(const unsigned char *bytes, size_t n_bytes) {
+            while (n_bytes > 0) {
+                ssize_t n_written = ::write(fd, bytes, n_bytes);
+                if (n_written < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n_written <= 0) {
+                    if (errno == EPIPE) {
+                        spdlog::error("The reader of {} has gone after {} frames", path, n_frames);
+                    } else {
+                        spdlog::error("Could not write frame {} to {}: {}", n_frames, path, std::strerror(errno));
+                    }
+                    return false;
+                }
+                bytes += n_written;
+                n_bytes -= static_cast<size_t>(n_written);
+            }
+            return true;
+        }
+
+        // the frame as it goes on the stream, rows converted in parallel on the pool
+        void convert(thread_pool::ThreadPool &pool, const output_sink::Sink &image) {
+            size_t n_pixels = static_cast<size_t>(width) * height;
+            size_t row_bytes = static_cast<size_t>(width) * output_sink::bytes_per_pixel(pixel_format);
+            frame.resize(n_pixels * output_sink::bytes_per_pixel(pixel_format));
+            bool planar = format == Format::Y4M && pixel_format == output_sink::PixelFormat::RGB8;
+            pool.parallel_for(height, [&](int y) {
+                const unsigned char *row = image.row(y);
+                if (!planar && pixel_format != output_sink::PixelFormat::RGB8) {
+                    std::memcpy(frame.data() + y * row_bytes, row, row_bytes);
+                    return;
+                }
+                int offset_r = image.bgr ? 2 : 0, offset_b = image.bgr ? 0 : 2;
+                if (!planar) {
+                    unsigned char *out = frame.data() + y * row_bytes;
+                    for (int x = 0; x < width; x++) {
+                        out[3 * x] = row[3 * x + offset_r];
+                        out[3 * x + 1] = row[3 * x + 1];
+                        out[3 * x + 2] = row[3 * x + offset_b];
+                    }
+                    return;
+                }
+                unsigned char *plane_y = frame.data() + static_cast<size_t>(y) * width;
+                unsigned char *plane_u = plane_y + n_pixels, *plane_v = plane_u + n_pixels;
+                for (int x = 0; x < width; x++) {
+                    detail::rgb_to_yuv(row[3 * x + offset_r], row[3 * x + 1], row[3 * x + offset_b],
+                                       plane_y[x], plane_u[x], plane_v[x]);
+                }
+            });
+        }
+
+    public:
+        FrameStream() = default;
+
+        ~FrameStream() { close(); }
+
+        FrameStream(const FrameStream &) = delete;
+        FrameStream &operator=(const FrameStream &) = delete;
+
+        // Opens `stream_path` ("-" for stdout) for frames of width x height `image_format` pixels at `fps`
+        // frames per second (Y4M header only), and writes the stream header. A named pipe blocks here until
+        // its reader opens it. SIGPIPE is ignored from then on, so a reader that quits is an error of
+        // write_frame() rather than the end of the process.
+        bool open(const std::string &stream_path, Format stream_format, int frame_width, int frame_height,
+                  output_sink::PixelFormat image_format, int fps) {
+            close();
+            path = stream_path == "-" ? "stdout" : stream_path;
+            format = stream_format;
+            width = frame_width;
+            height = frame_height;
+            pixel_format = image_format;
+            n_frames = 0;
+
+            std::string header;
+            if (format == Format::Y4M) {
+                const char *colorspace;
+                switch (pixel_format) {
+                    case output_sink::PixelFormat::U8:
+                        colorspace = "mono";
+                        break;
+                    case output_sink::PixelFormat::U16:
+                        colorspace = "mono16";
+                        break;
+                    case output_sink::PixelFormat::RGB8:
+                        colorspace = "444 XCOLORRANGE=LIMITED";
+                        break;
+                    default:
+                        spdlog::error("Y4M streams hold u8, u16 or rgb8 frames, use a raw stream for f32");
+                        return false;
+                }
+                header = fmt::format("YUV4MPEG2 W{} H{} F{}:1 Ip A1:1 C{}\n", width, height, fps, colorspace);
+            } else if (raw_pix_fmt(pixel_format)[0] == '\0') {
+                spdlog::error("Raw streams hold u8, u16, f32 or rgb8 frames");
+                return false;
+            }
+
+            std::signal(SIGPIPE, SIG_IGN);
+            if (stream_path == "-") {
+                fd = STDOUT_FILENO;
+                owns_fd = false;
+            } else {
+                fd = ::open(stream_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                owns_fd = true;
+                if (fd < 0) {
+                    spdlog::error("Could not open stream {}", stream_path);
+                    return false;
+                }
+            }
+            return write_all(reinterpret_cast<const unsigned char *>(header.data()), header.size());
+        }
+
+        // appends one frame; false, logged, if its size or format differs from the stream's or the write fails
+        bool write_frame(thread_pool::ThreadPool &pool, const output_sink::Sink &image) {
+            if (fd < 0) {
+                return false;
+            }
+            if (image.width != width || image.height != height || image.format != pixel_format) {
+                spdlog::error("Frame {} is {}x{} in another format, the stream is {}x{}", n_frames, image.width,
+                              image.height, width, height);
+                return false;
+            }
+            if (format == Format::Y4M && !write_all(reinterpret_cast<const unsigned char *>("FRAME\n"), 6)) {
+                return false;
+            }
+            size_t row_bytes = static_cast<size_t>(width) * output_sink::bytes_per_pixel(pixel_format);
+            bool as_is = pixel_format != output_sink::PixelFormat::RGB8;
+            if (as_is && image.stride == row_bytes) {
+                // packed rows already are the frame: no copy
+                if (!write_all(image.row(0), row_bytes * height)) {
+                    return false;
+                }
+            } else {
+                convert(pool, image);
+                if (!write_all(frame.data(), frame.size())) {
+                    return false;
+                }
+            }
+            n_frames++;
+            return true;
+        }
+
+        void close() {
+            if (owns_fd && fd >= 0) {
+                ::close(fd);
+            }
+            fd = -1;
+            owns_fd = false;
+        }
+
+        uint64_t frames() const { return n_frames; }
+    };
+}
+
+#endif
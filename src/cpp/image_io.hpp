@@ -0,0 +1,431 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+#include "spdlog/spdlog.h"
+
+#include "output_sink.hpp"
+#include "thread_pool.hpp"
+
+#ifndef IMAGE_IO_HPP
+#define IMAGE_IO_HPP
+
+// Image encoders for the rendered buffers, without OpenCV:
+//   - PNG, compressed in parallel as pigz does: rows are filtered in parallel, then bands of rows are
+//     deflated independently (each primed with the 32 KiB of filtered data before it, so matches still
+//     reach back across band edges) and ended on a byte boundary with a sync flush. The raw deflate
+//     streams concatenate into one zlib stream whose Adler-32 is combined from the bands', so the file is
+//     a standard PNG that any decoder reads.
+//   - PNM (PGM / PPM, PFM for f32): a header and the raw rows, for fast hand-off between tools.
+//   - QOI: a light lossless codec, several times faster than deflate at a somewhat larger size.
+//
+// An image is described by the output_sink::Sink it was rendered through.
+namespace image_io {
+
+    enum class Encoding {
+        PNG,
+        PNM,
+        QOI
+    };
+
+    inline const char *encoding_name(Encoding encoding) {
+        switch (encoding) {
+            case Encoding::PNG:
+                return "png";
+            case Encoding::PNM:
+                return "pnm";
+            case Encoding::QOI:
+                return "qoi";
+        }
+        return "";
+    }
+
+    // false for an unknown name; names are png, pnm (or ppm / pgm) and qoi
+    inline bool parse_encoding(const std::string &name, Encoding &encoding) {
+        if (name == "png") {
+            encoding = Encoding::PNG;
+        } else if (name == "pnm" || name == "ppm" || name == "pgm" || name == "pfm") {
+            encoding = Encoding::PNM;
+        } else if (name == "qoi") {
+            encoding = Encoding::QOI;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    // the encoding named by the extension of `path`; false if no encoder here handles it
+    inline bool encoding_for_path(const std::string &path, Encoding &encoding) {
+        size_t dot = path.find_last_of('.');
+        if (dot == std::string::npos || path.find('/', dot) != std::string::npos) {
+            return false;
+        }
+        std::string extension = path.substr(dot + 1);
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return parse_encoding(extension, encoding);
+    }
+
+    // uncompressed input per deflated band of a PNG
+    const size_t PNG_BAND_BYTES = 128 * 1024;
+    // deflate looks back at most this far, so that much of the previous band primes the next
+    const size_t DEFLATE_WINDOW = 32 * 1024;
+
+    namespace detail {
+
+        inline void put_u32_be(std::vector<unsigned char> &out, uint32_t value) {
+            for (int shift = 24; shift >= 0; shift -= 8) {
+                out.push_back(static_cast<unsigned char>(value >> shift));
+            }
+        }
+
+        inline void put_string(std::vector<unsigned char> &out, const std::string &text) {
+            out.insert(out.end(), text.begin(), text.end());
+        }
+
+        // row y of the image as PNG / PNM store it: big-endian 16-bit samples, RGB order
+        inline void raw_row(const output_sink::Sink &image, int y, unsigned char *out) {
+            const unsigned char *row = image.row(y);
+            switch (image.format) {
+                case output_sink::PixelFormat::U16:
+                    for (int x = 0; x < image.width; x++) {
+                        uint16_t value;
+                        std::memcpy(&value, row + 2 * x, 2);
+                        out[2 * x] = static_cast<unsigned char>(value >> 8);
+                        out[2 * x + 1] = static_cast<unsigned char>(value);
+                    }
+                    break;
+                case output_sink::PixelFormat::RGB8:
+                    for (int x = 0; x < image.width; x++) {
+                        out[3 * x] = row[3 * x + (image.bgr ? 2 : 0)];
+                        out[3 * x + 1] = row[3 * x + 1];
+                        out[3 * x + 2] = row[3 * x + (image.bgr ? 0 : 2)];
+                    }
+                    break;
+                default:
+                    std::memcpy(out, row, static_cast<size_t>(image.width) * output_sink::bytes_per_pixel(image.format));
+                    break;
+            }
+        }
+
+        inline int paeth(int a, int b, int c) {
+            int p = a + b - c;
+            int pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+            if (pa <= pb && pa <= pc) {
+                return a;
+            }
+            return pb <= pc ? b : c;
+        }
+
+        inline unsigned char predict(int filter, int left, int up, int up_left) {
+            switch (filter) {
+                case 1:
+                    return static_cast<unsigned char>(left);
+                case 2:
+                    return static_cast<unsigned char>(up);
+                case 4:
+                    return static_cast<unsigned char>(paeth(left, up, up_left));
+                default:
+                    return 0;
+            }
+        }
+
+        // Filters `row` against `prior` (zeros for the first row) with whichever of None, Sub, Up and Paeth
+        // gives the smallest sum of absolute signed residuals, the heuristic libpng uses (Average rarely wins
+        // on these images and is not tried). `out` receives the filter type byte followed by the filtered row.
+        inline void filter_row(const unsigned char *row, const unsigned char *prior, size_t n_bytes, int bpp,
+                               unsigned char *out) {
+            auto magnitude = [](int residual) {
+                auto value = static_cast<unsigned char>(residual);
+                return value < 128 ? value : 256 - value;
+            };
+            long costs[5] = {0, 0, 0, 0, 0};
+            for (size_t idx = 0; idx < n_bytes; idx++) {
+                int left = idx >= static_cast<size_t>(bpp) ? row[idx - bpp] : 0;
+                int up_left = idx >= static_cast<size_t>(bpp) ? prior[idx - bpp] : 0;
+                costs[0] += magnitude(row[idx]);
+                costs[1] += magnitude(row[idx] - left);
+                costs[2] += magnitude(row[idx] - prior[idx]);
+                costs[4] += magnitude(row[idx] - paeth(left, prior[idx], up_left));
+            }
+            int best = 0;
+            for (int filter: {1, 2, 4}) {
+                if (costs[filter] < costs[best]) {
+                    best = filter;
+                }
+            }
+            out[0] = static_cast<unsigned char>(best);
+            for (size_t idx = 0; idx < n_bytes; idx++) {
+                int left = idx >= static_cast<size_t>(bpp) ? row[idx - bpp] : 0;
+                int up_left = idx >= static_cast<size_t>(bpp) ? prior[idx - bpp] : 0;
+                out[1 + idx] = static_cast<unsigned char>(row[idx] - predict(best, left, prior[idx], up_left));
+            }
+        }
+
+        inline void put_chunk(std::vector<unsigned char> &out, const char *type, const unsigned char *data,
+                              size_t n_bytes) {
+            put_u32_be(out, static_cast<uint32_t>(n_bytes));
+            size_t type_at = out.size();
+            out.insert(out.end(), type, type + 4);
+            out.insert(out.end(), data, data + n_bytes);
+            put_u32_be(out, static_cast<uint32_t>(crc32(0, out.data() + type_at, static_cast<uInt>(4 + n_bytes))));
+        }
+    }
+
+    // PNG of an 8-bit grey (U8), 16-bit grey (U16) or RGB (RGB8) image, deflated in bands on the pool;
+    // empty for other formats
+    inline std::vector<unsigned char> encode_png(thread_pool::ThreadPool &pool, const output_sink::Sink &image,
+                                                 int level = 6) {
+        std::vector<unsigned char> png;
+        int bit_depth = 8, color_type = 0;
+        switch (image.format) {
+            case output_sink::PixelFormat::U8:
+                break;
+            case output_sink::PixelFormat::U16:
+                bit_depth = 16;
+                break;
+            case output_sink::PixelFormat::RGB8:
+                color_type = 2;
+                break;
+            default:
+                spdlog::error("PNG holds u8, u16 or rgb8 pixels");
+                return png;
+        }
+        int bpp = static_cast<int>(output_sink::bytes_per_pixel(image.format));
+        size_t row_bytes = static_cast<size_t>(image.width) * bpp;
+        size_t line_bytes = row_bytes + 1;
+        int rows_per_band = static_cast<int>(std::max<size_t>(1, PNG_BAND_BYTES / line_bytes));
+        int n_bands = (image.height + rows_per_band - 1) / rows_per_band;
+
+        // every row filtered, with its filter byte, as the zlib stream holds them
+        std::vector<unsigned char> filtered(line_bytes * image.height);
+        pool.parallel_for(n_bands, [&](int idx_band) {
+            int y_end = std::min(image.height, (idx_band + 1) * rows_per_band);
+            std::vector<unsigned char> prior(row_bytes, 0), row(row_bytes);
+            if (idx_band > 0) {
+                detail::raw_row(image, idx_band * rows_per_band - 1, prior.data());
+            }
+            for (int y = idx_band * rows_per_band; y < y_end; y++) {
+                detail::raw_row(image, y, row.data());
+                detail::filter_row(row.data(), prior.data(), row_bytes, bpp, filtered.data() + y * line_bytes);
+                prior.swap(row);
+            }
+        });
+
+        // each band as raw deflate, byte-aligned at its end, with its Adler-32 for the stream trailer
+        std::vector<std::vector<unsigned char>> bands(n_bands);
+        std::vector<uLong> band_adlers(n_bands);
+        std::vector<int> band_errors(n_bands, Z_OK);
+        pool.parallel_for(n_bands, [&](int idx_band) {
+            size_t begin = static_cast<size_t>(idx_band) * rows_per_band * line_bytes;
+            size_t end = std::min(filtered.size(), begin + static_cast<size_t>(rows_per_band) * line_bytes);
+            band_adlers[idx_band] = adler32(1, filtered.data() + begin, static_cast<uInt>(end - begin));
+
+            z_stream stream{};
+            int status = deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY);
+            if (status == Z_OK && begin > 0) {
+                size_t dictionary = std::min(begin, DEFLATE_WINDOW);
+                status = deflateSetDictionary(&stream, filtered.data() + begin - dictionary,
+                                              static_cast<uInt>(dictionary));
+            }
+            if (status != Z_OK) {
+                band_errors[idx_band] = status;
+                return;
+            }
+            std::vector<unsigned char> &out = bands[idx_band];
+            // room for the sync flush marker, and for the DC bias of deflateBound
+            out.resize(deflateBound(&stream, static_cast<uLong>(end - begin)) + 16);
+            stream.next_in = filtered.data() + begin;
+            stream.avail_in = static_cast<uInt>(end - begin);
+            stream.next_out = out.data();
+            stream.avail_out = static_cast<uInt>(out.size());
+            bool last = idx_band == n_bands - 1;
+            status = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+            if (status != (last ? Z_STREAM_END : Z_OK) || stream.avail_in != 0) {
+                band_errors[idx_band] = status == Z_OK ? Z_BUF_ERROR : status;
+            }
+            out.resize(out.size() - stream.avail_out);
+            deflateEnd(&stream);
+        });
+        for (int status: band_errors) {
+            if (status != Z_OK) {
+                spdlog::error("deflate failed: {}", status);
+                return png;
+            }
+        }
+
+        uLong adler = band_adlers[0];
+        for (int idx_band = 1; idx_band < n_bands; idx_band++) {
+            size_t band_size = std::min(filtered.size() - static_cast<size_t>(idx_band) * rows_per_band * line_bytes,
+                                        static_cast<size_t>(rows_per_band) * line_bytes);
+            adler = adler32_combine(adler, band_adlers[idx_band], static_cast<z_off_t>(band_size));
+        }
+
+        const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        png.insert(png.end(), signature, signature + 8);
+        std::vector<unsigned char> header;
+        detail::put_u32_be(header, static_cast<uint32_t>(image.width));
+        detail::put_u32_be(header, static_cast<uint32_t>(image.height));
+        header.insert(header.end(), {static_cast<unsigned char>(bit_depth), static_cast<unsigned char>(color_type),
+                                     0, 0, 0});
+        detail::put_chunk(png, "IHDR", header.data(), header.size());
+
+        // zlib header (deflate, 32 KiB window, FLEVEL of `level`), one IDAT per band, then the Adler-32
+        const unsigned char zlib_flags = level < 0 || level == 6 ? 0x9c : level <= 1 ? 0x01 : level <= 5 ? 0x5e : 0xda;
+        const unsigned char zlib_header[2] = {0x78, zlib_flags};
+        detail::put_chunk(png, "IDAT", zlib_header, 2);
+        for (const std::vector<unsigned char> &band: bands) {
+            detail::put_chunk(png, "IDAT", band.data(), band.size());
+        }
+        std::vector<unsigned char> trailer;
+        detail::put_u32_be(trailer, static_cast<uint32_t>(adler));
+        detail::put_chunk(png, "IDAT", trailer.data(), trailer.size());
+        detail::put_chunk(png, "IEND", nullptr, 0);
+        return png;
+    }
+
+    // PGM (U8, U16), PPM (RGB8) or PFM (F32); empty for I32
+    inline std::vector<unsigned char> encode_pnm(const output_sink::Sink &image) {
+        std::vector<unsigned char> pnm;
+        std::string dimensions = std::to_string(image.width) + " " + std::to_string(image.height) + "\n";
+        switch (image.format) {
+            case output_sink::PixelFormat::U8:
+                detail::put_string(pnm, "P5\n" + dimensions + "255\n");
+                break;
+            case output_sink::PixelFormat::U16:
+                detail::put_string(pnm, "P5\n" + dimensions + "65535\n");
+                break;
+            case output_sink::PixelFormat::RGB8:
+                detail::put_string(pnm, "P6\n" + dimensions + "255\n");
+                break;
+            case output_sink::PixelFormat::F32:
+                // a negative scale marks little-endian samples
+                detail::put_string(pnm, "Pf\n" + dimensions + "-1.0\n");
+                break;
+            default:
+                spdlog::error("PNM holds u8, u16, rgb8 or f32 pixels");
+                return pnm;
+        }
+        size_t header_bytes = pnm.size();
+        size_t row_bytes = static_cast<size_t>(image.width) * output_sink::bytes_per_pixel(image.format);
+        pnm.resize(header_bytes + row_bytes * image.height);
+        for (int y = 0; y < image.height; y++) {
+            if (image.format == output_sink::PixelFormat::F32) {
+                // PFM rows run bottom to top; the host is assumed little-endian, as for the atlas files
+                std::memcpy(pnm.data() + header_bytes + (image.height - 1 - y) * row_bytes, image.row(y), row_bytes);
+            } else {
+                detail::raw_row(image, y, pnm.data() + header_bytes + y * row_bytes);
+            }
+        }
+        return pnm;
+    }
+
+    // QOI (https://qoiformat.org) of a U8 (stored as grey RGB) or RGB8 image; empty for other formats
+    inline std::vector<unsigned char> encode_qoi(const output_sink::Sink &image) {
+        std::vector<unsigned char> qoi;
+        if (image.format != output_sink::PixelFormat::U8 && image.format != output_sink::PixelFormat::RGB8) {
+            spdlog::error("QOI holds u8 or rgb8 pixels");
+            return qoi;
+        }
+        qoi.reserve(14 + static_cast<size_t>(image.width) * image.height + 8);
+        detail::put_string(qoi, "qoif");
+        detail::put_u32_be(qoi, static_cast<uint32_t>(image.width));
+        detail::put_u32_be(qoi, static_cast<uint32_t>(image.height));
+        qoi.push_back(3);   // RGB
+        qoi.push_back(0);   // sRGB with linear alpha
+
+        const unsigned char OP_INDEX = 0x00, OP_DIFF = 0x40, OP_LUMA = 0x80, OP_RUN = 0xc0, OP_RGB = 0xfe;
+        // RGBA as the decoder keeps them: the index starts out transparent black, pixels are opaque
+        unsigned char seen[64][4] = {};
+        unsigned char previous[4] = {0, 0, 0, 255};
+        int run = 0;
+        std::vector<unsigned char> row(static_cast<size_t>(image.width) * 3);
+        for (int y = 0; y < image.height; y++) {
+            if (image.format == output_sink::PixelFormat::U8) {
+                const unsigned char *grey = image.row(y);
+                for (int x = 0; x < image.width; x++) {
+                    row[3 * x] = row[3 * x + 1] = row[3 * x + 2] = grey[x];
+                }
+            } else {
+                detail::raw_row(image, y, row.data());
+            }
+            for (int x = 0; x < image.width; x++) {
+                const unsigned char pixel[4] = {row[3 * x], row[3 * x + 1], row[3 * x + 2], 255};
+                if (std::memcmp(pixel, previous, 4) == 0) {
+                    run++;
+                    if (run == 62) {
+                        qoi.push_back(static_cast<unsigned char>(OP_RUN | (run - 1)));
+                        run = 0;
+                    }
+                    continue;
+                }
+                if (run > 0) {
+                    qoi.push_back(static_cast<unsigned char>(OP_RUN | (run - 1)));
+                    run = 0;
+                }
+                int hash = (pixel[0] * 3 + pixel[1] * 5 + pixel[2] * 7 + pixel[3] * 11) % 64;
+                if (std::memcmp(seen[hash], pixel, 4) == 0) {
+                    qoi.push_back(static_cast<unsigned char>(OP_INDEX | hash));
+                } else {
+                    std::memcpy(seen[hash], pixel, 4);
+                    auto dr = static_cast<signed char>(pixel[0] - previous[0]);
+                    auto dg = static_cast<signed char>(pixel[1] - previous[1]);
+                    auto db = static_cast<signed char>(pixel[2] - previous[2]);
+                    int dr_dg = dr - dg, db_dg = db - dg;
+                    if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+                        qoi.push_back(static_cast<unsigned char>(OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+                    } else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7) {
+                        qoi.push_back(static_cast<unsigned char>(OP_LUMA | (dg + 32)));
+                        qoi.push_back(static_cast<unsigned char>((dr_dg + 8) << 4 | (db_dg + 8)));
+                    } else {
+                        qoi.insert(qoi.end(), {OP_RGB, pixel[0], pixel[1], pixel[2]});
+                    }
+                }
+                std::memcpy(previous, pixel, 4);
+            }
+        }
+        if (run > 0) {
+            qoi.push_back(static_cast<unsigned char>(OP_RUN | (run - 1)));
+        }
+        qoi.insert(qoi.end(), {0, 0, 0, 0, 0, 0, 0, 1});
+        return qoi;
+    }
+
+    // Encodes `image` with `encoding` (PNG on the pool at zlib `level`) and writes it to `path`;
+    // false, logged, if the format cannot hold the image or the file cannot be written
+    inline bool write(thread_pool::ThreadPool &pool, const std::string &path, const output_sink::Sink &image,
+                      Encoding encoding, int level = 6) {
+        std::vector<unsigned char> bytes;
+        switch (encoding) {
+            case Encoding::PNG:
+                bytes = encode_png(pool, image, level);
+                break;
+            case Encoding::PNM:
+                bytes = encode_pnm(image);
+                break;
+            case Encoding::QOI:
+                bytes = encode_qoi(image);
+                break;
+        }
+        if (bytes.empty()) {
+            spdlog::error("Could not encode {} as {}", path, encoding_name(encoding));
+            return false;
+        }
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        if (!file) {
+            spdlog::error("Failed to write image: {}", path);
+            return false;
+        }
+        return true;
+    }
+}
+
+#endif
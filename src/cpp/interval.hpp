@@ -0,0 +1,114 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#ifndef INTERVAL_HPP
+#define INTERVAL_HPP
+
+// Circular interval arithmetic (disks of the complex plane), used to settle whole tiles of the Mandelbrot
+// set at once: iterating the disk of c values around a tile gives, at every step, a disk holding z_n of
+// every c in the tile. If those disks show every c escaping at the same iteration, or every c staying
+// bounded, the tile needs no per-pixel work.
+//
+// Disks rather than rectangles: z^2 rotates its argument, and an axis-aligned box has to grow to hold its
+// rotated self on every step, so box bounds blow up within a few iterations even where the orbits converge.
+// A disk is rotation invariant and only grows by the actual stretching |dz_(n+1) / dz_n| = 2 |z_n|.
+namespace interval {
+
+    // all z with |z - (re, im)| <= radius
+    struct Disk {
+        double re, im, radius;
+    };
+
+    // z -> z^2 + c for every z in `z` and c in `c`:
+    // (w + d)^2 + c0 + e = w^2 + c0 + (2 w d + d^2 + e), |2 w d + d^2 + e| <= 2 |w| r + r^2 + r_c.
+    // The centre is computed in double; the radius takes a few ulps of it to cover that rounding.
+    inline Disk mandelbrot_step(const Disk &z, const Disk &c) {
+        double w_abs = std::hypot(z.re, z.im);
+        double re = z.re * z.re - z.im * z.im + c.re;
+        double im = 2.0 * z.re * z.im + c.im;
+        double rounding = 4.0 * DBL_EPSILON * (w_abs * w_abs + std::fabs(c.re) + std::fabs(c.im));
+        return {re, im, (2.0 * w_abs + z.radius) * z.radius + c.radius + rounding};
+    }
+
+    inline double abs_lo(const Disk &z) { return std::hypot(z.re, z.im) - z.radius; }
+
+    inline double abs_hi(const Disk &z) { return std::hypot(z.re, z.im) + z.radius; }
+
+    // returned by certify_mandelbrot_disk() when the disk has to be rendered pixel by pixel
+    const int UNCERTIFIED = -1;
+
+    // cycles up to this length are looked for, see certify_mandelbrot_disk()
+    const int MAX_PERIOD = 32;
+    // the first step at which a cycle is looked for; later checks follow at doubling steps
+    const int FIRST_CYCLE_CHECK = 16;
+
+    // true if, for every c in `c`, orbits entering `trap` stay within the threshold for good: the trap maps
+    // into itself after `period` steps and no disk on the way reaches the threshold
+    inline bool is_trap(const Disk &trap, const Disk &c, int period, double threshold) {
+        Disk z = trap;
+        for (int idx_step = 0; idx_step < period; idx_step++) {
+            z = mandelbrot_step(z, c);
+            if (abs_hi(z) > threshold) {
+                return false;
+            }
+        }
+        return std::hypot(z.re - trap.re, z.im - trap.im) + z.radius <= trap.radius;
+    }
+
+    // Settles the Mandelbrot iteration escape_iteration() does for every c in the disk `c` at once.
+    // Returns
+    //   n_iterations  - no c escapes (interior), either because no disk reached the threshold within
+    //                   n_iterations or because the orbit disks fell into a trap (see is_trap()),
+    //   idx_iter      - every c crosses the threshold at this same iteration,
+    //   UNCERTIFIED   - the disks straddle the threshold.
+    // `trapped`, if given, tells the two interior cases apart: true only for the trap, which proves the
+    // disk interior for any iteration cap.
+    // The disks only stay small where the orbits converge, i.e. well inside a component of the interior,
+    // or while they are far from the set; elsewhere this gives up within a few steps.
+    inline int certify_mandelbrot_disk(const Disk &c, double threshold, int n_iterations, bool *trapped = nullptr) {
+        if (trapped != nullptr) {
+            *trapped = false;
+        }
+        Disk orbit[MAX_PERIOD + 1];
+        Disk z{0.0, 0.0, 0.0};
+        orbit[0] = z;
+        int next_cycle_check = FIRST_CYCLE_CHECK;
+
+        for (int idx_iter = 0; idx_iter < n_iterations; idx_iter++) {
+            z = mandelbrot_step(z, c);
+            if (abs_lo(z) > threshold) {
+                // every c is past the threshold, and no c was at the previous step
+                return idx_iter;
+            }
+            if (abs_hi(z) > threshold) {
+                return UNCERTIFIED;
+            }
+
+            int n_steps = idx_iter + 1;
+            orbit[n_steps % (MAX_PERIOD + 1)] = z;
+            if (n_steps != next_cycle_check) {
+                continue;
+            }
+            next_cycle_check *= 2;
+            // z_n and z_(n - period) overlapping: try a slightly larger disk holding both as a trap
+            for (int period = 1; period <= std::min(MAX_PERIOD, n_steps); period++) {
+                const Disk &earlier = orbit[(n_steps - period) % (MAX_PERIOD + 1)];
+                double distance = std::hypot(z.re - earlier.re, z.im - earlier.im);
+                if (distance > z.radius + earlier.radius) {
+                    continue;
+                }
+                double radius = std::max(z.radius, distance + earlier.radius);
+                if (is_trap({z.re, z.im, 1.25 * radius + DBL_EPSILON}, c, period, threshold)) {
+                    if (trapped != nullptr) {
+                        *trapped = true;
+                    }
+                    return n_iterations;
+                }
+            }
+        }
+        return n_iterations;
+    }
+}
+
+#endif
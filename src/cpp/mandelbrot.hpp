@@ -1,11 +1,22 @@
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
 #include <complex>
+#include <cstring>
+#include <type_traits>
 #include <vector>
 #include <istream>
+#include <tuple>
 #include <iostream>
 
 #include "spdlog/spdlog.h"
 
+#include "atlas.hpp"
+#include "formulas.hpp"
+#include "interval.hpp"
+#include "output_sink.hpp"
 #include "utilities.hpp"
+#include "thread_pool.hpp"
 
 #ifndef MANDELBROT_HPP
 #define MANDELBROT_HPP
@@ -73,32 +84,152 @@ namespace mandelbrot {
         return {hi, lo};
     }
 
-    // stores real_hi, real_lo, imag_hi, imag_lo per pixel (4 floats)
-    std::vector<float> gen_complex_set_2_shader(int size_x, int size_y, const ViewParams &vp) {
-        std::vector<float> complex_set;
-        complex_set.reserve(size_x * size_y * 4);
+    // rectangular block of pixels [x0, x1) x [y0, y1) - the unit of parallel work
+    struct Tile {
+        int x0, y0, x1, y1;
+    };
 
-        for (int i_row = 0; i_row < size_y; i_row++) {
-            double imag_frac = static_cast<double>(i_row) / (size_y - 1.0);
-            double imag_value = mandelbrot::interpolate(vp.imag_min, vp.imag_max, imag_frac);
-            auto [imag_hi, imag_lo] = dsplit(imag_value);
+    // the view as double-single uniforms for FRAGMENT_SRC: c(col, row) = origin + (col, row) * step,
+    // both stored as real_hi, real_lo, imag_hi, imag_lo; same pixel -> c mapping as gen_complex_set()
+    struct ShaderView {
+        float origin[4];
+        float step[4];
+    };
 
-            for (int i_col = 0; i_col < size_x; ++i_col) {
-                double real_frac = static_cast<double>(i_col) / (size_x - 1.0);
-                double real_value = mandelbrot::interpolate(vp.real_min, vp.real_max, real_frac);
-                auto [real_hi, real_lo] = dsplit(real_value);
+    ShaderView gen_shader_view(int size_x, int size_y, const ViewParams &vp) {
+        double real_step = (vp.real_max - vp.real_min) / (size_x - 1.0);
+        double imag_step = (vp.imag_max - vp.imag_min) / (size_y - 1.0);
+
+        ShaderView view{};
+        std::tie(view.origin[0], view.origin[1]) = dsplit(vp.real_min);
+        std::tie(view.origin[2], view.origin[3]) = dsplit(vp.imag_min);
+        std::tie(view.step[0], view.step[1]) = dsplit(real_step);
+        std::tie(view.step[2], view.step[3]) = dsplit(imag_step);
+        return view;
+    }
+
+    // iteration at which |z| first exceeds the threshold, n_iterations if it never does
+    template<typename Formula>
+    inline int escape_iteration(const Formula &formula, double pr, double pi, double threshold, int n_iterations) {
+        double zr, zi, cr, ci;
+        formula.start(pr, pi, zr, zi, cr, ci);
+        double threshold_sq = threshold * threshold;
+
+        int idx_iter = 0;
+        for (; idx_iter < n_iterations; idx_iter++) {
+            // if it is first iteration, use fc(z0), on other iterations fc(fc(z0)), etc ...
+            formula.step(zr, zi, cr, ci);
 
-                complex_set.push_back(real_hi);
-                complex_set.push_back(real_lo);
-                complex_set.push_back(imag_hi);
-                complex_set.push_back(imag_lo);
+            if (zr * zr + zi * zi > threshold_sq) {
+                break;
             }
         }
-        return complex_set;
+        return idx_iter;
+    }
+
+    // main cardioid and period-2 bulb membership of c = (x, y), the same test as in_cardioid_or_bulb() in FRAGMENT_SRC
+    inline bool in_cardioid_or_bulb(double x, double y) {
+        double q = (x - 0.25) * (x - 0.25) + y * y;
+        if (q * (q + (x - 0.25)) < 0.25 * y * y) {
+            return true;
+        }
+        return (x + 1.0) * (x + 1.0) + y * y < 0.0625;
+    }
+
+    // 0 (black) for points that never crossed the threshold,
+    // otherwise the crossing iteration scaled to [0, 255)
+    inline int iteration_to_greyscale(int idx_iter, int n_iterations) {
+        if (idx_iter == n_iterations) {
+            return 0; // black
+        }
+        return static_cast<int>(255 * (static_cast<double>(idx_iter) / n_iterations));
+    }
+
+    // iteration_to_greyscale() before quantisation, in [0, 1): what the kernels hand to an output_sink::Sink,
+    // whose U8 / I32 formats then give back iteration_to_greyscale() exactly
+    inline double iteration_to_shade(int idx_iter, int n_iterations) {
+        if (idx_iter == n_iterations) {
+            return 0.0;
+        }
+        return static_cast<double>(idx_iter) / n_iterations;
+    }
+
+    // past the threshold, the orbit of escape_distance() runs on to this radius (squared), where the
+    // asymptotic Green's function log|z| / degree^n is accurate
+    const double DE_BAILOUT_SQ = 1e10;
+    const int DE_MAX_EXTRA_STEPS = 64;
+
+    // Exterior distance estimate for the pixel at (pr, pi), -1 for points that did not escape.
+    // With G the Green's function of the set, b = G / |G'| = |z| log|z| / |dz| and the Koebe 1/4 theorem
+    // gives distance >= sinh(G) / (2 e^G |G'|) = b (1 - e^-2G) / (4 G), which is what is returned: a lower
+    // bound, so a disk of that radius around the pixel holds no point of the set.
+    template<typename Formula>
+    inline double escape_distance(const Formula &formula, double pr, double pi, double threshold, int n_iterations) {
+        double zr, zi, cr, ci, dzr, dzi;
+        formula.start(pr, pi, zr, zi, cr, ci);
+        formula.derivative_start(dzr, dzi);
+        double threshold_sq = threshold * threshold;
+
+        int idx_iter = 0;
+        for (; idx_iter < n_iterations; idx_iter++) {
+            formula.derivative_step(zr, zi, dzr, dzi);
+            formula.step(zr, zi, cr, ci);
+
+            if (zr * zr + zi * zi > threshold_sq) {
+                break;
+            }
+        }
+        if (idx_iter == n_iterations) {
+            return -1.0;
+        }
+
+        int n_steps = idx_iter + 1;
+        double z_sq = zr * zr + zi * zi;
+        for (int idx_extra = 0; idx_extra < DE_MAX_EXTRA_STEPS && z_sq < DE_BAILOUT_SQ; idx_extra++) {
+            formula.derivative_step(zr, zi, dzr, dzi);
+            formula.step(zr, zi, cr, ci);
+            z_sq = zr * zr + zi * zi;
+            n_steps++;
+        }
+        if (!(z_sq >= DE_BAILOUT_SQ)) {
+            // crossed a small threshold but stayed bounded: not (provably) exterior
+            return -1.0;
+        }
+
+        double z_abs = std::sqrt(z_sq);
+        double log_z = std::log(z_abs);
+        double b = z_abs * log_z / std::hypot(dzr, dzi);
+        if (!std::isfinite(b)) {
+            // dz overflowed: the orbit stayed close to the set for a long time
+            return 0.0;
+        }
+        double g = log_z * std::pow(static_cast<double>(Formula::degree), -n_steps);
+        return g > 1e-12 ? b * -std::expm1(-2.0 * g) / (4.0 * g) : b * 0.5;
+    }
+
+    // 0 (black) for points that did not escape, otherwise rising from black at the boundary
+    // to 255 at a distance of one pixel and beyond
+    inline int distance_to_greyscale(double distance, double pixel_size) {
+        if (distance < 0.0) {
+            return 0;
+        }
+        double frac = std::min(1.0, distance / pixel_size);
+        return static_cast<int>(255 * std::sqrt(std::sqrt(frac)));
     }
 
-    std::complex<double> mandelbrot_func(std::complex<double> z_val, std::complex<double> complex_val) {
-        return std::pow(z_val, 2) + complex_val;
+    // distance_to_greyscale() before quantisation, in [0, 1]
+    inline double distance_to_shade(double distance, double pixel_size) {
+        if (distance < 0.0) {
+            return 0.0;
+        }
+        return std::sqrt(std::sqrt(std::min(1.0, distance / pixel_size)));
+    }
+
+    inline int escape_greyscale(std::complex<double> complex_value, double threshold, int n_iterations) {
+        return iteration_to_greyscale(
+                escape_iteration(formulas::Mandelbrot{}, complex_value.real(), complex_value.imag(), threshold, n_iterations),
+                n_iterations
+        );
     }
 
     std::vector<int> mandelbrot_sequence(
@@ -113,27 +244,431 @@ namespace mandelbrot {
         mandelbrot_set.reserve(n_values);
 
         for (int idx_value = 0; idx_value < n_values; idx_value++) {
+            mandelbrot_set.push_back(escape_greyscale(complex_set[idx_value], threshold, n_iterations));
+        }
+        return mandelbrot_set;
+    }
 
-            auto complex_value = complex_set[idx_value];
-            std::complex<double> z_value_iterated(0.0);
+    std::vector<Tile> gen_tiles(int size_x, int size_y, int tile_size) {
+        std::vector<Tile> tiles;
+        for (int y0 = 0; y0 < size_y; y0 += tile_size) {
+            for (int x0 = 0; x0 < size_x; x0 += tile_size) {
+                tiles.push_back({x0, y0, std::min(x0 + tile_size, size_x), std::min(y0 + tile_size, size_y)});
+            }
+        }
+        return tiles;
+    }
 
-            int idx_iter = 0;
-            for (; idx_iter < n_iterations; idx_iter++) {
-                // if it is first iteration, use fc(0) = z**2 + c
-                // on other iterations, use fc(fc(0)), or fc(fc(fc(0))), etc ...
-                z_value_iterated = mandelbrot_func(z_value_iterated, complex_value);
+    // a disk holding the c values of every pixel of `tile`, widened by a few ulps to cover rounding in interpolate()
+    inline interval::Disk tile_c_disk(const Tile &tile, int size_x, int size_y, const ViewParams &vp) {
+        double real_0 = interpolate(vp.real_min, vp.real_max, tile.x0 / (size_x - 1.0));
+        double real_1 = interpolate(vp.real_min, vp.real_max, (tile.x1 - 1) / (size_x - 1.0));
+        double imag_0 = interpolate(vp.imag_min, vp.imag_max, tile.y0 / (size_y - 1.0));
+        double imag_1 = interpolate(vp.imag_min, vp.imag_max, (tile.y1 - 1) / (size_y - 1.0));
+        double re = (real_0 + real_1) / 2.0, im = (imag_0 + imag_1) / 2.0;
+        double radius = std::hypot(real_1 - real_0, imag_1 - imag_0) / 2.0;
+        return {re, im, radius + 4.0 * DBL_EPSILON * (std::fabs(re) + std::fabs(im))};
+    }
 
-                if (std::abs(z_value_iterated) > threshold) {
-                    break;
+    // escape_iteration() shared by every pixel of the tile, interval::UNCERTIFIED if it has to be worked out
+    // per pixel; only the Mandelbrot formula is certified, the rest always go per pixel. The installed
+    // atlas (see atlas::install()) is looked up first, so cells it already holds are not re-proven.
+    template<typename Formula>
+    int certify_tile(const Formula &, const Tile &tile, int size_x, int size_y, const ViewParams &vp,
+                     double threshold, int n_iterations) {
+        if constexpr (std::is_same<Formula, formulas::Mandelbrot>::value) {
+            if (size_x < 2 || size_y < 2) {
+                return interval::UNCERTIFIED;
+            }
+            if (const atlas::Atlas *cells = atlas::installed()) {
+                interval::Disk c = tile_c_disk(tile, size_x, size_y, vp);
+                int iteration = cells->lookup(c.re - c.radius, c.re + c.radius, c.im - c.radius, c.im + c.radius,
+                                              threshold, n_iterations);
+                if (iteration != interval::UNCERTIFIED) {
+                    return iteration;
                 }
             }
-            if (idx_iter == n_iterations) {
-                mandelbrot_set.push_back(0); // black
-            } else {
-                mandelbrot_set.push_back(static_cast<int>(255 * (static_cast<double>(idx_iter) / n_iterations)));
+            return interval::certify_mandelbrot_disk(tile_c_disk(tile, size_x, size_y, vp), threshold, n_iterations);
+        }
+        return interval::UNCERTIFIED;
+    }
+
+    // tiles certify_tile() fails on are split in four down to this size, since smaller boxes stay tighter
+    const int MIN_CERTIFIED_TILE = 8;
+
+    // computes the pixels of one tile straight from the view, without materialising the complex set;
+    // each row of the tile is shaded into a small per-thread buffer and written once into `out`, a sink of
+    // size_x * size_y pixels. Tiles, or quarters of tiles, that certify_tile() settles as a whole are filled
+    // without iterating any pixel.
+    template<typename Formula>
+    void mandelbrot_sequence_tile(
+            const Formula &formula,
+            const Tile &tile,
+            int size_x,
+            int size_y,
+            const ViewParams &vp,
+            double threshold,
+            int n_iterations,
+            const output_sink::Sink &out
+    ) {
+        int tile_iteration = certify_tile(formula, tile, size_x, size_y, vp, threshold, n_iterations);
+        if (tile_iteration != interval::UNCERTIFIED) {
+            double shade = iteration_to_shade(tile_iteration, n_iterations);
+            for (int i_row = tile.y0; i_row < tile.y1; i_row++) {
+                out.fill_row(i_row, tile.x0, tile.x1, shade);
             }
+            return;
         }
-        return mandelbrot_set;
+        if (std::is_same<Formula, formulas::Mandelbrot>::value &&
+            tile.x1 - tile.x0 >= 2 * MIN_CERTIFIED_TILE && tile.y1 - tile.y0 >= 2 * MIN_CERTIFIED_TILE) {
+            int x_mid = (tile.x0 + tile.x1) / 2, y_mid = (tile.y0 + tile.y1) / 2;
+            for (const Tile &quarter: {Tile{tile.x0, tile.y0, x_mid, y_mid}, Tile{x_mid, tile.y0, tile.x1, y_mid},
+                                       Tile{tile.x0, y_mid, x_mid, tile.y1}, Tile{x_mid, y_mid, tile.x1, tile.y1}}) {
+                mandelbrot_sequence_tile(formula, quarter, size_x, size_y, vp, threshold, n_iterations, out);
+            }
+            return;
+        }
+
+        thread_local std::vector<double> shades;
+        shades.resize(static_cast<size_t>(tile.x1 - tile.x0));
+        for (int i_row = tile.y0; i_row < tile.y1; i_row++) {
+            double imag_frac = static_cast<double>(i_row) / (static_cast<double>(size_y) - 1.0);
+            double imag_value = mandelbrot::interpolate(vp.imag_min, vp.imag_max, imag_frac);
+
+            for (int i_col = tile.x0; i_col < tile.x1; i_col++) {
+                double real_frac = static_cast<double>(i_col) / (static_cast<double>(size_x) - 1.0);
+                double real_value = mandelbrot::interpolate(vp.real_min, vp.real_max, real_frac);
+
+                shades[i_col - tile.x0] = iteration_to_shade(
+                        escape_iteration(formula, real_value, imag_value, threshold, n_iterations),
+                        n_iterations
+                );
+            }
+            out.write_row(i_row, tile.x0, tile.x1, shades.data());
+        }
+    }
+
+    // mandelbrot_sequence_tile() into the row-major int buffer `out` of size_x * size_y greyscale values
+    template<typename Formula>
+    void mandelbrot_sequence_tile(
+            const Formula &formula,
+            const Tile &tile,
+            int size_x,
+            int size_y,
+            const ViewParams &vp,
+            double threshold,
+            int n_iterations,
+            int *out
+    ) {
+        mandelbrot_sequence_tile(formula, tile, size_x, size_y, vp, threshold, n_iterations,
+                                 output_sink::packed(out, size_x, size_y));
+    }
+
+    // On a NUMA-aware pool, binds the rows each node's share of `tiles` (see ThreadPool::node_items()) writes
+    // to that node, so most output writes stay local. Called when the buffer was just (re)allocated: its
+    // zero-fill already put every page on the allocating thread's node, so first touch cannot place them.
+    inline void place_tile_rows(const thread_pool::ThreadPool &pool, const std::vector<Tile> &tiles,
+                                const output_sink::Sink &out) {
+        for (int node = 0; node < pool.numa_nodes() && pool.numa_nodes() > 1; node++) {
+            std::pair<int, int> items = pool.node_items(node, static_cast<int>(tiles.size()));
+            if (items.first >= items.second) {
+                continue;
+            }
+            unsigned char *begin = out.row(tiles[items.first].y0);
+            unsigned char *end = out.row(tiles[items.second - 1].y1);
+            if (!numa::bind_pages(begin, static_cast<size_t>(end - begin), pool.numa_node_id(node))) {
+                spdlog::debug("Could not bind output rows to NUMA node {}", pool.numa_node_id(node));
+            }
+        }
+    }
+
+    inline void place_tile_rows(const thread_pool::ThreadPool &pool, const std::vector<Tile> &tiles, int size_x,
+                                int *out) {
+        if (!tiles.empty()) {
+            place_tile_rows(pool, tiles, output_sink::packed(out, size_x, tiles.back().y1));
+        }
+    }
+
+    // How a render uses the conjugate symmetry of its formula: the tiles to compute, and the rows then copied
+    // from computed rows instead. Without symmetry to use, `tiles` is gen_tiles() and `copies` is empty.
+    struct RowPlan {
+        std::vector<Tile> tiles;
+        std::vector<std::pair<int, int>> copies;    // (row, source row)
+    };
+
+    // For a conjugate_symmetric formula the pixel at conj(c) is the mirror image of the pixel at c, so each row
+    // below the real axis whose imaginary value is exactly the negation of another row's is copied from it.
+    // interpolate() places the rows symmetrically only up to rounding: rows whose mirror is off by an ulp are
+    // computed, so the image is the same bit for bit. The computed rows are tiled run by run, with thin runs in
+    // wide tiles of about tile_size^2 pixels.
+    template<typename Formula>
+    RowPlan plan_rows(int size_x, int size_y, const ViewParams &vp, int tile_size) {
+        RowPlan plan;
+        if (Formula::conjugate_symmetric && size_y >= 2) {
+            std::vector<std::pair<double, int>> rows(static_cast<size_t>(size_y));
+            for (int i_row = 0; i_row < size_y; i_row++) {
+                double imag_frac = static_cast<double>(i_row) / (static_cast<double>(size_y) - 1.0);
+                rows[i_row] = {mandelbrot::interpolate(vp.imag_min, vp.imag_max, imag_frac), i_row};
+            }
+            std::vector<std::pair<double, int>> sorted = rows;
+            std::sort(sorted.begin(), sorted.end());
+            for (const auto &[imag_value, i_row]: rows) {
+                if (imag_value >= 0.0) {
+                    continue;
+                }
+                auto mirror = std::lower_bound(sorted.begin(), sorted.end(), std::make_pair(-imag_value, 0));
+                if (mirror != sorted.end() && mirror->first == -imag_value) {
+                    plan.copies.emplace_back(i_row, mirror->second);
+                }
+            }
+        }
+        if (plan.copies.empty()) {
+            plan.tiles = gen_tiles(size_x, size_y, tile_size);
+            return plan;
+        }
+
+        std::vector<char> copied(static_cast<size_t>(size_y), 0);
+        for (const auto &copy: plan.copies) {
+            copied[copy.first] = 1;
+        }
+        for (int run_y0 = 0; run_y0 < size_y;) {
+            if (copied[run_y0]) {
+                run_y0++;
+                continue;
+            }
+            int run_y1 = run_y0;
+            while (run_y1 < size_y && !copied[run_y1]) {
+                run_y1++;
+            }
+            for (int y0 = run_y0; y0 < run_y1; y0 += tile_size) {
+                int y1 = std::min(y0 + tile_size, run_y1);
+                int tile_w = std::max(tile_size, tile_size * tile_size / (y1 - y0));
+                for (int x0 = 0; x0 < size_x; x0 += tile_w) {
+                    plan.tiles.push_back({x0, y0, std::min(x0 + tile_w, size_x), y1});
+                }
+            }
+            run_y0 = run_y1;
+        }
+        return plan;
+    }
+
+    // fills the rows plan_rows() left to copying, once their source rows are in `out`
+    inline void copy_mirrored_rows(thread_pool::ThreadPool &pool, const RowPlan &plan, const output_sink::Sink &out) {
+        size_t row_bytes = static_cast<size_t>(out.width) * output_sink::bytes_per_pixel(out.format);
+        pool.parallel_for(static_cast<int>(plan.copies.size()), [&](int idx_copy) {
+            const std::pair<int, int> &copy = plan.copies[idx_copy];
+            std::memcpy(out.row(copy.first), out.row(copy.second), row_bytes);
+        });
+    }
+
+    // place_tile_rows() for a render following `plan`: the computed rows as above, then each mirrored row on
+    // the node whose share computes its source row, so the copy reads and writes locally
+    inline void place_tile_rows(const thread_pool::ThreadPool &pool, const RowPlan &plan,
+                                const output_sink::Sink &out) {
+        place_tile_rows(pool, plan.tiles, out);
+        if (pool.numa_nodes() <= 1 || plan.copies.empty()) {
+            return;
+        }
+        std::vector<int> row_node(static_cast<size_t>(out.height), 0);
+        for (int node = 0; node < pool.numa_nodes(); node++) {
+            std::pair<int, int> items = pool.node_items(node, static_cast<int>(plan.tiles.size()));
+            for (int idx_tile = items.first; idx_tile < items.second; idx_tile++) {
+                for (int y = plan.tiles[idx_tile].y0; y < plan.tiles[idx_tile].y1; y++) {
+                    row_node[y] = node;
+                }
+            }
+        }
+        // copies are in row order; bind runs of adjacent rows going to the same node at once
+        for (size_t begin = 0; begin < plan.copies.size();) {
+            int node = row_node[plan.copies[begin].second];
+            size_t end = begin + 1;
+            while (end < plan.copies.size() && plan.copies[end].first == plan.copies[end - 1].first + 1 &&
+                   row_node[plan.copies[end].second] == node) {
+                end++;
+            }
+            unsigned char *first = out.row(plan.copies[begin].first);
+            unsigned char *last = out.row(plan.copies[end - 1].first + 1);
+            if (!numa::bind_pages(first, static_cast<size_t>(last - first), pool.numa_node_id(node))) {
+                spdlog::debug("Could not bind mirrored rows to NUMA node {}", pool.numa_node_id(node));
+            }
+            begin = end;
+        }
+    }
+
+    // parallel equivalent of gen_complex_set() + mandelbrot_sequence() for any formula, written straight
+    // into `out` (out.width x out.height pixels) in its own pixel format; rows mirrored across the real axis
+    // are computed once (see plan_rows())
+    template<typename Formula>
+    void render_greyscale(
+            thread_pool::ThreadPool &pool,
+            const Formula &formula,
+            const ViewParams &vp,
+            double threshold,
+            int n_iterations,
+            const output_sink::Sink &out,
+            int tile_size = 64
+    ) {
+        RowPlan plan = plan_rows<Formula>(out.width, out.height, vp, tile_size);
+        pool.parallel_for(static_cast<int>(plan.tiles.size()), [&](int idx_tile) {
+            mandelbrot_sequence_tile(formula, plan.tiles[idx_tile], out.width, out.height, vp, threshold, n_iterations,
+                                     out);
+        });
+        copy_mirrored_rows(pool, plan, out);
+    }
+
+    // render_greyscale() into greyscale ints; `mandelbrot_set` is resized, not reallocated, so a caller
+    // rendering many views can keep reusing it
+    template<typename Formula>
+    void render_greyscale(
+            thread_pool::ThreadPool &pool,
+            const Formula &formula,
+            int size_x,
+            int size_y,
+            const ViewParams &vp,
+            double threshold,
+            int n_iterations,
+            std::vector<int> &mandelbrot_set,
+            int tile_size = 64
+    ) {
+        bool reallocated = mandelbrot_set.capacity() < static_cast<size_t>(size_x) * size_y;
+        mandelbrot_set.resize(static_cast<size_t>(size_x) * size_y);
+        output_sink::Sink out = output_sink::packed(mandelbrot_set.data(), size_x, size_y);
+        if (reallocated) {
+            place_tile_rows(pool, plan_rows<Formula>(size_x, size_y, vp, tile_size), out);
+        }
+        render_greyscale(pool, formula, vp, threshold, n_iterations, out, tile_size);
+    }
+
+    void render_greyscale(
+            thread_pool::ThreadPool &pool,
+            int size_x,
+            int size_y,
+            const ViewParams &vp,
+            double threshold,
+            int n_iterations,
+            std::vector<int> &mandelbrot_set,
+            int tile_size = 64
+    ) {
+        render_greyscale(pool, formulas::Mandelbrot{}, size_x, size_y, vp, threshold, n_iterations, mandelbrot_set, tile_size);
+    }
+
+    // Distance-estimate counterpart of mandelbrot_sequence_tile(), values from distance_to_greyscale().
+    // With `fill`, a pixel whose estimate reaches beyond one pixel proves the disk around it free of the set,
+    // so every pixel of the tile in that disk, shrunk by a pixel, is set to 255 and the ones not reached yet
+    // are never iterated. Exterior-heavy views then iterate mostly the pixels near the boundary.
+    // Fills reach other rows of the tile, so the tile is shaded whole in a per-thread buffer, then written.
+    template<typename Formula>
+    void distance_tile(
+            const Formula &formula,
+            const Tile &tile,
+            int size_x,
+            int size_y,
+            const ViewParams &vp,
+            double threshold,
+            int n_iterations,
+            bool fill,
+            const output_sink::Sink &out
+    ) {
+        static_assert(Formula::has_derivative, "distance estimation needs a holomorphic formula");
+        double real_step = (vp.real_max - vp.real_min) / (size_x - 1.0);
+        double imag_step = (vp.imag_max - vp.imag_min) / (size_y - 1.0);
+        double pixel_size = std::max(std::fabs(real_step), std::fabs(imag_step));
+
+        if (certify_tile(formula, tile, size_x, size_y, vp, threshold, n_iterations) == n_iterations) {
+            // the whole tile is interior
+            for (int i_row = tile.y0; i_row < tile.y1; i_row++) {
+                out.fill_row(i_row, tile.x0, tile.x1, distance_to_shade(-1.0, pixel_size));
+            }
+            return;
+        }
+
+        int tile_w = tile.x1 - tile.x0;
+        thread_local std::vector<double> shades;
+        shades.resize(static_cast<size_t>(tile_w) * (tile.y1 - tile.y0));
+        std::vector<char> filled(fill ? shades.size() : 0, 0);
+
+        for (int i_row = tile.y0; i_row < tile.y1; i_row++) {
+            double imag_frac = static_cast<double>(i_row) / (static_cast<double>(size_y) - 1.0);
+            double imag_value = mandelbrot::interpolate(vp.imag_min, vp.imag_max, imag_frac);
+
+            double *shade_row = shades.data() + static_cast<size_t>(i_row - tile.y0) * tile_w;
+            for (int i_col = tile.x0; i_col < tile.x1; i_col++) {
+                if (fill && filled[static_cast<size_t>(i_row - tile.y0) * tile_w + (i_col - tile.x0)]) {
+                    continue;
+                }
+                double real_frac = static_cast<double>(i_col) / (static_cast<double>(size_x) - 1.0);
+                double real_value = mandelbrot::interpolate(vp.real_min, vp.real_max, real_frac);
+
+                double distance = escape_distance(formula, real_value, imag_value, threshold, n_iterations);
+                shade_row[i_col - tile.x0] = distance_to_shade(distance, pixel_size);
+
+                // pixels within `radius` are at least a pixel away from the set
+                double radius = distance - pixel_size;
+                if (!fill || radius < pixel_size) {
+                    continue;
+                }
+                int d_rows = static_cast<int>(radius / std::fabs(imag_step));
+                int row_begin = std::max(tile.y0, i_row - d_rows), row_end = std::min(tile.y1, i_row + d_rows + 1);
+                for (int j_row = row_begin; j_row < row_end; j_row++) {
+                    double dy = (j_row - i_row) * imag_step;
+                    double half_width = std::sqrt(std::max(0.0, radius * radius - dy * dy));
+                    int d_cols = static_cast<int>(half_width / std::fabs(real_step));
+                    int col_begin = std::max(tile.x0, i_col - d_cols), col_end = std::min(tile.x1, i_col + d_cols + 1);
+
+                    double *fill_row = shades.data() + static_cast<size_t>(j_row - tile.y0) * tile_w;
+                    char *filled_row = filled.data() + static_cast<size_t>(j_row - tile.y0) * tile_w;
+                    for (int j_col = col_begin; j_col < col_end; j_col++) {
+                        fill_row[j_col - tile.x0] = 1.0;
+                        filled_row[j_col - tile.x0] = 1;
+                    }
+                }
+            }
+        }
+        for (int i_row = tile.y0; i_row < tile.y1; i_row++) {
+            out.write_row(i_row, tile.x0, tile.x1, shades.data() + static_cast<size_t>(i_row - tile.y0) * tile_w);
+        }
+    }
+
+    // render_greyscale() colouring by exterior distance estimate instead of escape iteration,
+    // see distance_tile(); the formula needs has_derivative
+    template<typename Formula>
+    void render_distance(
+            thread_pool::ThreadPool &pool,
+            const Formula &formula,
+            const ViewParams &vp,
+            double threshold,
+            int n_iterations,
+            bool fill,
+            const output_sink::Sink &out,
+            int tile_size = 64
+    ) {
+        RowPlan plan = plan_rows<Formula>(out.width, out.height, vp, tile_size);
+        pool.parallel_for(static_cast<int>(plan.tiles.size()), [&](int idx_tile) {
+            distance_tile(formula, plan.tiles[idx_tile], out.width, out.height, vp, threshold, n_iterations, fill, out);
+        });
+        copy_mirrored_rows(pool, plan, out);
+    }
+
+    template<typename Formula>
+    void render_distance(
+            thread_pool::ThreadPool &pool,
+            const Formula &formula,
+            int size_x,
+            int size_y,
+            const ViewParams &vp,
+            double threshold,
+            int n_iterations,
+            bool fill,
+            std::vector<int> &mandelbrot_set,
+            int tile_size = 64
+    ) {
+        bool reallocated = mandelbrot_set.capacity() < static_cast<size_t>(size_x) * size_y;
+        mandelbrot_set.resize(static_cast<size_t>(size_x) * size_y);
+        output_sink::Sink out = output_sink::packed(mandelbrot_set.data(), size_x, size_y);
+        if (reallocated) {
+            place_tile_rows(pool, plan_rows<Formula>(size_x, size_y, vp, tile_size), out);
+        }
+        render_distance(pool, formula, vp, threshold, n_iterations, fill, out, tile_size);
     }
 
     std::vector<float> gen_mandelbrot_greyscale(
@@ -0,0 +1,116 @@
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "spdlog/spdlog.h"
+
+#include "formulas.hpp"
+
+#ifndef MANIFEST_HPP
+#define MANIFEST_HPP
+
+namespace manifest {
+
+    // one image of a batch render
+    struct ViewEntry {
+        int width, height;
+        double real_min, real_max, imag_min, imag_max;
+        int n_iterations;
+        double threshold;
+        std::string img_p;
+        formulas::FormulaSpec formula;
+    };
+
+    inline std::string trim(const std::string &value) {
+        size_t begin = value.find_first_not_of(" \t\r");
+        if (begin == std::string::npos) {
+            return "";
+        }
+        size_t end = value.find_last_not_of(" \t\r");
+        return value.substr(begin, end - begin + 1);
+    }
+
+    // cells between commas, trimmed; empty cells are kept, a trailing one too ("a,b," has three cells)
+    inline std::vector<std::string> split_csv_line(const std::string &line) {
+        std::vector<std::string> cells;
+        size_t begin = 0;
+        while (true) {
+            size_t end = line.find(',', begin);
+            cells.push_back(trim(line.substr(begin, end == std::string::npos ? std::string::npos : end - begin)));
+            if (end == std::string::npos) {
+                return cells;
+            }
+            begin = end + 1;
+        }
+    }
+
+    // Reads a CSV manifest. The first non-comment line is a header naming the columns with the same
+    // long names as the CLI options (width, height, real_min, real_max, imag_min, imag_max,
+    // n_iterations, threshold, img_p, formula, power, julia_re, julia_im). Columns may come in any order;
+    // missing columns take their value from `defaults`. Lines starting with '#' and blank lines are skipped.
+    inline bool read_csv(const std::string &path, const ViewEntry &defaults, std::vector<ViewEntry> &entries) {
+        std::ifstream manifest_stream(path, std::ios::in);
+        if (!manifest_stream.is_open()) {
+            spdlog::error("Could not open manifest: {}", path);
+            return false;
+        }
+
+        std::vector<std::string> columns;
+        std::string line;
+        int line_no = 0;
+
+        while (std::getline(manifest_stream, line)) {
+            line_no++;
+            std::string stripped = trim(line);
+            if (stripped.empty() || stripped[0] == '#') {
+                continue;
+            }
+            std::vector<std::string> cells = split_csv_line(stripped);
+
+            if (columns.empty()) {
+                columns = cells;
+                continue;
+            }
+            if (cells.size() != columns.size()) {
+                spdlog::error("{}:{}: expected {} columns, got {}", path, line_no, columns.size(), cells.size());
+                return false;
+            }
+
+            ViewEntry entry = defaults;
+            for (size_t i = 0; i < columns.size(); i++) {
+                const std::string &column = columns[i];
+                const std::string &cell = cells[i];
+                try {
+                    if (column == "width") entry.width = std::stoi(cell);
+                    else if (column == "height") entry.height = std::stoi(cell);
+                    else if (column == "real_min") entry.real_min = std::stod(cell);
+                    else if (column == "real_max") entry.real_max = std::stod(cell);
+                    else if (column == "imag_min") entry.imag_min = std::stod(cell);
+                    else if (column == "imag_max") entry.imag_max = std::stod(cell);
+                    else if (column == "n_iterations") entry.n_iterations = std::stoi(cell);
+                    else if (column == "threshold") entry.threshold = std::stod(cell);
+                    else if (column == "img_p") entry.img_p = cell;
+                    else if (column == "formula") entry.formula.name = cell;
+                    else if (column == "power") entry.formula.power = std::stoi(cell);
+                    else if (column == "julia_re") entry.formula.julia_c.real(std::stod(cell));
+                    else if (column == "julia_im") entry.formula.julia_c.imag(std::stod(cell));
+                    else {
+                        spdlog::error("{}:{}: unknown column '{}'", path, line_no, column);
+                        return false;
+                    }
+                } catch (const std::exception &) {
+                    spdlog::error("{}:{}: bad value '{}' in column '{}'", path, line_no, cell, column);
+                    return false;
+                }
+            }
+            if (entry.width < 2 || entry.height < 2 || entry.n_iterations < 1) {
+                spdlog::error("{}:{}: width/height must be >= 2 and n_iterations >= 1", path, line_no);
+                return false;
+            }
+            entries.push_back(entry);
+        }
+        return true;
+    }
+}
+
+#endif
@@ -0,0 +1,121 @@
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifndef NUMA_HPP
+#define NUMA_HPP
+
+// NUMA topology and placement without a libnuma dependency: nodes and their CPUs come from sysfs, threads
+// are pinned with pthread affinity and memory is bound with the mbind system call. On other systems, or
+// when sysfs is missing, everything reports a single node and the placement calls do nothing.
+namespace numa {
+
+    struct Node {
+        int id;                 // kernel node id, as in /sys/devices/system/node/node<id>
+        std::vector<int> cpus;
+    };
+
+    // "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}
+    inline std::vector<int> parse_list(const std::string &list) {
+        std::vector<int> values;
+        std::stringstream list_stream(list);
+        std::string range;
+        while (std::getline(list_stream, range, ',')) {
+            if (range.empty() || range == "\n") {
+                continue;
+            }
+            size_t dash = range.find('-');
+            int first = std::stoi(range.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+            for (int value = first; value <= last; value++) {
+                values.push_back(value);
+            }
+        }
+        return values;
+    }
+
+    inline std::string read_line(const std::string &path) {
+        std::ifstream file(path);
+        std::string line;
+        std::getline(file, line);
+        return line;
+    }
+
+    // nodes that have CPUs; a single node with no CPU list (do not pin) when the topology is unknown
+    inline std::vector<Node> detect_nodes() {
+        std::vector<Node> nodes;
+#ifdef __linux__
+        try {
+            for (int id: parse_list(read_line("/sys/devices/system/node/online"))) {
+                std::vector<int> cpus = parse_list(
+                        read_line("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist"));
+                if (!cpus.empty()) {
+                    nodes.push_back({id, cpus});
+                }
+            }
+        } catch (const std::exception &) {
+            nodes.clear();
+        }
+#endif
+        if (nodes.empty()) {
+            nodes.push_back({0, {}});
+        }
+        return nodes;
+    }
+
+    // restricts the calling thread to `cpus` (any CPU of a node, so the scheduler still balances within it)
+    inline bool pin_current_thread(const std::vector<int> &cpus) {
+#ifdef __linux__
+        if (cpus.empty()) {
+            return false;
+        }
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        for (int cpu: cpus) {
+            CPU_SET(cpu, &cpu_set);
+        }
+        return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0;
+#else
+        (void) cpus;
+        return false;
+#endif
+    }
+
+    // Moves the whole pages inside [data, data + bytes) to `node` and keeps them there. Used instead of
+    // relying on first touch for buffers that were already written (zero-filled) by the allocating thread.
+    inline bool bind_pages(void *data, size_t bytes, int node) {
+#if defined(__linux__) && defined(SYS_mbind)
+        const int MPOL_BIND_MODE = 2;       // MPOL_BIND
+        const unsigned MPOL_MF_MOVE_FLAG = 2; // MPOL_MF_MOVE
+        if (node < 0 || node >= 64) {
+            return false;
+        }
+        auto page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+        uintptr_t begin = (reinterpret_cast<uintptr_t>(data) + page - 1) / page * page;
+        uintptr_t end = (reinterpret_cast<uintptr_t>(data) + bytes) / page * page;
+        if (end <= begin) {
+            return false;
+        }
+        unsigned long node_mask = 1ul << node;
+        // maxnode counts one past the last bit the kernel reads
+        unsigned long max_node = 8 * sizeof(node_mask) + 1;
+        return syscall(SYS_mbind, begin, end - begin, MPOL_BIND_MODE, &node_mask, max_node, MPOL_MF_MOVE_FLAG) == 0;
+#else
+        (void) data;
+        (void) bytes;
+        (void) node;
+        return false;
+#endif
+    }
+}
+
+#endif
@@ -0,0 +1,213 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "spdlog/spdlog.h"
+
+#include "colormaps.hpp"
+
+#ifndef OUTPUT_SINK_HPP
+#define OUTPUT_SINK_HPP
+
+// Where the render kernels write their pixels. A Sink is a non-owning view of a row-major 2D buffer - a
+// std::vector, a cv::Mat, a mapped GL pixel buffer, a memory-mapped file, a NumPy array - with the row
+// stride and pixel format of that buffer, so each pixel is written once, straight into its final place.
+//
+// The kernels hand over a shade per pixel in [0, 1] (see mandelbrot::iteration_to_shade()), and the sink
+// converts a whole row run at a time: the format switch is per run, not per pixel.
+namespace output_sink {
+
+    enum class PixelFormat {
+        U8,     // shade * 255, as the greyscale images
+        U16,    // shade * 65535, for 16-bit images that keep the iteration gradient
+        F32,    // the shade itself, as GL_R32F textures take it
+        RGB8,   // 3 bytes: the shade through a colormap, or grey
+        I32     // shade * 255 in an int, the engine's historic std::vector<int> layout
+    };
+
+    inline size_t bytes_per_pixel(PixelFormat format) {
+        switch (format) {
+            case PixelFormat::U8:
+                return 1;
+            case PixelFormat::U16:
+                return 2;
+            case PixelFormat::RGB8:
+                return 3;
+            case PixelFormat::F32:
+            case PixelFormat::I32:
+                return 4;
+        }
+        return 0;
+    }
+
+    // false for an unknown name; names are u8, u16, f32 and rgb8
+    inline bool parse_format(const std::string &name, PixelFormat &format) {
+        if (name == "u8") {
+            format = PixelFormat::U8;
+        } else if (name == "u16") {
+            format = PixelFormat::U16;
+        } else if (name == "f32") {
+            format = PixelFormat::F32;
+        } else if (name == "rgb8") {
+            format = PixelFormat::RGB8;
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    struct Sink {
+        void *data = nullptr;
+        int width = 0, height = 0;
+        size_t stride = 0;              // bytes from one row to the next
+        PixelFormat format = PixelFormat::U8;
+        const colormaps::Colormap *colormap = nullptr; // RGB8: shades through this map, grey without one
+        bool bgr = false;               // RGB8: blue first, as OpenCV stores colour
+
+        unsigned char *row(int y) const { return static_cast<unsigned char *>(data) + static_cast<size_t>(y) * stride; }
+
+        // pixels [x0, x1) of row y from shades[0 .. x1 - x0)
+        void write_row(int y, int x0, int x1, const double *shades) const {
+            int n = x1 - x0;
+            unsigned char *out = row(y) + static_cast<size_t>(x0) * bytes_per_pixel(format);
+            switch (format) {
+                case PixelFormat::U8:
+                    for (int idx = 0; idx < n; idx++) {
+                        out[idx] = static_cast<uint8_t>(255 * shades[idx]);
+                    }
+                    break;
+                case PixelFormat::U16: {
+                    auto *out_u16 = reinterpret_cast<uint16_t *>(out);
+                    for (int idx = 0; idx < n; idx++) {
+                        out_u16[idx] = static_cast<uint16_t>(65535 * shades[idx]);
+                    }
+                    break;
+                }
+                case PixelFormat::F32: {
+                    auto *out_f32 = reinterpret_cast<float *>(out);
+                    for (int idx = 0; idx < n; idx++) {
+                        out_f32[idx] = static_cast<float>(shades[idx]);
+                    }
+                    break;
+                }
+                case PixelFormat::RGB8:
+                    for (int idx = 0; idx < n; idx++) {
+                        unsigned char rgb[3];
+                        if (colormap != nullptr) {
+                            colormaps::lookup(*colormap, static_cast<float>(shades[idx]), rgb);
+                        } else {
+                            rgb[0] = rgb[1] = rgb[2] = static_cast<unsigned char>(255 * shades[idx]);
+                        }
+                        out[3 * idx] = bgr ? rgb[2] : rgb[0];
+                        out[3 * idx + 1] = rgb[1];
+                        out[3 * idx + 2] = bgr ? rgb[0] : rgb[2];
+                    }
+                    break;
+                case PixelFormat::I32: {
+                    auto *out_i32 = reinterpret_cast<int *>(out);
+                    for (int idx = 0; idx < n; idx++) {
+                        out_i32[idx] = static_cast<int>(255 * shades[idx]);
+                    }
+                    break;
+                }
+            }
+        }
+
+        // pixels [x0, x1) of row y all set to one shade
+        void fill_row(int y, int x0, int x1, double shade) const {
+            size_t pixel_bytes = bytes_per_pixel(format);
+            unsigned char *out = row(y) + static_cast<size_t>(x0) * pixel_bytes;
+            if (format == PixelFormat::U8) {
+                std::memset(out, static_cast<uint8_t>(255 * shade), static_cast<size_t>(x1 - x0));
+                return;
+            }
+            // one converted pixel, copied across the run
+            unsigned char pixel[4];
+            Sink one{pixel, 1, 1, pixel_bytes, format, colormap, bgr};
+            one.write_row(0, 0, 1, &shade);
+            for (int idx = 0; idx < x1 - x0; idx++) {
+                std::memcpy(out + idx * pixel_bytes, pixel, pixel_bytes);
+            }
+        }
+    };
+
+    // sink over a buffer whose rows follow each other without padding
+    inline Sink packed(void *data, int width, int height, PixelFormat format) {
+        return {data, width, height, static_cast<size_t>(width) * bytes_per_pixel(format), format};
+    }
+
+    inline Sink packed(int *values, int width, int height) {
+        return packed(values, width, height, PixelFormat::I32);
+    }
+
+    // A raw image file mapped into memory: rows are rendered straight into the page cache and reach the disk
+    // without an intermediate buffer. The file holds the pixels only, row-major and packed.
+    class MappedFile {
+
+    private:
+        void *mapping = nullptr;
+        size_t mapping_size = 0;
+        Sink file_sink;
+
+        void unmap() {
+            if (mapping != nullptr) {
+                munmap(mapping, mapping_size);
+            }
+            mapping = nullptr;
+            mapping_size = 0;
+            file_sink = Sink{};
+        }
+
+    public:
+        MappedFile() = default;
+
+        ~MappedFile() { unmap(); }
+
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        // creates (or truncates) `path` to width x height pixels of `format` and maps it
+        bool create(const std::string &path, int width, int height, PixelFormat format) {
+            unmap();
+            int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0) {
+                spdlog::error("Could not create output file: {}", path);
+                return false;
+            }
+            size_t size = static_cast<size_t>(width) * height * bytes_per_pixel(format);
+            if (size == 0 || ftruncate(fd, static_cast<off_t>(size)) != 0) {
+                spdlog::error("Could not size output file {} to {} bytes", path, size);
+                close(fd);
+                return false;
+            }
+            mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+            if (mapping == MAP_FAILED) {
+                mapping = nullptr;
+                spdlog::error("Could not map output file: {}", path);
+                return false;
+            }
+            mapping_size = size;
+            file_sink = packed(mapping, width, height, format);
+            return true;
+        }
+
+        // writes the dirty pages back; munmap() would too, but without reporting errors
+        bool flush() {
+            if (mapping == nullptr || msync(mapping, mapping_size, MS_SYNC) != 0) {
+                spdlog::error("Could not write back the output file");
+                return false;
+            }
+            return true;
+        }
+
+        const Sink &sink() const { return file_sink; }
+    };
+}
+
+#endif
@@ -0,0 +1,87 @@
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#ifndef PERTURBATION_HPP
+#define PERTURBATION_HPP
+
+// Perturbation rendering: one reference orbit Z_k is iterated on the CPU at high precision and every
+// pixel c = C + dc only iterates its small offset dz_k = z_k - Z_k in low precision,
+//   dz_{k+1} = 2 Z_k dz_k + dz_k^2 + dc
+// The reference values themselves are O(1), so storing them as float loses nothing that matters; the
+// zoom depth is limited only by the precision the reference is computed in.
+namespace perturbation {
+
+    template<typename Real>
+    Real square(const Real &value) { return value * value; }
+
+    // Reference orbit Z_0 = 0, Z_{k+1} = Z_k^2 + C for C = (cr, ci), computed in `Real` and stored as
+    // interleaved float (re, im) pairs. Stops after the first value beyond `threshold`, so the last stored
+    // value is the escaping one; returns the number of stored values (at most n_iterations + 1).
+    // `Real` is a floating-point type or a fixed_point::Fixed; the squares found by `square` are shared
+    // between the escape test and the next step, so an iteration costs one product and two squares.
+    template<typename Real>
+    int reference_orbit(Real cr, Real ci, double threshold, int n_iterations, std::vector<float> &orbit) {
+        orbit.clear();
+        orbit.reserve(2 * (static_cast<size_t>(n_iterations) + 1));
+
+        Real zr(0), zi(0), zr_sq(0), zi_sq(0);
+        Real threshold_sq = square(static_cast<Real>(threshold));
+        orbit.push_back(0.0f);
+        orbit.push_back(0.0f);
+        for (int idx_iter = 0; idx_iter < n_iterations; idx_iter++) {
+            Real zr_zi = zr * zi;
+            zi = zr_zi + zr_zi + ci;
+            zr = zr_sq - zi_sq + cr;
+            zr_sq = square(zr);
+            zi_sq = square(zi);
+            orbit.push_back(static_cast<float>(zr));
+            orbit.push_back(static_cast<float>(zi));
+            if (zr_sq + zi_sq > threshold_sq) {
+                break;
+            }
+        }
+        return static_cast<int>(orbit.size() / 2);
+    }
+
+    // Picks the pixel for the next reference among the glitched ones: the glitched pixel closest to the
+    // centroid of all of them, which for the usual single glitch blob lands inside the blob.
+    // `glitched(x, y)` tells whether the pixel still needs a pass; returns false when none does.
+    template<typename GlitchTest>
+    bool pick_glitch_reference(int size_x, int size_y, GlitchTest &&glitched, int &ref_x, int &ref_y) {
+        double sum_x = 0.0, sum_y = 0.0;
+        long long n_glitched = 0;
+        for (int y = 0; y < size_y; y++) {
+            for (int x = 0; x < size_x; x++) {
+                if (glitched(x, y)) {
+                    sum_x += x;
+                    sum_y += y;
+                    n_glitched++;
+                }
+            }
+        }
+        if (n_glitched == 0) {
+            return false;
+        }
+        double centroid_x = sum_x / static_cast<double>(n_glitched);
+        double centroid_y = sum_y / static_cast<double>(n_glitched);
+
+        double best_dist = std::numeric_limits<double>::max();
+        for (int y = 0; y < size_y; y++) {
+            for (int x = 0; x < size_x; x++) {
+                if (!glitched(x, y)) {
+                    continue;
+                }
+                double dist = (x - centroid_x) * (x - centroid_x) + (y - centroid_y) * (y - centroid_y);
+                if (dist < best_dist) {
+                    best_dist = dist;
+                    ref_x = x;
+                    ref_y = y;
+                }
+            }
+        }
+        return true;
+    }
+}
+
+#endif
@@ -0,0 +1,221 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "mandelbrot.hpp"
+#include "output_sink.hpp"
+#include "thread_pool.hpp"
+
+#ifndef RENDER_JOB_HPP
+#define RENDER_JOB_HPP
+
+// Non-blocking counterpart of mandelbrot::render_greyscale(): start() returns at once with a JobHandle that
+// exposes the result as a future, a cancellation token, progress counters, and calls back as each tile lands.
+// Cancellation is checked before every tile, so a cancelled job goes idle once each worker finishes the tile
+// it is on: the cancel-to-idle latency is bounded by one tile (tile_size^2 pixels of at most n_iterations
+// each) and is measured into Result::cancel_latency_ms.
+namespace render_job {
+
+    inline int64_t now_ns() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Shared cancellation flag; copies refer to the same flag, so one can be handed to another thread
+    // (e.g. the UI) while the job holds its own. Also remembers when it was first cancelled.
+    class CancelToken {
+
+    private:
+        struct State {
+            std::atomic<bool> cancelled{false};
+            std::atomic<int64_t> cancel_ns{0};
+        };
+        std::shared_ptr<State> state = std::make_shared<State>();
+
+    public:
+        void cancel() const {
+            int64_t unset = 0;
+            state->cancel_ns.compare_exchange_strong(unset, now_ns());
+            state->cancelled.store(true, std::memory_order_release);
+        }
+
+        bool cancelled() const { return state->cancelled.load(std::memory_order_acquire); }
+
+        // steady_clock time of the first cancel(), in ns; 0 if never cancelled
+        int64_t cancel_time_ns() const { return state->cancel_ns.load(); }
+    };
+
+    struct Result {
+        int width = 0, height = 0;
+        std::vector<int> values;    // as render_greyscale() writes them; tiles skipped by a cancel stay 0.
+                                    // Empty for jobs rendering into a caller's Sink
+        bool complete = false;      // every tile was rendered
+        int tiles_done = 0;
+        double render_ms = 0.0;     // start() to idle
+        double cancel_latency_ms = -1.0; // cancel() to idle, -1 if not cancelled
+    };
+
+    // called on a pool worker as soon as `tile` is written through `out`; must be thread safe, and must not
+    // touch pixels outside the tile, which other workers are still writing
+    using TileCallback = std::function<void(const mandelbrot::Tile &tile, const output_sink::Sink &out)>;
+
+    class JobHandle {
+
+    private:
+        CancelToken cancel_token;
+        std::shared_ptr<std::atomic<int>> n_tiles_done;
+        int n_tiles_total = 0;
+        std::shared_future<Result> result;
+
+    public:
+        JobHandle() = default;
+
+        JobHandle(CancelToken cancel_token, std::shared_ptr<std::atomic<int>> n_tiles_done, int n_tiles_total,
+                  std::shared_future<Result> result)
+                : cancel_token(std::move(cancel_token)), n_tiles_done(std::move(n_tiles_done)),
+                  n_tiles_total(n_tiles_total), result(std::move(result)) {}
+
+        bool valid() const { return result.valid(); }
+
+        // stop handing out tiles; the job finishes (incomplete) once the tiles in flight are done
+        void cancel() const { cancel_token.cancel(); }
+
+        const CancelToken &token() const { return cancel_token; }
+
+        int tiles_done() const { return n_tiles_done ? n_tiles_done->load(std::memory_order_relaxed) : 0; }
+
+        int n_tiles() const { return n_tiles_total; }
+
+        double progress() const { return n_tiles_total > 0 ? static_cast<double>(tiles_done()) / n_tiles_total : 0.0; }
+
+        bool done() const {
+            return result.valid() && result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        }
+
+        const std::shared_future<Result> &future() const { return result; }
+
+        // blocks until the job is idle
+        const Result &get() const { return result.get(); }
+    };
+
+    namespace detail {
+
+        // what the tasks of one job share; the last one to finish fulfils `promise`
+        struct Job {
+            std::vector<mandelbrot::Tile> tiles;
+            output_sink::Sink out;
+            Result result;
+            std::promise<Result> promise;
+            CancelToken token;
+            std::shared_ptr<std::atomic<int>> n_done;
+            int64_t start_ns = 0;
+        };
+
+        // hands the tiles of `job` to the pool and returns at once
+        template<typename Formula>
+        void run_tiles(thread_pool::ThreadPool &pool, const Formula &formula, const mandelbrot::ViewParams &vp,
+                       double threshold, int n_iterations, TileCallback on_tile, std::shared_ptr<Job> job) {
+            int n_tiles = static_cast<int>(job->tiles.size());
+            pool.parallel_for_async(
+                    n_tiles,
+                    [formula, vp, threshold, n_iterations, on_tile = std::move(on_tile), job](int idx_tile) {
+                        if (job->token.cancelled()) {
+                            return;
+                        }
+                        const mandelbrot::Tile &tile = job->tiles[idx_tile];
+                        mandelbrot::mandelbrot_sequence_tile(
+                                formula, tile, job->out.width, job->out.height, vp, threshold, n_iterations, job->out
+                        );
+                        job->n_done->fetch_add(1, std::memory_order_relaxed);
+                        if (on_tile) {
+                            on_tile(tile, job->out);
+                        }
+                    },
+                    [job, n_tiles] {
+                        int64_t idle_ns = now_ns();
+                        Result &result = job->result;
+                        result.width = job->out.width;
+                        result.height = job->out.height;
+                        result.tiles_done = job->n_done->load();
+                        result.complete = result.tiles_done == n_tiles;
+                        result.render_ms = static_cast<double>(idle_ns - job->start_ns) / 1e6;
+                        if (job->token.cancelled()) {
+                            result.cancel_latency_ms = static_cast<double>(idle_ns - job->token.cancel_time_ns()) / 1e6;
+                        }
+                        job->promise.set_value(std::move(result));
+                    }
+            );
+        }
+
+        inline std::shared_ptr<Job> make_job(int size_x, int size_y, int tile_size, CancelToken token) {
+            auto job = std::make_shared<Job>();
+            job->tiles = mandelbrot::gen_tiles(size_x, size_y, tile_size);
+            job->token = std::move(token);
+            job->n_done = std::make_shared<std::atomic<int>>(0);
+            job->start_ns = now_ns();
+            return job;
+        }
+
+        inline JobHandle handle(const std::shared_ptr<Job> &job) {
+            return {job->token, job->n_done, static_cast<int>(job->tiles.size()), job->promise.get_future().share()};
+        }
+    }
+
+    // Renders the view into `out` on `pool` without blocking the caller: the tiles go straight to the pool's
+    // queue and the last worker to finish one fulfils the result. `pool` and the pixels behind `out` must
+    // outlive the job; jobs may share a pool with each other and with blocking renders, their tiles queue up
+    // behind one another. `token` lets the caller hold the job's token before start() returns, e.g. for
+    // on_tile to check.
+    template<typename Formula>
+    JobHandle start(
+            thread_pool::ThreadPool &pool,
+            const Formula &formula,
+            const mandelbrot::ViewParams &vp,
+            double threshold,
+            int n_iterations,
+            const output_sink::Sink &out,
+            TileCallback on_tile = {},
+            int tile_size = 64,
+            CancelToken token = {}
+    ) {
+        std::shared_ptr<detail::Job> job = detail::make_job(out.width, out.height, tile_size, std::move(token));
+        job->out = out;
+        JobHandle handle = detail::handle(job);
+        detail::run_tiles(pool, formula, vp, threshold, n_iterations, std::move(on_tile), std::move(job));
+        return handle;
+    }
+
+    // As above into Result::values, allocated (and its pages placed) by a pool task too.
+    template<typename Formula>
+    JobHandle start(
+            thread_pool::ThreadPool &pool,
+            const Formula &formula,
+            int size_x,
+            int size_y,
+            const mandelbrot::ViewParams &vp,
+            double threshold,
+            int n_iterations,
+            TileCallback on_tile = {},
+            int tile_size = 64,
+            CancelToken token = {}
+    ) {
+        std::shared_ptr<detail::Job> job = detail::make_job(size_x, size_y, tile_size, std::move(token));
+        JobHandle handle = detail::handle(job);
+        pool.submit([&pool, formula, size_x, size_y, vp, threshold, n_iterations, on_tile = std::move(on_tile),
+                     job]() mutable {
+            std::vector<int> &values = job->result.values;
+            values.resize(static_cast<size_t>(size_x) * size_y);
+            mandelbrot::place_tile_rows(pool, job->tiles, size_x, values.data());
+            job->out = output_sink::packed(values.data(), size_x, size_y, output_sink::PixelFormat::I32);
+            detail::run_tiles(pool, formula, vp, threshold, n_iterations, std::move(on_tile), std::move(job));
+        });
+        return handle;
+    }
+}
+
+#endif
@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "spdlog/spdlog.h"
+
+#include "mandelbrot.hpp"
+#include "output_sink.hpp"
+#include "render_job.hpp"
+#include "spsc_slot.hpp"
+#include "thread_pool.hpp"
+
+#ifndef RENDER_WORKER_HPP
+#define RENDER_WORKER_HPP
+
+namespace render_worker {
+
+    // everything a frame depends on; a new frame is computed only when this changes
+    struct ViewRequest {
+        int width = 0, height = 0;
+        double real_min = 0.0, real_max = 0.0, imag_min = 0.0, imag_max = 0.0;
+        double threshold = 0.0;
+        int n_iterations = 0;
+
+        bool operator==(const ViewRequest &other) const {
+            return width == other.width && height == other.height &&
+                   real_min == other.real_min && real_max == other.real_max &&
+                   imag_min == other.imag_min && imag_max == other.imag_max &&
+                   threshold == other.threshold && n_iterations == other.n_iterations;
+        }
+
+        bool operator!=(const ViewRequest &other) const { return !(*this == other); }
+    };
+
+    // a greyscale frame, one byte per pixel, row 0 at imag_min; only rows [0, rows_done) are computed yet,
+    // the frame is finished when rows_done == request.height. `pixels` is the buffer the engine renders the
+    // frame into, shared by every band published of it: rows below rows_done are final and no longer written.
+    struct Frame {
+        ViewRequest request;
+        uint64_t generation = 0;
+        int rows_done = 0;
+        std::shared_ptr<const std::vector<unsigned char>> pixels;
+
+        bool complete() const { return rows_done == request.height; }
+    };
+
+    // Renders on its own ThreadPool as render_job jobs, so the UI thread never waits for the CPU engine.
+    // Requests are latest-wins: submitting cancels the job in flight, which stops taking tiles at once and is
+    // dropped. A frame is handed over through a lock-free LatestSlot each time the next band of tile rows from
+    // imag_min up is complete, so the UI can show it as it fills in. Bands are not copied: every frame is
+    // rendered into a buffer of its own, and a published band only moves rows_done.
+    class RenderWorker {
+
+    private:
+        static constexpr int TILE_SIZE = 64;
+
+        // bands of one frame; whichever worker completes a band publishes every complete band up to it
+        struct FrameBands {
+            ViewRequest request;
+            uint64_t generation = 0;
+            std::shared_ptr<std::vector<unsigned char>> pixels;
+            std::unique_ptr<std::atomic<int>[]> tiles_left;     // per band
+            std::vector<bool> complete;                         // per band, under publish_mutex
+            int n_bands = 0;
+            int bands_done = 0;                                 // under publish_mutex
+        };
+
+        thread_pool::ThreadPool pool;
+        spsc::LatestSlot<Frame> frames;
+        std::mutex publish_mutex;               // the producer side of `frames`, taken by the publishing worker
+
+        std::atomic<uint64_t> n_submitted{0};
+        std::atomic<bool> rendering{false};
+        std::vector<render_job::JobHandle> jobs;    // not yet idle, the last one is the frame in flight
+
+        // frame buffers; one is reused once no job or published frame refers to it any more
+        std::vector<std::shared_ptr<std::vector<unsigned char>>> buffers;
+
+        std::shared_ptr<std::vector<unsigned char>> free_buffer(size_t n_bytes) {
+            for (const auto &buffer: buffers) {
+                if (buffer.use_count() == 1) {
+                    buffer->resize(n_bytes);
+                    return buffer;
+                }
+            }
+            buffers.push_back(std::make_shared<std::vector<unsigned char>>(n_bytes));
+            return buffers.back();
+        }
+
+        void band_done(FrameBands &bands, int band, const render_job::CancelToken &token) {
+            std::lock_guard<std::mutex> lock(publish_mutex);
+            bands.complete[band] = true;
+            int bands_done = bands.bands_done;
+            while (bands_done < bands.n_bands && bands.complete[bands_done]) {
+                bands_done++;
+            }
+            if (bands_done == bands.bands_done || token.cancelled()) {
+                // nothing new below, or the frame has holes - a cancelled job skips tiles
+                return;
+            }
+            bands.bands_done = bands_done;
+
+            Frame &frame = frames.back();
+            frame.request = bands.request;
+            frame.generation = bands.generation;
+            frame.rows_done = std::min(bands_done * TILE_SIZE, bands.request.height);
+            frame.pixels = bands.pixels;
+            frames.publish();
+            if (frame.complete() && bands.generation == n_submitted.load()) {
+                rendering = false;
+            }
+        }
+
+    public:
+        explicit RenderWorker(int n_threads = 0) : pool(n_threads) {}
+
+        ~RenderWorker() {
+            for (const auto &job: jobs) {
+                job.cancel();
+            }
+            // the jobs' callbacks refer to this worker
+            for (const auto &job: jobs) {
+                job.get();
+            }
+        }
+
+        RenderWorker(const RenderWorker &) = delete;
+        RenderWorker &operator=(const RenderWorker &) = delete;
+
+        // call from the UI thread only
+        void submit(const ViewRequest &request) {
+            uint64_t generation;
+            {
+                // against a worker publishing the last frame complete in between
+                std::lock_guard<std::mutex> lock(publish_mutex);
+                generation = ++n_submitted;
+                rendering = request.width > 0 && request.height > 0;
+            }
+            for (const auto &job: jobs) {
+                job.cancel();
+            }
+            jobs.erase(std::remove_if(jobs.begin(), jobs.end(), [](const render_job::JobHandle &job) {
+                if (!job.done()) {
+                    return false;
+                }
+                const render_job::Result &result = job.get();
+                if (!result.complete) {
+                    spdlog::debug("Dropped stale frame, idle {:.2f} ms after the new request",
+                                  result.cancel_latency_ms);
+                }
+                return true;
+            }), jobs.end());
+            if (!rendering) {
+                return;
+            }
+
+            auto bands = std::make_shared<FrameBands>();
+            bands->request = request;
+            bands->generation = generation;
+            bands->pixels = free_buffer(static_cast<size_t>(request.width) * request.height);
+            bands->n_bands = (request.height + TILE_SIZE - 1) / TILE_SIZE;
+            bands->tiles_left.reset(new std::atomic<int>[bands->n_bands]);
+            int tiles_per_band = (request.width + TILE_SIZE - 1) / TILE_SIZE;
+            for (int band = 0; band < bands->n_bands; band++) {
+                bands->tiles_left[band] = tiles_per_band;
+            }
+            bands->complete.assign(bands->n_bands, false);
+
+            mandelbrot::ViewParams vp{
+                    request.real_min, request.real_max, request.imag_min, request.imag_max, 0.0, 0.0, 0.0
+            };
+            output_sink::Sink out = output_sink::packed(bands->pixels->data(), request.width, request.height,
+                                                        output_sink::PixelFormat::U8);
+            render_job::CancelToken token;
+            jobs.push_back(render_job::start(
+                    pool, formulas::Mandelbrot{}, vp, request.threshold, request.n_iterations, out,
+                    [this, bands, token](const mandelbrot::Tile &tile, const output_sink::Sink &) {
+                        int band = tile.y0 / TILE_SIZE;
+                        if (bands->tiles_left[band].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                            band_done(*bands, band, token);
+                        }
+                    },
+                    TILE_SIZE, token
+            ));
+        }
+
+        // true from submit() until the frame of the last submitted request is published complete
+        bool busy() const { return rendering; }
+
+        // consumer side of the frame slot - call from one thread only
+        bool take_frame() { return frames.take(); }
+
+        const Frame &frame() { return frames.front(); }
+    };
+}
+
+#endif
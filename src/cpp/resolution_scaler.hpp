@@ -0,0 +1,59 @@
+#include <algorithm>
+#include <cmath>
+
+#ifndef RESOLUTION_SCALER_HPP
+#define RESOLUTION_SCALER_HPP
+
+namespace resolution_scaler {
+
+    // Picks the fraction of the window resolution to render at so frames stay near `target_ms`.
+    // Fragment cost scales with the pixel count, i.e. with scale^2, so a frame that took frame_ms at the
+    // current scale would take target_ms at scale * sqrt(target_ms / frame_ms). Drops are applied at once,
+    // increases are capped and wait for a run of fast frames, so the scale does not oscillate around a
+    // vsync step.
+    class ResolutionScaler {
+
+    private:
+        static constexpr double SLOW_FACTOR = 1.1;  // frame_ms above target * this: drop resolution
+        static constexpr double FAST_FACTOR = 0.85; // frame_ms below target * this: may raise resolution
+        static constexpr double MAX_GROWTH = 1.05;  // per update
+        static constexpr int N_FAST_TO_GROW = 8;
+
+        double target_ms;
+        double min_scale;
+        double current = 1.0;
+        int n_fast = 0;
+
+    public:
+        explicit ResolutionScaler(double target_ms, double min_scale = 0.25)
+                : target_ms(target_ms), min_scale(min_scale) {}
+
+        double scale() const { return current; }
+
+        // frame_ms: measured cost of the last frame, which was rendered at scale()
+        void update(double frame_ms) {
+            if (frame_ms <= 0.0) {
+                return;
+            }
+            double ideal = current * std::sqrt(target_ms / frame_ms);
+            if (frame_ms > target_ms * SLOW_FACTOR) {
+                current = std::max(min_scale, ideal);
+                n_fast = 0;
+            } else if (frame_ms < target_ms * FAST_FACTOR) {
+                if (++n_fast >= N_FAST_TO_GROW) {
+                    current = std::min({1.0, ideal, current * MAX_GROWTH});
+                }
+            } else {
+                n_fast = 0;
+            }
+        }
+
+        // render size for a window of width x height at the current scale (never below 16 pixels a side)
+        void render_size(int width, int height, int &render_width, int &render_height) const {
+            render_width = std::min(width, std::max(16, static_cast<int>(std::lround(width * current))));
+            render_height = std::min(height, std::max(16, static_cast<int>(std::lround(height * current))));
+        }
+    };
+}
+
+#endif
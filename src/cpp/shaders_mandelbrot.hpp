@@ -1,3 +1,5 @@
+#include <string>
+
 #ifndef SHADERS_MANDELBROT_HPP
 #define SHADERS_MANDELBROT_HPP
 
@@ -17,17 +19,11 @@ void main()
 }
 )glsl";
 
-static const char *FRAGMENT_SRC = R"glsl(
-#version 330 core
-out vec4 FragColor;
-in vec2 TexCoord;
-
-uniform sampler1D colormap;
-uniform sampler2D complexSet;
+// ---------------- GLSL pieces shared by the fragment shaders below
 
-uniform int n_iterations;
-uniform float threshold;
+static const char *GLSL_VERSION = "#version 330 core\n";
 
+static const char *DS_ARITHMETIC_GLSL = R"glsl(
 // double-single: a vec2 where x=hi, y=lo, and the true value is x+y
 vec2 ds_add(vec2 a, vec2 b) {
     float s = a.x + b.x;
@@ -52,6 +48,38 @@ vec2 ds_sq(vec2 a) {
     float e = 2.0 * a.x * a.y + (a.x * a.x - p);
     return vec2(p, e);
 }
+)glsl";
+
+static const char *VIEW_GLSL = R"glsl(
+// view as double-single values: c = view_origin + pixel * view_step,
+// each vec4 holds real_hi, real_lo, imag_hi, imag_lo
+uniform vec4 view_origin;
+uniform vec4 view_step;
+// index of the pixel at gl_FragCoord (0, 0) - non-zero when rendering one tile of a larger image
+uniform vec2 pixel_offset;
+
+void pixel_c(out vec2 cr, out vec2 ci) {
+    // pixel index is exact in float; the offset from the origin is small, so one ds_mul keeps
+    // sub-pixel accuracy while the origin carries the full double-single precision
+    vec2 pixel = floor(gl_FragCoord.xy) + pixel_offset;
+    cr = ds_add(view_origin.xy, ds_mul(vec2(pixel.x, 0.0), view_step.xy)); // real part as double-single
+    ci = ds_add(view_origin.zw, ds_mul(vec2(pixel.y, 0.0), view_step.zw)); // imag part as double-single
+}
+)glsl";
+
+static const char *INTERIOR_TESTS_GLSL = R"glsl(
+// main cardioid and period-2 bulb membership
+bool in_cardioid_or_bulb(float x, float y) {
+    float q = (x - 0.25) * (x - 0.25) + y * y;
+    if (q * (q + (x - 0.25)) < 0.25 * y * y)
+        return true;
+    return (x + 1.0) * (x + 1.0) + y * y < 0.0625;
+}
+)glsl";
+
+static const char *COLOR_GLSL = R"glsl(
+uniform sampler1D colormap;
+uniform int n_iterations;
 
 vec3 computeColorIteration(int iter) {
     if (iter == n_iterations)
@@ -59,25 +87,23 @@ vec3 computeColorIteration(int iter) {
     float t = log(float(iter)) / log(float(n_iterations));
     return texture(colormap, t).rgb;
 }
+)glsl";
+
+// ---------------- single-pass kernel: the whole iteration in one draw
+
+static const char *FRAGMENT_MAIN_GLSL = R"glsl(
+out vec4 FragColor;
+in vec2 TexCoord;
+
+uniform float threshold;
 
 void main()
 {
-    // texture stores: r=real_hi, g=real_lo, b=imag_hi, a=imag_lo
-    vec4 c_tex = texture(complexSet, TexCoord);
-    vec2 cr = vec2(c_tex.r, c_tex.g); // real part as double-single
-    vec2 ci = vec2(c_tex.b, c_tex.a); // imag part as double-single
+    vec2 cr, ci;
+    pixel_c(cr, ci);
 
     // ponytail: hi-part only for bulb tests — precision sufficient for membership
-    float x = cr.x, y = ci.x;
-
-    // cardioid check
-    float q = (x - 0.25) * (x - 0.25) + y * y;
-    if (q * (q + (x - 0.25)) < 0.25 * y * y) {
-        FragColor = vec4(0.0, 0.0, 0.0, 1.0);
-        return;
-    }
-    // period-2 bulb check
-    if ((x + 1.0) * (x + 1.0) + y * y < 0.0625) {
+    if (in_cardioid_or_bulb(cr.x, ci.x)) {
         FragColor = vec4(0.0, 0.0, 0.0, 1.0);
         return;
     }
@@ -121,6 +147,159 @@ void main()
 }
 )glsl";
 
+static const std::string FRAGMENT_SRC = std::string(GLSL_VERSION) + DS_ARITHMETIC_GLSL + VIEW_GLSL +
+                                        INTERIOR_TESTS_GLSL + COLOR_GLSL + FRAGMENT_MAIN_GLSL;
+
+// ---------------- multi-frame kernel: per-pixel (z, iter) lives in float render targets and every
+// frame advances unfinished pixels by at most iter_budget iterations (ping-pong between two targets)
+
+static const char *STATUS_GLSL = R"glsl(
+const float STATUS_RUNNING = 0.0;
+const float STATUS_ESCAPED = 1.0;
+const float STATUS_INTERIOR = 2.0;
+)glsl";
+
+static const char *FRAGMENT_ACCUM_MAIN_GLSL = R"glsl(
+layout (location = 0) out vec4 state_z;    // zr_hi, zr_lo, zi_hi, zi_lo
+layout (location = 1) out vec2 state_iter; // iterations done, status
+
+uniform sampler2D state_z_prev;
+uniform sampler2D state_iter_prev;
+uniform bool reset_state;
+uniform int iter_budget;
+uniform int n_iterations;
+uniform float threshold;
+
+void main()
+{
+    vec2 cr, ci;
+    pixel_c(cr, ci);
+
+    vec4 z;
+    vec2 it;
+    if (reset_state) {
+        z = vec4(0.0);
+        it = vec2(0.0, in_cardioid_or_bulb(cr.x, ci.x) ? STATUS_INTERIOR : STATUS_RUNNING);
+    } else {
+        ivec2 texel = ivec2(gl_FragCoord.xy);
+        z = texelFetch(state_z_prev, texel, 0);
+        it = texelFetch(state_iter_prev, texel, 0).xy;
+    }
+
+    if (it.y == STATUS_RUNNING) {
+        vec2 zr = z.xy;
+        vec2 zi = z.zw;
+        // iteration counts stay exact in float up to 2^24
+        int iter = int(it.x);
+        int iter_end = min(n_iterations, iter + iter_budget);
+
+        for (; iter < iter_end; iter++) {
+            vec2 zr2 = ds_sq(zr);
+            vec2 zi2 = ds_sq(zi);
+
+            if ((zr2.x + zi2.x) > threshold * threshold) {
+                it.y = STATUS_ESCAPED;
+                break;
+            }
+            vec2 new_zr = ds_add(ds_sub(zr2, zi2), cr);
+            vec2 new_zi = ds_add(ds_mul(vec2(2.0, 0.0), ds_mul(zr, zi)), ci);
+            zr = new_zr;
+            zi = new_zi;
+        }
+        it.x = float(iter);
+        z = vec4(zr, zi);
+    }
+    state_z = z;
+    state_iter = it;
+}
+)glsl";
+
+static const std::string FRAGMENT_ACCUM_SRC = std::string(GLSL_VERSION) + DS_ARITHMETIC_GLSL + VIEW_GLSL +
+                                              INTERIOR_TESTS_GLSL + STATUS_GLSL + FRAGMENT_ACCUM_MAIN_GLSL;
+
+// colours the accumulated state; pixels still running are shown black like the interior
+static const char *FRAGMENT_ACCUM_DISPLAY_MAIN_GLSL = R"glsl(
+out vec4 FragColor;
+
+uniform sampler2D state_iter;
+
+void main()
+{
+    vec2 it = texelFetch(state_iter, ivec2(gl_FragCoord.xy), 0).xy;
+    int iter = it.y == STATUS_ESCAPED ? int(it.x) : n_iterations;
+    FragColor = vec4(computeColorIteration(iter), 1.0);
+}
+)glsl";
+
+static const std::string FRAGMENT_ACCUM_DISPLAY_SRC = std::string(GLSL_VERSION) + STATUS_GLSL + COLOR_GLSL +
+                                                      FRAGMENT_ACCUM_DISPLAY_MAIN_GLSL;
+
+// ---------------- perturbation kernel: plain-float deltas against a CPU reference orbit (see perturbation.hpp).
+// Glitched pixels are written with alpha 0 so a following pass with a new reference can replace only them.
+
+static const char *FRAGMENT_PERTURBATION_MAIN_GLSL = R"glsl(
+out vec4 FragColor;
+
+// Z_0 .. Z_{ref_length - 1} as (re, im)
+uniform samplerBuffer ref_orbit;
+uniform int ref_length;
+// pixel the reference was computed at and its c rounded to float (only used for the bulb test)
+uniform vec2 ref_pixel;
+uniform vec2 ref_c;
+// whether ref_c + dc still tells the pixels apart in float; deeper, every pixel would test the same point
+uniform bool interior_test;
+uniform vec2 pixel_step;
+uniform float threshold;
+// |z| < glitch_tolerance * |Z| means dz has cancelled against the reference and lost its precision
+uniform float glitch_tolerance;
+
+vec2 c_mul(vec2 a, vec2 b) {
+    return vec2(a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x);
+}
+
+void main()
+{
+    // the pixel difference is an exact integer, so dc keeps full float precision at any zoom
+    vec2 dc = (floor(gl_FragCoord.xy) - ref_pixel) * pixel_step;
+
+    if (interior_test && in_cardioid_or_bulb(ref_c.x + dc.x, ref_c.y + dc.y)) {
+        FragColor = vec4(0.0, 0.0, 0.0, 1.0);
+        return;
+    }
+
+    float threshold_sq = threshold * threshold;
+    float tolerance_sq = glitch_tolerance * glitch_tolerance;
+    vec2 dz = vec2(0.0);
+    bool glitched = false;
+    int iter = 0;
+
+    for (iter = 0; iter < n_iterations; iter++) {
+        if (iter + 1 >= ref_length) {
+            // the reference escaped before this pixel did
+            glitched = true;
+            break;
+        }
+        vec2 Z = texelFetch(ref_orbit, iter).xy;
+        dz = 2.0 * c_mul(Z, dz) + c_mul(dz, dz) + dc;
+
+        vec2 Z_next = texelFetch(ref_orbit, iter + 1).xy;
+        vec2 z = Z_next + dz;
+        float z_sq = dot(z, z);
+        if (z_sq > threshold_sq)
+            break;
+        if (z_sq < tolerance_sq * dot(Z_next, Z_next)) {
+            glitched = true;
+            break;
+        }
+    }
+
+    FragColor = vec4(computeColorIteration(iter), glitched ? 0.0 : 1.0);
+}
+)glsl";
+
+static const std::string FRAGMENT_PERTURBATION_SRC = std::string(GLSL_VERSION) + INTERIOR_TESTS_GLSL + COLOR_GLSL +
+                                                     FRAGMENT_PERTURBATION_MAIN_GLSL;
+
 } // namespace shaders_mandelbrot
 
 #endif
@@ -0,0 +1,47 @@
+#include <atomic>
+
+#ifndef SPSC_SLOT_HPP
+#define SPSC_SLOT_HPP
+
+namespace spsc {
+
+    // Single-producer / single-consumer "latest value" slot (a triple buffer).
+    // The producer fills back() and publish()es it; the consumer take()s the most recent published value
+    // and reads it through front(). Neither side ever waits: values the consumer did not get to in time
+    // are overwritten, which is what a display wants from a renderer. Buffers are reused, so a T holding
+    // a std::vector keeps its allocation from frame to frame.
+    template<typename T>
+    class LatestSlot {
+
+    private:
+        static constexpr int INDEX_MASK = 3;
+        static constexpr int FRESH = 4;
+
+        T buffers[3];
+        // index of the buffer in the middle, plus FRESH when it holds a value the consumer has not taken
+        std::atomic<int> middle{1};
+        int back_idx = 0;  // owned by the producer
+        int front_idx = 2; // owned by the consumer
+
+    public:
+        // producer side
+        T &back() { return buffers[back_idx]; }
+
+        void publish() {
+            back_idx = middle.exchange(back_idx | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+        }
+
+        // consumer side; returns false (and leaves front() as it was) when nothing new was published
+        bool take() {
+            if ((middle.load(std::memory_order_acquire) & FRESH) == 0) {
+                return false;
+            }
+            front_idx = middle.exchange(front_idx, std::memory_order_acq_rel) & INDEX_MASK;
+            return true;
+        }
+
+        T &front() { return buffers[front_idx]; }
+    };
+}
+
+#endif
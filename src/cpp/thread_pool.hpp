@@ -0,0 +1,215 @@
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "numa.hpp"
+
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+namespace thread_pool {
+
+    // fixed set of workers fed from a single FIFO queue;
+    // created once and reused for every render so thread start-up is paid only once.
+    // NUMA-aware pools split the workers into contiguous groups, one per node, pinned to that node's CPUs;
+    // parallel_for() then gives every node a contiguous share of the items and workers drain their own
+    // node's share before stealing from the others.
+    class ThreadPool {
+
+    private:
+        std::vector<std::thread> workers;
+        std::queue<std::function<void()>> tasks;
+        std::mutex tasks_mutex;
+        std::condition_variable tasks_cv;
+        bool stopping = false;
+
+        std::vector<numa::Node> nodes{numa::Node{0, {}}};
+        std::vector<int> node_n_workers;
+
+        // index into `nodes` of the pool worker running on this thread, 0 elsewhere
+        static int &worker_node() {
+            thread_local int node = 0;
+            return node;
+        }
+
+        // one counter per node share of a parallel_for(), each on its own cache line
+        struct alignas(64) Share {
+            std::atomic<int> next{0};
+            int end = 0;
+        };
+
+        std::unique_ptr<Share[]> make_shares(int n_items) const {
+            std::unique_ptr<Share[]> shares(new Share[numa_nodes()]);
+            for (int node = 0; node < numa_nodes(); node++) {
+                std::pair<int, int> items = node_items(node, n_items);
+                shares[node].next = items.first;
+                shares[node].end = items.second;
+            }
+            return shares;
+        }
+
+        // the items of a parallel_for() one job takes: its own node's share first, then the others' in turn
+        template<typename F>
+        static void drain(Share *shares, int n_nodes, F &func) {
+            int home = worker_node();
+            for (int offset = 0; offset < n_nodes; offset++) {
+                Share &share = shares[(home + offset) % n_nodes];
+                for (int idx = share.next++; idx < share.end; idx = share.next++) {
+                    func(idx);
+                }
+            }
+        }
+
+        void worker_loop(int node) {
+            worker_node() = node;
+            numa::pin_current_thread(nodes[node].cpus);
+            while (true) {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(tasks_mutex);
+                    tasks_cv.wait(lock, [this] { return stopping || !tasks.empty(); });
+                    if (stopping && tasks.empty()) {
+                        return;
+                    }
+                    task = std::move(tasks.front());
+                    tasks.pop();
+                }
+                task();
+            }
+        }
+
+    public:
+        explicit ThreadPool(int n_threads = 0, bool numa_aware = false) {
+            if (n_threads <= 0) {
+                n_threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+            }
+            if (numa_aware) {
+                nodes = numa::detect_nodes();
+            }
+            int n_nodes = std::min(static_cast<int>(nodes.size()), n_threads);
+            nodes.resize(n_nodes);
+            if (n_nodes == 1) {
+                // nothing to gain from pinning everything to one node
+                nodes[0].cpus.clear();
+            }
+            node_n_workers.assign(n_nodes, 0);
+
+            workers.reserve(n_threads);
+            for (int i = 0; i < n_threads; i++) {
+                int node = static_cast<int>(static_cast<long>(i) * n_nodes / n_threads);
+                node_n_workers[node]++;
+                workers.emplace_back([this, node] { worker_loop(node); });
+            }
+        }
+
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(tasks_mutex);
+                stopping = true;
+            }
+            tasks_cv.notify_all();
+            for (auto &worker: workers) {
+                worker.join();
+            }
+        }
+
+        ThreadPool(const ThreadPool &) = delete;
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        int size() const { return static_cast<int>(workers.size()); }
+
+        // number of NUMA nodes the workers are spread over (1 unless NUMA-aware on a multi-node host)
+        int numa_nodes() const { return static_cast<int>(nodes.size()); }
+
+        // kernel id of the `node`-th node of the pool, for numa::bind_pages()
+        int numa_node_id(int node) const { return nodes[node].id; }
+
+        // items [begin, end) of parallel_for(n_items) that start out on the `node`-th node, in proportion
+        // to its workers; the pool's first node gets the first items
+        std::pair<int, int> node_items(int node, int n_items) const {
+            long before = 0;
+            for (int idx = 0; idx < node; idx++) {
+                before += node_n_workers[idx];
+            }
+            long begin = before * n_items / size();
+            long end = (before + node_n_workers[node]) * n_items / size();
+            return {static_cast<int>(begin), static_cast<int>(end)};
+        }
+
+        template<typename F>
+        std::future<void> submit(F &&func) {
+            auto task = std::make_shared<std::packaged_task<void()>>(std::forward<F>(func));
+            std::future<void> result = task->get_future();
+            {
+                std::lock_guard<std::mutex> lock(tasks_mutex);
+                tasks.emplace([task] { (*task)(); });
+            }
+            tasks_cv.notify_one();
+            return result;
+        }
+
+        // calls func(idx) for idx in [0, n_items), items are handed out one at a time
+        // so uneven items (e.g. tiles touching the set interior) balance across workers;
+        // on several NUMA nodes see node_items() for which items each node takes first
+        template<typename F>
+        void parallel_for(int n_items, F &&func) {
+            if (n_items <= 0) {
+                return;
+            }
+            int n_jobs = std::min(size(), n_items);
+            int n_nodes = numa_nodes();
+            std::unique_ptr<Share[]> shares = make_shares(n_items);
+
+            std::vector<std::future<void>> jobs;
+            jobs.reserve(n_jobs);
+            for (int i = 0; i < n_jobs; i++) {
+                jobs.push_back(submit([&shares, &func, n_nodes] { drain(shares.get(), n_nodes, func); }));
+            }
+            for (auto &job: jobs) {
+                job.get();
+            }
+        }
+
+        // parallel_for() that returns at once; on_done() runs on the worker that finishes the last item (at
+        // once on the caller for no items). Nothing waits on the items, so it may also be called from a task
+        // of this pool.
+        template<typename F, typename Done>
+        void parallel_for_async(int n_items, F func, Done on_done) {
+            if (n_items <= 0) {
+                on_done();
+                return;
+            }
+            struct State {
+                std::unique_ptr<Share[]> shares;
+                F func;
+                Done on_done;
+                std::atomic<int> n_running;
+
+                State(std::unique_ptr<Share[]> shares, F func, Done on_done, int n_jobs)
+                        : shares(std::move(shares)), func(std::move(func)), on_done(std::move(on_done)),
+                          n_running(n_jobs) {}
+            };
+            int n_jobs = std::min(size(), n_items);
+            int n_nodes = numa_nodes();
+            auto state = std::make_shared<State>(make_shares(n_items), std::move(func), std::move(on_done), n_jobs);
+            for (int i = 0; i < n_jobs; i++) {
+                submit([state, n_nodes] {
+                    drain(state->shares.get(), n_nodes, state->func);
+                    if (state->n_running.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                        state->on_done();
+                    }
+                });
+            }
+        }
+    };
+}
+
+#endif
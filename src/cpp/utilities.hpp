@@ -1,6 +1,9 @@
 #include <vector>
 #include <chrono>
 
+#ifndef UTILITIES_HPP
+#define UTILITIES_HPP
+
 namespace math_cpp_utils {
     int assign_greyscale_color_based_on_value(
             double value,
@@ -37,3 +40,5 @@ namespace math_cpp_utils {
         return color;
     }
 }
+
+#endif
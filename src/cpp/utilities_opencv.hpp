@@ -1,6 +1,61 @@
 #include <opencv2/opencv.hpp>
 
+#include "colormaps.hpp"
+#include "output_sink.hpp"
+#include "thread_pool.hpp"
+
 namespace math_cpp_utils_opencv {
+    // (Re)creates `mat` to hold size_x x size_y pixels of `format` and returns a sink writing into its rows,
+    // so the render lands in the mat without an intermediate buffer: U8 / U16 / F32 give single-channel
+    // mats, RGB8 a BGR one through `colormap` (grey without one); I32 has no image type and falls back to U8.
+    inline output_sink::Sink mat_sink(cv::Mat &mat, int size_x, int size_y, output_sink::PixelFormat format,
+                                      const colormaps::Colormap *colormap = nullptr) {
+        int type = CV_8UC1;
+        switch (format) {
+            case output_sink::PixelFormat::U16:
+                type = CV_16UC1;
+                break;
+            case output_sink::PixelFormat::F32:
+                type = CV_32FC1;
+                break;
+            case output_sink::PixelFormat::RGB8:
+                type = CV_8UC3;
+                break;
+            default:
+                break;
+        }
+        mat.create(size_y, size_x, type);
+        output_sink::Sink sink{mat.data, size_x, size_y, mat.step, format, colormap, true};
+        if (format == output_sink::PixelFormat::I32) {
+            sink.format = output_sink::PixelFormat::U8;
+        }
+        return sink;
+    }
+
+    // sink describing the pixels of an existing mat, e.g. to hand it to image_io; false for a mat type no
+    // pixel format matches
+    inline bool mat_view(cv::Mat &mat, output_sink::Sink &view) {
+        output_sink::PixelFormat format;
+        switch (mat.type()) {
+            case CV_8UC1:
+                format = output_sink::PixelFormat::U8;
+                break;
+            case CV_16UC1:
+                format = output_sink::PixelFormat::U16;
+                break;
+            case CV_32FC1:
+                format = output_sink::PixelFormat::F32;
+                break;
+            case CV_8UC3:
+                format = output_sink::PixelFormat::RGB8;
+                break;
+            default:
+                return false;
+        }
+        view = output_sink::Sink{mat.data, mat.cols, mat.rows, mat.step, format, nullptr, true};
+        return true;
+    }
+
     cv::Mat get_greyscale_mat(std::vector<int> const &greyscale_values, int size_x, int size_y) {
         cv::Mat greyscale_mat(size_y, size_x, CV_8UC1);
 
@@ -15,4 +70,50 @@ namespace math_cpp_utils_opencv {
 
         return greyscale_mat;
     }
-}
\ No newline at end of file
+
+    // same as get_greyscale_mat(), but writes into an existing mat;
+    // cv::Mat::create() keeps the allocation when the size does not change
+    void fill_greyscale_mat(std::vector<int> const &greyscale_values, int size_x, int size_y, cv::Mat &greyscale_mat) {
+        greyscale_mat.create(size_y, size_x, CV_8UC1);
+
+        for (int i_row = 0; i_row < size_y; i_row++) {
+            auto *mat_row = greyscale_mat.ptr<uchar>(i_row);
+            const int *values_row = greyscale_values.data() + static_cast<size_t>(i_row) * size_x;
+            for (int j_col = 0; j_col < size_x; ++j_col) {
+                mat_row[j_col] = static_cast<uchar>(values_row[j_col]);
+            }
+        }
+    }
+
+    // fill_greyscale_mat() with rows spread over the pool. Rows are split between NUMA nodes like the tiles
+    // of the render, so each node reads the values it computed, and a newly allocated mat is first touched
+    // by the node that fills it.
+    void fill_greyscale_mat(thread_pool::ThreadPool &pool, std::vector<int> const &greyscale_values, int size_x,
+                            int size_y, cv::Mat &greyscale_mat) {
+        greyscale_mat.create(size_y, size_x, CV_8UC1);
+
+        pool.parallel_for(size_y, [&](int i_row) {
+            auto *mat_row = greyscale_mat.ptr<uchar>(i_row);
+            const int *values_row = greyscale_values.data() + static_cast<size_t>(i_row) * size_x;
+            for (int j_col = 0; j_col < size_x; ++j_col) {
+                mat_row[j_col] = static_cast<uchar>(values_row[j_col]);
+            }
+        });
+    }
+
+    // values in [0, 1] through `colormap` into an 8-bit BGR mat (OpenCV channel order), rows spread over the pool
+    void fill_colormap_mat(thread_pool::ThreadPool &pool, std::vector<float> const &values, int size_x, int size_y,
+                           const colormaps::Colormap &colormap, cv::Mat &color_mat) {
+        color_mat.create(size_y, size_x, CV_8UC3);
+
+        pool.parallel_for(size_y, [&](int i_row) {
+            auto *mat_row = color_mat.ptr<cv::Vec3b>(i_row);
+            const float *values_row = values.data() + static_cast<size_t>(i_row) * size_x;
+            for (int j_col = 0; j_col < size_x; ++j_col) {
+                unsigned char rgb[3];
+                colormaps::lookup(colormap, values_row[j_col], rgb);
+                mat_row[j_col] = cv::Vec3b(rgb[2], rgb[1], rgb[0]);
+            }
+        });
+    }
+}
@@ -1,7 +1,20 @@
 #include <iostream>
 #include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
 
+#ifdef MATH_CPP_GL_NO_GLEW
+// headless targets have no window system for GLEW to query and call the
+// entry points exported by libOpenGL (GLVND) directly
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#else
 #include <GL/glew.h>
+#endif
 
 #ifndef UTILITIES_SHADERS_HPP
 #define UTILITIES_SHADERS_HPP
@@ -141,6 +154,255 @@ namespace utils_shaders {
 
         return ProgramID;
     }
+
+    // offscreen framebuffer with one texture per entry of `internal_formats`,
+    // attached as GL_COLOR_ATTACHMENT0 .. N-1 and all enabled as draw buffers
+    struct RenderTarget {
+        GLuint fbo = 0;
+        std::vector<GLuint> textures;
+        int width = 0, height = 0;
+    };
+
+    GLenum base_format(GLenum internal_format) {
+        switch (internal_format) {
+            case GL_R8:
+            case GL_R32F:
+                return GL_RED;
+            case GL_RG32F:
+                return GL_RG;
+            default:
+                return GL_RGBA;
+        }
+    }
+
+    void delete_render_target(RenderTarget &target) {
+        if (!target.textures.empty()) {
+            glDeleteTextures(static_cast<GLsizei>(target.textures.size()), target.textures.data());
+            target.textures.clear();
+        }
+        if (target.fbo != 0) {
+            glDeleteFramebuffers(1, &target.fbo);
+            target.fbo = 0;
+        }
+        target.width = target.height = 0;
+    }
+
+    bool create_render_target(RenderTarget &target, int width, int height, const std::vector<GLenum> &internal_formats) {
+        delete_render_target(target);
+        target.width = width;
+        target.height = height;
+        target.textures.resize(internal_formats.size());
+        glGenTextures(static_cast<GLsizei>(target.textures.size()), target.textures.data());
+        glGenFramebuffers(1, &target.fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+
+        std::vector<GLenum> draw_buffers;
+        for (size_t i = 0; i < internal_formats.size(); i++) {
+            glBindTexture(GL_TEXTURE_2D, target.textures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, static_cast<GLint>(internal_formats[i]), width, height, 0,
+                         base_format(internal_formats[i]), GL_FLOAT, nullptr);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+            GLenum attachment = GL_COLOR_ATTACHMENT0 + static_cast<GLenum>(i);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, target.textures[i], 0);
+            draw_buffers.push_back(attachment);
+        }
+        glDrawBuffers(static_cast<GLsizei>(draw_buffers.size()), draw_buffers.data());
+
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (status != GL_FRAMEBUFFER_COMPLETE) {
+            printf("Framebuffer %dx%d is incomplete (status 0x%x)\n", width, height, status);
+            return false;
+        }
+        return true;
+    }
+
+    bool has_extension(const char *name) {
+        GLint n_extensions = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &n_extensions);
+        for (GLint i = 0; i < n_extensions; i++) {
+            const char *extension = reinterpret_cast<const char *>(glGetStringi(GL_EXTENSIONS, i));
+            if (extension != nullptr && std::strcmp(extension, name) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Two pixel-unpack buffers used in turn for streaming texture uploads: while the GL still copies from
+    // one, the CPU fills the other. With ARB_buffer_storage both are mapped once, persistently and
+    // coherently, for their whole lifetime; otherwise every upload maps the buffer with invalidation.
+    struct PixelUploader {
+        GLuint pbo[2] = {0, 0};
+        unsigned char *mapped[2] = {nullptr, nullptr};
+        GLsync fence[2] = {nullptr, nullptr};
+        size_t capacity = 0;
+        bool persistent = false;
+        int next = 0;
+    };
+
+    void delete_pixel_uploader(PixelUploader &uploader) {
+        for (int i = 0; i < 2; i++) {
+            if (uploader.fence[i] != nullptr) {
+                glDeleteSync(uploader.fence[i]);
+                uploader.fence[i] = nullptr;
+            }
+            if (uploader.mapped[i] != nullptr) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploader.pbo[i]);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                uploader.mapped[i] = nullptr;
+            }
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (uploader.pbo[0] != 0) {
+            glDeleteBuffers(2, uploader.pbo);
+            uploader.pbo[0] = uploader.pbo[1] = 0;
+        }
+        uploader.capacity = 0;
+    }
+
+    bool create_pixel_uploader(PixelUploader &uploader, size_t capacity) {
+        delete_pixel_uploader(uploader);
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        uploader.persistent = major > 4 || (major == 4 && minor >= 4) || has_extension("GL_ARB_buffer_storage");
+        uploader.capacity = capacity;
+        uploader.next = 0;
+
+        glGenBuffers(2, uploader.pbo);
+        for (int i = 0; i < 2; i++) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploader.pbo[i]);
+            if (uploader.persistent) {
+                GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+                glBufferStorage(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(capacity), nullptr, flags);
+                uploader.mapped[i] = static_cast<unsigned char *>(
+                        glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(capacity), flags)
+                );
+                if (uploader.mapped[i] == nullptr) {
+                    printf("Could not map pixel buffer of %zu bytes\n", capacity);
+                    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                    delete_pixel_uploader(uploader);
+                    return false;
+                }
+            } else {
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(capacity), nullptr, GL_STREAM_DRAW);
+            }
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return true;
+    }
+
+    // Copies `data` (n_rows rows of `width` pixels, tightly packed) into the next buffer and updates rows
+    // [y0, y0 + n_rows) of `texture` from it. The texture must already have storage covering those rows;
+    // the buffers grow as needed.
+    bool upload_texture_rows(PixelUploader &uploader, GLuint texture, int width, int y0, int n_rows,
+                             GLenum format, GLenum type, const void *data, size_t bytes) {
+        if (bytes > uploader.capacity && !create_pixel_uploader(uploader, bytes)) {
+            return false;
+        }
+        int idx = uploader.next;
+        uploader.next = 1 - uploader.next;
+
+        // the buffer may still be read by the upload issued two calls ago
+        if (uploader.fence[idx] != nullptr) {
+            glClientWaitSync(uploader.fence[idx], GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1000000000));
+            glDeleteSync(uploader.fence[idx]);
+            uploader.fence[idx] = nullptr;
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, uploader.pbo[idx]);
+        if (uploader.persistent) {
+            std::memcpy(uploader.mapped[idx], data, bytes);
+        } else {
+            void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(bytes),
+                                         GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            if (dst == nullptr) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                return false;
+            }
+            std::memcpy(dst, data, bytes);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y0, width, n_rows, format, type, nullptr);
+        uploader.fence[idx] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return true;
+    }
+
+    // updates the whole of `texture` (width x height) from `data`, see upload_texture_rows()
+    bool upload_texture(PixelUploader &uploader, GLuint texture, int width, int height,
+                        GLenum format, GLenum type, const void *data, size_t bytes) {
+        return upload_texture_rows(uploader, texture, width, 0, height, format, type, data, bytes);
+    }
+
+    // GL_TIME_ELAPSED queries in a small ring: a frame's GPU time is read a few frames later, once
+    // available, so timing never stalls the pipeline. Frames that find every query still in flight go untimed.
+    struct GpuTimer {
+        static constexpr int N_QUERIES = 4;
+        GLuint queries[N_QUERIES] = {0, 0, 0, 0};
+        uint64_t frames[N_QUERIES] = {0, 0, 0, 0};
+        bool pending[N_QUERIES] = {false, false, false, false};
+        int next = 0;
+        int active = -1;
+    };
+
+    void create_gpu_timer(GpuTimer &timer) {
+        glGenQueries(GpuTimer::N_QUERIES, timer.queries);
+    }
+
+    void delete_gpu_timer(GpuTimer &timer) {
+        glDeleteQueries(GpuTimer::N_QUERIES, timer.queries);
+        for (int i = 0; i < GpuTimer::N_QUERIES; i++) {
+            timer.queries[i] = 0;
+            timer.pending[i] = false;
+        }
+    }
+
+    void gpu_timer_begin(GpuTimer &timer, uint64_t frame) {
+        if (timer.pending[timer.next]) {
+            return;
+        }
+        timer.active = timer.next;
+        timer.next = (timer.next + 1) % GpuTimer::N_QUERIES;
+        timer.frames[timer.active] = frame;
+        glBeginQuery(GL_TIME_ELAPSED, timer.queries[timer.active]);
+    }
+
+    void gpu_timer_end(GpuTimer &timer) {
+        if (timer.active < 0) {
+            return;
+        }
+        glEndQuery(GL_TIME_ELAPSED);
+        timer.pending[timer.active] = true;
+        timer.active = -1;
+    }
+
+    // calls on_result(frame, gpu_ms) for every query whose result has arrived
+    template<typename OnResult>
+    void gpu_timer_collect(GpuTimer &timer, OnResult &&on_result) {
+        for (int i = 0; i < GpuTimer::N_QUERIES; i++) {
+            if (!timer.pending[i]) {
+                continue;
+            }
+            GLint available = 0;
+            glGetQueryObjectiv(timer.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                continue;
+            }
+            GLuint64 elapsed_ns = 0;
+            glGetQueryObjectui64v(timer.queries[i], GL_QUERY_RESULT, &elapsed_ns);
+            timer.pending[i] = false;
+            on_result(timer.frames[i], static_cast<double>(elapsed_ns) / 1e6);
+        }
+    }
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -3,6 +3,12 @@ import typing
 import numpy as np
 import matplotlib as mpl
 
+try:
+    # native engine, built with -DMATH_CPP_BUILD_PYTHON=ON (see README)
+    import mandelbrot_cpp
+except ImportError:
+    mandelbrot_cpp = None
+
 colormap = mpl.colormaps["turbo"]
 
 colors_bgr = np.clip(np.array(colormap.colors[::-1]) * 255, 0, 255).astype(int)
@@ -136,3 +142,23 @@ def mandelbrot_sequence_v2(
         mandelbrot_set[np.logical_not(threshold_crossed, already_set)] = color_bgr
 
     return mandelbrot_set
+
+
+def mandelbrot_sequence_native(
+    n_iterations: int,
+    complex_set: np._typing.NDArray,
+    mandelbrot_set: np._typing.NDArray,
+    threshold: float = 2.0,
+) -> np._typing.NDArray:
+    if mandelbrot_cpp is None:
+        raise ImportError("mandelbrot_cpp module is not built")
+
+    # greyscale is 255 * escape_iter / n_iterations, 0 for points that never escaped
+    greyscale = mandelbrot_cpp.mandelbrot_sequence(
+        complex_set, threshold=threshold, n_iterations=n_iterations
+    )
+    escaped = greyscale > 0
+    idx_color = greyscale[escaped] * len(colors_bgr) // 256
+    mandelbrot_set[escaped] = colors_bgr[idx_color]
+
+    return mandelbrot_set
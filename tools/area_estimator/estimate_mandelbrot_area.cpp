@@ -0,0 +1,146 @@
+#include <chrono>
+#include <fstream>
+
+#include <cxxopts.hpp>
+#include "spdlog/spdlog.h"
+
+#include "src/cpp/area.hpp"
+#include "src/cpp/atlas.hpp"
+#include "src/cpp/formulas.hpp"
+#include "src/cpp/thread_pool.hpp"
+
+
+// writes one line per region of the --regions grid, row-major from imag_min
+bool write_regions(const std::string &path, const area::Params &params, const area::Estimate &estimate) {
+    std::ofstream file(path);
+    if (!file) {
+        spdlog::error("Could not open {}", path);
+        return false;
+    }
+    const area::Region &region = params.region;
+    double re_step = (region.re_max - region.re_min) / params.regions_x;
+    double im_step = (region.im_max - region.im_min) / params.regions_y;
+    file << "real_min,real_max,imag_min,imag_max,interior_area,std_error,escape_area,mean_escape_iteration\n";
+    for (int row = 0; row < params.regions_y; row++) {
+        for (int col = 0; col < params.regions_x; col++) {
+            const area::RegionStats &stats = estimate.regions[static_cast<size_t>(row) * params.regions_x + col];
+            double re0 = region.re_min + col * re_step, im0 = region.im_min + row * im_step;
+            file << fmt::format("{},{},{},{},{:.9g},{:.3g},{:.9g},{:.6g}\n", re0, re0 + re_step, im0, im0 + im_step,
+                                stats.interior_area, stats.std_error(), stats.escape_area,
+                                stats.mean_escape_iteration());
+        }
+    }
+    return true;
+}
+
+// Estimates the area of the set (points not escaping within --n_iterations) in a region, with its standard
+// error and escape-time statistics, without rendering an image.
+int main(int argc, char *argv[]) {
+    cxxopts::Options options{argv[0], "Estimate the area and escape statistics of a region of a fractal"};
+    options.add_options()
+            ("rmin,real_min", "Real number minimum", cxxopts::value<double>()->default_value("-2.0"))
+            ("rmax,real_max", "Real number maximum", cxxopts::value<double>()->default_value("0.5"))
+            ("imin,imag_min", "Imaginary number minimum", cxxopts::value<double>()->default_value("-1.25"))
+            ("imax,imag_max", "Imaginary number maximum", cxxopts::value<double>()->default_value("1.25"))
+            ("i,n_iterations", "Iteration cap: points still bounded after it count as inside",
+             cxxopts::value<int>()->default_value("10000"))
+            ("t,threshold", "Abs value threshold", cxxopts::value<double>()->default_value("2.0"))
+            ("f,formula", "Iteration formula: mandelbrot, julia, multibrot, burning_ship, tricorn",
+             cxxopts::value<std::string>()->default_value("mandelbrot"))
+            ("power", "Multibrot power (2-8)", cxxopts::value<int>()->default_value("3"))
+            ("julia_re", "Julia constant, real part", cxxopts::value<double>()->default_value("-0.8"))
+            ("julia_im", "Julia constant, imaginary part", cxxopts::value<double>()->default_value("0.156"))
+            ("g,grid", "Cells per side of the initial split, the parallel work units",
+             cxxopts::value<int>()->default_value("32"))
+            ("d,max_depth", "Quadtree splits below a grid cell", cxxopts::value<int>()->default_value("8"))
+            ("samples", "Samples per side of a boundary leaf", cxxopts::value<int>()->default_value("4"))
+            ("refine", "Boundary leaves with mixed samples get (refine x samples)^2 more",
+             cxxopts::value<int>()->default_value("4"))
+            ("regions_x", "Columns of the per-region statistics (must divide --grid)",
+             cxxopts::value<int>()->default_value("1"))
+            ("regions_y", "Rows of the per-region statistics (must divide --grid)",
+             cxxopts::value<int>()->default_value("1"))
+            ("o,output", "CSV file for the per-region statistics", cxxopts::value<std::string>()->default_value(""))
+            ("seed", "Random seed of the sample jitter", cxxopts::value<uint64_t>()->default_value("1"))
+            ("atlas", "Interior / early-escape atlas from build_mandelbrot_atlas, consulted before certifying cells",
+             cxxopts::value<std::string>()->default_value(""))
+            ("j,n_threads", "Number of worker threads (0 - all cores)", cxxopts::value<int>()->default_value("0"));
+    auto result = options.parse(argc, argv);
+
+    area::Params params;
+    params.region = {result["real_min"].as<double>(), result["real_max"].as<double>(),
+                     result["imag_min"].as<double>(), result["imag_max"].as<double>()};
+    params.n_iterations = result["n_iterations"].as<int>();
+    params.threshold = result["threshold"].as<double>();
+    params.grid = result["grid"].as<int>();
+    params.max_depth = result["max_depth"].as<int>();
+    params.samples = result["samples"].as<int>();
+    params.refine = result["refine"].as<int>();
+    params.regions_x = result["regions_x"].as<int>();
+    params.regions_y = result["regions_y"].as<int>();
+    params.seed = result["seed"].as<uint64_t>();
+    if (params.region.re_min >= params.region.re_max || params.region.im_min >= params.region.im_max ||
+        params.n_iterations < 1 || params.grid < 1 || params.max_depth < 0 || params.max_depth > 30 ||
+        params.samples < 1 || params.refine < 1) {
+        spdlog::error("Need a non-empty region, n_iterations, grid, samples, refine >= 1 and 0 <= max_depth <= 30");
+        return -1;
+    }
+    if (params.regions_x < 1 || params.regions_y < 1 || params.grid % params.regions_x != 0 ||
+        params.grid % params.regions_y != 0) {
+        spdlog::error("--regions_x and --regions_y must divide --grid {}", params.grid);
+        return -1;
+    }
+
+    formulas::FormulaSpec formula_spec;
+    formula_spec.name = result["formula"].as<std::string>();
+    formula_spec.power = result["power"].as<int>();
+    formula_spec.julia_c = {result["julia_re"].as<double>(), result["julia_im"].as<double>()};
+
+    atlas::Atlas cells;
+    if (!result["atlas"].as<std::string>().empty()) {
+        if (!cells.load(result["atlas"].as<std::string>())) {
+            return -1;
+        }
+        atlas::install(&cells);
+    }
+
+    thread_pool::ThreadPool pool(result["n_threads"].as<int>());
+    spdlog::info("Estimating {} area: {} iterations, {}^2 cells, depth {} on {} threads",
+                 formula_spec.name, params.n_iterations, params.grid, params.max_depth, pool.size());
+
+    auto t_start = std::chrono::steady_clock::now();
+    area::Estimate estimate;
+    bool known_formula = formulas::visit_formula(formula_spec, [&](const auto &formula) {
+        estimate = area::estimate(pool, formula, params);
+    });
+    if (!known_formula) {
+        spdlog::error("Unknown formula '{}' (power {})", formula_spec.name, formula_spec.power);
+        return -1;
+    }
+    auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t_start);
+
+    const area::RegionStats &total = estimate.total;
+    spdlog::info("Area {:.7f} +- {:.7f} (1 sigma, sampling only) in {} ms", total.interior_area, total.std_error(),
+                 elapsed_ms.count());
+    spdlog::info("Certified interior {:.5f}, certified exterior {:.5f}, sampled {:.5f} with {} samples in {} leaves",
+                 estimate.certified_interior_area, estimate.certified_escape_area, estimate.sampled_area,
+                 estimate.n_samples, estimate.n_leaves);
+    spdlog::info("Escaping area {:.5f}, mean escape iteration {:.3f}", total.escape_area,
+                 total.mean_escape_iteration());
+    for (int bin = 0; bin < area::N_HISTOGRAM_BINS; bin++) {
+        if (estimate.escape_histogram[bin] > 0.0) {
+            int begin = bin == 0 ? 0 : 1 << (bin - 1);
+            spdlog::info("  escape iterations [{}, {}): area {:.6f}", begin, bin == 0 ? 1 : 2 * begin,
+                         estimate.escape_histogram[bin]);
+        }
+    }
+
+    std::string output = result["output"].as<std::string>();
+    if (!output.empty()) {
+        if (!write_regions(output, params, estimate)) {
+            return -1;
+        }
+        spdlog::info("Saved region statistics at: {}", output);
+    }
+    return 0;
+}
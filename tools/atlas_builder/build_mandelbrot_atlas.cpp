@@ -0,0 +1,104 @@
+#include <chrono>
+
+#include <cxxopts.hpp>
+#include "spdlog/spdlog.h"
+
+#include "src/cpp/atlas.hpp"
+#include "src/cpp/thread_pool.hpp"
+
+
+// Builds the interior / early-escape atlas read by render_mandelbrot_opencv_img --atlas.
+// The square is split into 4^split_depth cells that are built on the worker threads, then merged upwards.
+int main(int argc, char *argv[]) {
+    cxxopts::Options options{argv[0], "Build a quadtree atlas of cells proven inside the Mandelbrot set or escaping early"};
+    options.add_options()
+            ("o,output", "Atlas file", cxxopts::value<std::string>()->default_value("mandelbrot_atlas.bin"))
+            ("d,max_depth", "Deepest level of the quadtree (cells of 4 / 2^max_depth)",
+             cxxopts::value<int>()->default_value("12"))
+            ("i,n_iterations", "Iteration cap: escape leaves hold iterations below it",
+             cxxopts::value<int>()->default_value("1000"))
+            ("t,threshold", "Abs value threshold the escape leaves are valid for",
+             cxxopts::value<double>()->default_value("6.0"))
+            ("j,n_threads", "Number of worker threads (0 - all cores)", cxxopts::value<int>()->default_value("0"));
+    auto result = options.parse(argc, argv);
+
+    int max_depth = result["max_depth"].as<int>();
+    int n_iterations = result["n_iterations"].as<int>();
+    double threshold = result["threshold"].as<double>();
+    if (max_depth < 0 || max_depth > 24 || n_iterations < 1 || threshold < 2.0) {
+        spdlog::error("Need 0 <= max_depth <= 24, n_iterations >= 1 and threshold >= 2");
+        return -1;
+    }
+
+    atlas::Header header{};
+    std::copy(std::begin(atlas::MAGIC), std::end(atlas::MAGIC), header.magic);
+    header.version = atlas::FORMAT_VERSION;
+    header.threshold = threshold;
+    header.n_iterations = static_cast<uint32_t>(n_iterations);
+    header.max_depth = static_cast<uint32_t>(max_depth);
+    header.re_min = -2.0;
+    header.im_min = -2.0;
+    header.size = 4.0;
+
+    thread_pool::ThreadPool pool(result["n_threads"].as<int>());
+    int split_depth = std::min(max_depth, 4);
+    int n_side = 1 << split_depth;
+    double cell_size = header.size / n_side;
+    spdlog::info("Building atlas: depth {}, {} iterations, threshold {} on {} threads",
+                 max_depth, n_iterations, threshold, pool.size());
+
+    // cells of the split level, row-major from the lower left corner
+    auto t_build = std::chrono::steady_clock::now();
+    std::vector<atlas::Subtree> level(static_cast<size_t>(n_side) * n_side);
+    pool.parallel_for(static_cast<int>(level.size()), [&](int idx_cell) {
+        level[idx_cell] = atlas::build_cell(
+                header.re_min + (idx_cell % n_side) * cell_size, header.im_min + (idx_cell / n_side) * cell_size,
+                cell_size, split_depth, max_depth, threshold, n_iterations
+        );
+    });
+
+    for (; n_side > 1; n_side /= 2) {
+        int n_parent_side = n_side / 2;
+        std::vector<atlas::Subtree> parents(static_cast<size_t>(n_parent_side) * n_parent_side);
+        for (int idx_parent = 0; idx_parent < static_cast<int>(parents.size()); idx_parent++) {
+            int px = idx_parent % n_parent_side, py = idx_parent / n_parent_side;
+            atlas::Subtree children[4];
+            for (int idx_child = 0; idx_child < 4; idx_child++) {
+                int cx = 2 * px + idx_child % 2, cy = 2 * py + idx_child / 2;
+                children[idx_child] = std::move(level[static_cast<size_t>(cy) * n_side + cx]);
+            }
+            parents[idx_parent] = atlas::merge_children(children);
+        }
+        level = std::move(parents);
+    }
+    const atlas::Subtree &nodes = level[0];
+    header.n_nodes = nodes.size();
+    auto build_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t_build);
+
+    // area of each kind of leaf, for the log
+    double interior_area = 0.0, escape_area = 0.0;
+    std::vector<std::pair<uint32_t, double>> stack{{0, header.size}};
+    while (!stack.empty()) {
+        auto [idx_node, size] = stack.back();
+        stack.pop_back();
+        uint32_t node = nodes[idx_node];
+        if (node == atlas::NODE_INTERIOR) {
+            interior_area += size * size;
+        } else if (atlas::is_leaf(node) && node != atlas::NODE_UNKNOWN) {
+            escape_area += size * size;
+        } else if (!atlas::is_leaf(node)) {
+            for (uint32_t idx_child = 0; idx_child < 4; idx_child++) {
+                stack.emplace_back(node + idx_child, size / 2.0);
+            }
+        }
+    }
+    spdlog::info("Built {} nodes in {} ms: interior area {:.4f}, early escape area {:.4f} of {:.1f}",
+                 nodes.size(), build_ms.count(), interior_area, escape_area, header.size * header.size);
+
+    std::string output = result["output"].as<std::string>();
+    if (!atlas::write(output, header, nodes)) {
+        return -1;
+    }
+    spdlog::info("Saved atlas at: {}", output);
+    return 0;
+}